@@ -0,0 +1,114 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_BENCH_H
+#define PROJECT_INCLUDES_BENCH_H
+
+#include "keyvo.h"
+#include "client.h"
+#include "histogram.h"
+#include "workload.h"
+
+/**
+ * @brief The longest the generator will sleep in select()
+ * at a time, in microseconds.
+ *
+ */
+#ifndef BENCH_POLL_INTERVAL
+#define BENCH_POLL_INTERVAL 1000
+#endif
+
+/**
+ * @brief The most preload requests that may be in flight
+ * across every connection at once. Preloading is
+ * closed-loop, and keeping the window small stops it from
+ * overrunning the server's socket buffer and losing
+ * datagrams, however many connections there are.
+ *
+ */
+#ifndef BENCH_PRELOAD_WINDOW
+#define BENCH_PRELOAD_WINDOW 64
+#endif
+
+/**
+ * @brief How the load is to be generated, as given on the
+ * command line.
+ *
+ */
+struct bench_options_t {
+    enum transport_t transport;
+    const char* host;
+    const char* port;
+    const char* socket_path;
+
+    double rate;
+    double duration;
+    size_t connections;
+    uint64_t timeout;
+
+    bool preload;
+    bool cache_aside;
+};
+
+/**
+ * @brief What happened during a run.
+ *
+ * @details The corrected histogram measures every request
+ * from the moment the schedule says it should have been
+ * sent; the uncorrected one from the moment it actually
+ * was. The gap between the two shows how much the server's
+ * stalls were hiding from a closed-loop client.
+ *
+ */
+struct bench_results_t {
+    uint64_t sent;
+    uint64_t completed;
+    uint64_t lost;
+    uint64_t errors;
+    uint64_t busy;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t fills;
+    uint64_t send_lag;
+    uint64_t elapsed;
+
+    struct histogram_t corrected;
+    struct histogram_t uncorrected;
+};
+
+/**
+ * @brief A load generator and the connections it drives.
+ *
+ */
+struct bench_t {
+    const struct bench_options_t* options;
+    struct workload_t* workload;
+
+    struct client_t** clients;
+    int max_socket;
+
+    char value[VALUE_SIZE_MAXIMUM];
+    struct bench_results_t results;
+};
+
+void bench_initialize(struct bench_t* bench, const struct bench_options_t* options, struct workload_t* workload);
+
+void bench_preload(struct bench_t* bench);
+
+void bench_run(struct bench_t* bench);
+
+void bench_report(const struct bench_t* bench, FILE* stream);
+
+#endif /** PROJECT_INCLUDES_BENCH_H */
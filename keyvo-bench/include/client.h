@@ -0,0 +1,188 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_CLIENT_H
+#define PROJECT_INCLUDES_CLIENT_H
+
+#include "keyvo.h"
+
+/**
+ * @brief The most requests a single connection may have in
+ * flight. When a connection reaches this limit, the
+ * generator waits for replies before sending on it again,
+ * and the wait is charged to the requests that were held
+ * back.
+ *
+ */
+#ifndef CLIENT_PENDING_LIMIT
+#define CLIENT_PENDING_LIMIT 1024
+#endif
+
+/**
+ * @brief The largest value the generator will write. This
+ * keeps every request and reply inside a single datagram.
+ *
+ */
+#ifndef VALUE_SIZE_MAXIMUM
+#define VALUE_SIZE_MAXIMUM 60000
+#endif
+
+/**
+ * @brief Room for the longest request the generator sends,
+ * and the longest reply it expects back.
+ *
+ */
+#define REQUEST_SIZE_MAXIMUM (VALUE_SIZE_MAXIMUM + 64)
+
+#ifndef CLIENT_INPUT_SIZE
+#define CLIENT_INPUT_SIZE (2 * REQUEST_SIZE_MAXIMUM)
+#endif
+
+#ifndef CLIENT_OUTPUT_SIZE
+#define CLIENT_OUTPUT_SIZE (4 * REQUEST_SIZE_MAXIMUM)
+#endif
+
+/**
+ * @brief The ways the generator can reach the server.
+ *
+ */
+enum transport_t {
+    TRANSPORT_UDP,
+    TRANSPORT_TCP,
+    TRANSPORT_UNIX
+};
+
+/**
+ * @brief What a request in flight was for. Fills are the
+ * DEFINEs used to preload the key space and to repopulate
+ * the cache after a miss; they are not part of the measured
+ * load.
+ *
+ */
+enum request_kind_t {
+    REQUEST_GET,
+    REQUEST_UPDATE,
+    REQUEST_FILL
+};
+
+/**
+ * @brief A request that has been sent and not yet answered.
+ *
+ * @details The intended time is when the request should
+ * have gone out according to the fixed-rate schedule; the
+ * sent time is when it actually did. Latency measured from
+ * the former is corrected for coordinated omission, since
+ * it includes any time the request spent waiting behind a
+ * slow one.
+ *
+ * Over UDP, every request also carries a sequence number,
+ * which the server echoes back in its reply.
+ *
+ */
+struct request_t {
+    uint64_t intended;
+    uint64_t sent;
+    uint64_t key;
+    enum request_kind_t kind;
+
+    uint32_t sequence;
+    bool answered;
+};
+
+/**
+ * @brief A single connection to the server.
+ *
+ * @details Replies on a stream come back in the order the
+ * requests were sent, so the requests in flight are kept in
+ * a FIFO and matched up with replies as they arrive.
+ *
+ * Over UDP, each datagram carries exactly one request or
+ * reply, but datagrams can be lost, so order alone is not
+ * enough: every request is prefixed with an ECHO of its
+ * sequence number, and the reply is matched up by that. A
+ * request answered out of turn is marked as such, and
+ * skipped over once everything before it has been answered
+ * or given up on.
+ *
+ */
+struct client_t {
+    int socket;
+    bool datagram;
+
+    struct request_t pending[CLIENT_PENDING_LIMIT];
+    size_t pending_head;
+    size_t pending_count;
+    uint32_t next_sequence;
+
+    size_t input_length;
+    char input[CLIENT_INPUT_SIZE];
+
+    size_t output_length;
+    size_t output_sent;
+    char output[CLIENT_OUTPUT_SIZE];
+};
+
+/**
+ * @brief The function a client hands every complete reply
+ * to, along with the request it answers.
+ *
+ */
+typedef void (*reply_callback_t)(void* context, struct client_t* client, const struct request_t* request, const char* reply);
+
+struct client_t* client_connect(enum transport_t transport, const char* host, const char* port, const char* socket_path);
+
+bool client_send(struct client_t* client, const struct request_t* request, const char* command, size_t length);
+
+bool client_flush(struct client_t* client);
+
+bool client_receive(struct client_t* client, reply_callback_t callback, void* context);
+
+bool client_pop_pending(struct client_t* client, struct request_t* request);
+
+/**
+ * @brief Check whether the client can take another request.
+ *
+ * @param client
+ * @return true
+ * @return false
+ */
+static inline bool client_has_room(const struct client_t* client) {
+    return (client->pending_count < CLIENT_PENDING_LIMIT) && (client->datagram || (CLIENT_OUTPUT_SIZE - client->output_length >= REQUEST_SIZE_MAXIMUM));
+}
+
+/**
+ * @brief Return the oldest request in flight on the client,
+ * or NULL if there is none.
+ *
+ * @param client
+ * @return const struct request_t*
+ */
+static inline const struct request_t* client_oldest_pending(const struct client_t* client) {
+    return client->pending_count ? &client->pending[client->pending_head] : NULL;
+}
+
+/**
+ * @brief Check whether the client still has request data
+ * waiting to be written.
+ *
+ * @param client
+ * @return true
+ * @return false
+ */
+static inline bool client_pending_output(const struct client_t* client) {
+    return client->output_sent < client->output_length;
+}
+
+#endif /** PROJECT_INCLUDES_CLIENT_H */
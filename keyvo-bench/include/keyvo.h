@@ -0,0 +1,45 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_KEYVO_H
+#define PROJECT_INCLUDES_KEYVO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#if !defined(unix) || !defined(linux)
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <sys/un.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <errno.h>
+#else
+    #error "The current platform is not supported."
+#endif /** Require a Unix-like environment */
+
+#endif /** PROJECT_INCLUDES_KEYVO_H */
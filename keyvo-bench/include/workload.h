@@ -0,0 +1,94 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_WORKLOAD_H
+#define PROJECT_INCLUDES_WORKLOAD_H
+
+#include "keyvo.h"
+
+/**
+ * @brief How request keys are drawn from the key space.
+ *
+ */
+enum distribution_t {
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_ZIPF
+};
+
+/**
+ * @brief Everything needed to draw the next request's key,
+ * operation and value size.
+ *
+ * @details The Zipfian generator is the one described by
+ * Gray et al. in "Quickly Generating Billion-Record
+ * Synthetic Databases", which is also what YCSB uses. Key
+ * zero is the most popular one, key one the next most
+ * popular, and so on.
+ *
+ */
+struct workload_t {
+    uint64_t random_state;
+
+    enum distribution_t distribution;
+    uint64_t keys;
+
+    double read_ratio;
+
+    size_t value_size_minimum;
+    size_t value_size_maximum;
+
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+};
+
+/**
+ * @brief Return the next number from the xorshift64*
+ * generator.
+ *
+ * @param state
+ * @return uint64_t
+ */
+static inline uint64_t random_next(uint64_t* state) {
+    uint64_t x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+/**
+ * @brief Return a random number in [0, 1).
+ *
+ * @param state
+ * @return double
+ */
+static inline double random_unit(uint64_t* state) {
+    return (double) (random_next(state) >> 11) * 0x1.0p-53;
+}
+
+void workload_initialize(struct workload_t* workload, uint64_t seed);
+
+uint64_t workload_next_key(struct workload_t* workload);
+
+bool workload_next_is_read(struct workload_t* workload);
+
+size_t workload_next_value_size(struct workload_t* workload);
+
+#endif /** PROJECT_INCLUDES_WORKLOAD_H */
@@ -0,0 +1,401 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "bench.h"
+
+#include <inttypes.h>
+
+/**
+ * @brief The wire name of every transport, indexed by its
+ * transport_t.
+ *
+ */
+static const char* const transport_names[] = { "udp", "tcp", "unix" };
+
+/**
+ * @brief Open every connection the run calls for, and fill
+ * in the value that writes draw their payloads from.
+ *
+ * @param bench
+ * @param options
+ * @param workload
+ */
+void bench_initialize(struct bench_t* bench, const struct bench_options_t* options, struct workload_t* workload) {
+    bench->options = options;
+    bench->workload = workload;
+    bench->max_socket = -1;
+    memset(&bench->results, 0, sizeof (struct bench_results_t));
+
+    for (size_t i = 0; i < VALUE_SIZE_MAXIMUM; ++i) {
+        bench->value[i] = 'a' + (i % 26);
+    }
+
+    bench->clients = calloc(options->connections, sizeof (struct client_t*));
+
+    if (bench->clients == NULL) {
+        fprintf(stderr, "%s\n", "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < options->connections; ++i) {
+        bench->clients[i] = client_connect(options->transport, options->host, options->port, options->socket_path);
+
+        if (bench->clients[i]->socket >= FD_SETSIZE) {
+            fprintf(stderr, "%s\n", "Too many connections.");
+            exit(EXIT_FAILURE);
+        }
+
+        if (bench->clients[i]->socket > bench->max_socket) {
+            bench->max_socket = bench->clients[i]->socket;
+        }
+    }
+}
+
+/**
+ * @brief Build the command for a request and send it.
+ *
+ * @param bench
+ * @param client
+ * @param kind
+ * @param key
+ * @param intended
+ * @param now
+ * @return false if the client has no room for it yet.
+ */
+static bool issue(struct bench_t* bench, struct client_t* client, enum request_kind_t kind, uint64_t key, uint64_t intended, uint64_t now) {
+    char command[REQUEST_SIZE_MAXIMUM];
+    int length = 0;
+
+    if (kind == REQUEST_GET) {
+        length = snprintf(command, sizeof (command), "GET key:%" PRIu64 "\n", key);
+    } else {
+        int value_size = (int) workload_next_value_size(bench->workload);
+        const char* verb = (kind == REQUEST_UPDATE) ? "UPDATE" : "DEFINE";
+
+        length = snprintf(command, sizeof (command), "%s key:%" PRIu64 " %.*s\n", verb, key, value_size, bench->value);
+    }
+
+    struct request_t request = { intended, now, key, kind, 0, false };
+
+    return client_send(client, &request, command, (size_t) length);
+}
+
+/**
+ * @brief Tally up a reply. If the server missed on a read
+ * and the run is emulating a cache-aside client, the key is
+ * filled straight back in. An update that finds its key
+ * missing, as it will when the key space was not preloaded,
+ * is always followed by a DEFINE, so that the write still
+ * happens.
+ *
+ * @param context
+ * @param client
+ * @param request
+ * @param reply
+ */
+static void handle_reply(void* context, struct client_t* client, const struct request_t* request, const char* reply) {
+    struct bench_t* bench = context;
+    struct bench_results_t* results = &bench->results;
+    uint64_t now = monotonic_nanoseconds();
+
+    if (request->kind == REQUEST_FILL) {
+        results->fills += 1;
+        return;
+    }
+
+    results->completed += 1;
+
+    histogram_record(&results->corrected, now - request->intended);
+    histogram_record(&results->uncorrected, now - request->sent);
+
+    if (strncmp(reply, "VALUE", 5) == 0) {
+        results->hits += 1;
+    } else if (strcmp(reply, "NOT_FOUND") == 0) {
+        if (request->kind == REQUEST_GET) {
+            results->misses += 1;
+
+            if (bench->options->cache_aside) {
+                issue(bench, client, REQUEST_FILL, request->key, now, now);
+            }
+        } else {
+            issue(bench, client, REQUEST_FILL, request->key, now, now);
+        }
+    } else if (strcmp(reply, "BUSY") == 0) {
+        results->busy += 1;
+    } else if (strcmp(reply, "OK") != 0) {
+        results->errors += 1;
+    }
+}
+
+/**
+ * @brief Return the number of requests in flight across
+ * every connection.
+ *
+ * @param bench
+ * @return uint64_t
+ */
+static uint64_t outstanding(const struct bench_t* bench) {
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < bench->options->connections; ++i) {
+        count += bench->clients[i]->pending_count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Give up on a request that will never be answered.
+ *
+ * @param bench
+ * @param request
+ */
+static void abandon(struct bench_t* bench, const struct request_t* request) {
+    if (request->kind != REQUEST_FILL) {
+        bench->results.lost += 1;
+    }
+}
+
+/**
+ * @brief Wait up to the given number of nanoseconds for the
+ * connections to become ready, then move data both ways.
+ * Datagrams that have gone unanswered for longer than the
+ * timeout are counted as lost.
+ *
+ * @param bench
+ * @param wait
+ */
+static void bench_poll(struct bench_t* bench, uint64_t wait) {
+    fd_set reads;
+    fd_set writes;
+    FD_ZERO(&reads);
+    FD_ZERO(&writes);
+
+    for (size_t i = 0; i < bench->options->connections; ++i) {
+        FD_SET(bench->clients[i]->socket, &reads);
+
+        if (client_pending_output(bench->clients[i])) {
+            FD_SET(bench->clients[i]->socket, &writes);
+        }
+    }
+
+    struct timeval timeout = { (time_t) (wait / 1000000000), (suseconds_t) ((wait % 1000000000) / 1000) };
+
+    if (select(bench->max_socket + 1, &reads, &writes, 0, &timeout) < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+
+        perror("select");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < bench->options->connections; ++i) {
+        struct client_t* client = bench->clients[i];
+
+        if (FD_ISSET(client->socket, &writes) && !client_flush(client)) {
+            fprintf(stderr, "%s\n", "Lost the connection to the server.");
+            exit(EXIT_FAILURE);
+        }
+
+        if (FD_ISSET(client->socket, &reads) && !client_receive(client, handle_reply, bench)) {
+            fprintf(stderr, "%s\n", "The server closed the connection.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t now = monotonic_nanoseconds();
+
+    for (size_t i = 0; i < bench->options->connections; ++i) {
+        struct client_t* client = bench->clients[i];
+        const struct request_t* oldest = NULL;
+        struct request_t request;
+
+        if (!client->datagram) {
+            continue;
+        }
+
+        while ((oldest = client_oldest_pending(client)) && (oldest->sent + bench->options->timeout <= now)) {
+            client_pop_pending(client, &request);
+            abandon(bench, &request);
+        }
+    }
+}
+
+/**
+ * @brief Define every key in the key space, so that the
+ * measured run starts from a warm cache.
+ *
+ * @details This phase is closed-loop: it goes as fast as
+ * the server lets it, and none of it is measured.
+ *
+ * @param bench
+ */
+void bench_preload(struct bench_t* bench) {
+    size_t connections = bench->options->connections;
+
+    for (uint64_t key = 0; key < bench->workload->keys; ) {
+        struct client_t* client = bench->clients[key % connections];
+        uint64_t now = monotonic_nanoseconds();
+
+        if ((outstanding(bench) < BENCH_PRELOAD_WINDOW) && issue(bench, client, REQUEST_FILL, key, now, now)) {
+            ++key;
+        } else {
+            bench_poll(bench, BENCH_POLL_INTERVAL * 1000);
+        }
+    }
+
+    while (outstanding(bench) != 0) {
+        bench_poll(bench, BENCH_POLL_INTERVAL * 1000);
+    }
+
+    memset(&bench->results, 0, sizeof (struct bench_results_t));
+}
+
+/**
+ * @brief Generate the load and measure it.
+ *
+ * @details The load is open-loop: request i is due exactly
+ * i / rate seconds after the start, whether or not earlier
+ * requests have been answered, and requests are dealt out
+ * to the connections round-robin. When the generator can
+ * not keep up, because a connection has too much in flight
+ * or the socket is full, the requests it holds back are
+ * sent as soon as it can, and their latency is still
+ * measured from when they were due.
+ *
+ * @param bench
+ */
+void bench_run(struct bench_t* bench) {
+    const struct bench_options_t* options = bench->options;
+    struct bench_results_t* results = &bench->results;
+
+    uint64_t total = (uint64_t) (options->rate * options->duration);
+    double interval = 1e9 / options->rate;
+
+    uint64_t start = monotonic_nanoseconds();
+    uint64_t deadline = start + (uint64_t) ((double) total * interval) + options->timeout;
+    uint64_t now = start;
+
+    enum request_kind_t kind = REQUEST_GET;
+    uint64_t key = 0;
+    bool drawn = false;
+    uint64_t i = 0;
+
+    while (1) {
+        now = monotonic_nanoseconds();
+
+        uint64_t intended = start + (uint64_t) ((double) i * interval);
+
+        while ((i < total) && (intended <= now)) {
+            if (!drawn) {
+                kind = workload_next_is_read(bench->workload) ? REQUEST_GET : REQUEST_UPDATE;
+                key = workload_next_key(bench->workload);
+                drawn = true;
+            }
+
+            if (!issue(bench, bench->clients[i % options->connections], kind, key, intended, now)) {
+                break;
+            }
+
+            if (now - intended > results->send_lag) {
+                results->send_lag = now - intended;
+            }
+
+            results->sent += 1;
+            drawn = false;
+
+            intended = start + (uint64_t) ((double) ++i * interval);
+        }
+
+        if ((i == total) && ((outstanding(bench) == 0) || (now >= deadline))) {
+            break;
+        }
+
+        uint64_t wait = BENCH_POLL_INTERVAL * 1000;
+
+        if ((i < total) && (intended > now) && (intended - now < wait)) {
+            wait = intended - now;
+        }
+
+        bench_poll(bench, wait);
+    }
+
+    results->elapsed = now - start;
+
+    for (size_t c = 0; c < options->connections; ++c) {
+        struct request_t request;
+
+        while (client_pop_pending(bench->clients[c], &request)) {
+            abandon(bench, &request);
+        }
+    }
+}
+
+/**
+ * @brief Convert a latency to microseconds for printing.
+ *
+ * @param nanoseconds
+ * @return double
+ */
+static double microseconds(uint64_t nanoseconds) {
+    return (double) nanoseconds / 1000.0;
+}
+
+/**
+ * @brief Print what happened during the run.
+ *
+ * @param bench
+ * @param stream
+ */
+void bench_report(const struct bench_t* bench, FILE* stream) {
+    const struct bench_options_t* options = bench->options;
+    const struct bench_results_t* results = &bench->results;
+
+    double seconds = (double) results->elapsed / 1e9;
+    uint64_t lookups = results->hits + results->misses;
+
+    fprintf(stream, "%-16s %s\n", "transport", transport_names[options->transport]);
+    fprintf(stream, "%-16s %zu\n", "connections", options->connections);
+    fprintf(stream, "%-16s %.0f req/s\n", "target rate", options->rate);
+    fprintf(stream, "%-16s %.3f s\n", "elapsed", seconds);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "sent", results->sent);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "completed", results->completed);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "lost", results->lost);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "errors", results->errors);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "busy", results->busy);
+    fprintf(stream, "%-16s %.0f req/s\n", "throughput", seconds > 0 ? (double) results->completed / seconds : 0.0);
+    fprintf(stream, "%-16s %.4f (%" PRIu64 " hits, %" PRIu64 " misses)\n", "hit ratio", lookups ? (double) results->hits / (double) lookups : 0.0, results->hits, results->misses);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "fills", results->fills);
+    fprintf(stream, "%-16s %.1f us\n", "max send lag", microseconds(results->send_lag));
+
+    fprintf(stream, "\n%-16s %12s %12s\n", "latency (us)", "corrected", "uncorrected");
+
+    static const struct {
+        const char* name;
+        double percentile;
+    } rows[] = {
+        { "p50",   50.0 },
+        { "p99",   99.0 },
+        { "p99.9", 99.9 },
+        { "max",  100.0 }
+    };
+
+    for (size_t row = 0; row < sizeof (rows) / sizeof (rows[0]); ++row) {
+        fprintf(stream, "%-16s %12.1f %12.1f\n", rows[row].name,
+            microseconds(histogram_percentile(&results->corrected, rows[row].percentile)),
+            microseconds(histogram_percentile(&results->uncorrected, rows[row].percentile)));
+    }
+}
@@ -0,0 +1,382 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "client.h"
+
+#include <inttypes.h>
+
+/**
+ * @brief Open a socket to the server over the given
+ * transport. Failing to reach the server is fatal.
+ *
+ * @param transport
+ * @param host
+ * @param port
+ * @return int
+ */
+static int open_socket(enum transport_t transport, const char* host, const char* port, const char* socket_path) {
+    int client_socket = -1;
+
+    if (transport == TRANSPORT_UNIX) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof (struct sockaddr_un));
+        address.sun_family = AF_UNIX;
+
+        if (strlen(socket_path) >= sizeof (address.sun_path)) {
+            fprintf(stderr, "%s: %s\n", "Socket path is too long", socket_path);
+            exit(EXIT_FAILURE);
+        }
+
+        strcpy(address.sun_path, socket_path);
+
+        if ((client_socket = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+            perror("socket");
+            exit(EXIT_FAILURE);
+        }
+
+        if (connect(client_socket, (struct sockaddr *) &address, sizeof (address))) {
+            fprintf(stderr, "%s %s: %s\n", "Could not connect to", socket_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        return client_socket;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof (struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = (transport == TRANSPORT_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+
+    struct addrinfo* server_address = NULL;
+
+    int error = 0;
+
+    if ((error = getaddrinfo(host, port, &hints, &server_address)) != 0) {
+        fprintf(stderr, "%s\n", gai_strerror(error));
+        exit(EXIT_FAILURE);
+    }
+
+    for (struct addrinfo* address = server_address; address; address = address->ai_next) {
+        client_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+        if (client_socket == -1) {
+            continue;
+        }
+
+        if (connect(client_socket, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+
+        close(client_socket);
+        client_socket = -1;
+    }
+
+    freeaddrinfo(server_address);
+
+    if (client_socket == -1) {
+        fprintf(stderr, "%s %s:%s\n", "Could not connect to", host, port);
+        exit(EXIT_FAILURE);
+    }
+
+    if (transport == TRANSPORT_TCP) {
+        int enable = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof (enable));
+    }
+
+    return client_socket;
+}
+
+/**
+ * @brief Open a new connection to the server. The socket is
+ * switched to non-blocking mode once it is connected, so
+ * that a stalled server can never hold up the schedule.
+ *
+ * @param transport
+ * @param host
+ * @param port
+ * @param socket_path
+ * @return struct client_t*
+ */
+struct client_t* client_connect(enum transport_t transport, const char* host, const char* port, const char* socket_path) {
+    struct client_t* client = malloc(sizeof (struct client_t));
+
+    if (client == NULL) {
+        fprintf(stderr, "%s\n", "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    client->socket = open_socket(transport, host, port, socket_path);
+    client->datagram = (transport == TRANSPORT_UDP);
+    client->pending_head = 0;
+    client->pending_count = 0;
+    client->next_sequence = 0;
+    client->input_length = 0;
+    client->output_length = 0;
+    client->output_sent = 0;
+
+    int flags = fcntl(client->socket, F_GETFL, 0);
+    fcntl(client->socket, F_SETFL, flags | O_NONBLOCK);
+
+    return client;
+}
+
+/**
+ * @brief Send a request, and remember it so that its reply
+ * can be matched up with it.
+ *
+ * @details Over a stream, the command is queued and as much
+ * of it written as the socket will take. Over UDP, it goes
+ * straight out as a single datagram, behind an ECHO of its
+ * sequence number.
+ *
+ * @param client
+ * @param request
+ * @param command
+ * @param length
+ * @return false if the request could not be sent yet, and
+ * should be retried later.
+ */
+bool client_send(struct client_t* client, const struct request_t* request, const char* command, size_t length) {
+    if (!client_has_room(client)) {
+        return false;
+    }
+
+    struct request_t sent = *request;
+
+    sent.sequence = client->next_sequence;
+    sent.answered = false;
+
+    if (client->datagram) {
+        char datagram[REQUEST_SIZE_MAXIMUM + 32];
+        int header_length = snprintf(datagram, sizeof (datagram), "ECHO %" PRIu32 "\n", sent.sequence);
+
+        memcpy(datagram + header_length, command, length);
+
+        if (send(client->socket, datagram, header_length + length, 0) == -1) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS) || (errno == EINTR)) {
+                return false;
+            }
+
+            perror("send");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        memcpy(client->output + client->output_length, command, length);
+        client->output_length += length;
+    }
+
+    client->pending[(client->pending_head + client->pending_count) % CLIENT_PENDING_LIMIT] = sent;
+    client->pending_count += 1;
+    client->next_sequence += 1;
+
+    if (!client->datagram) {
+        client_flush(client);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write as much of the queued request data as the
+ * server will currently accept, and make room for more.
+ *
+ * @param client
+ * @return false if the connection has failed.
+ */
+bool client_flush(struct client_t* client) {
+    bool healthy = true;
+
+    while (client_pending_output(client)) {
+        ssize_t sent = send(client->socket, client->output + client->output_sent, client->output_length - client->output_sent, MSG_NOSIGNAL);
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            healthy = (errno == EAGAIN) || (errno == EWOULDBLOCK);
+            break;
+        }
+
+        client->output_sent += sent;
+    }
+
+    client->output_length -= client->output_sent;
+    memmove(client->output, client->output + client->output_sent, client->output_length);
+    client->output_sent = 0;
+
+    return healthy;
+}
+
+/**
+ * @brief Drop the requests at the front of the FIFO that
+ * have already been answered out of turn.
+ *
+ * @param client
+ */
+static void skip_answered(struct client_t* client) {
+    while ((client->pending_count != 0) && client->pending[client->pending_head].answered) {
+        client->pending_head = (client->pending_head + 1) % CLIENT_PENDING_LIMIT;
+        client->pending_count -= 1;
+    }
+}
+
+/**
+ * @brief Remove the oldest request in flight that has not
+ * been answered yet.
+ *
+ * @param client
+ * @param request
+ * @return false if there was no request in flight.
+ */
+bool client_pop_pending(struct client_t* client, struct request_t* request) {
+    skip_answered(client);
+
+    if (client->pending_count == 0) {
+        return false;
+    }
+
+    *request = client->pending[client->pending_head];
+    client->pending_head = (client->pending_head + 1) % CLIENT_PENDING_LIMIT;
+    client->pending_count -= 1;
+
+    skip_answered(client);
+
+    return true;
+}
+
+/**
+ * @brief Find the request a datagram reply answers, from
+ * the sequence number the server echoed back at the start
+ * of it, and mark it as answered.
+ *
+ * @param client
+ * @param reply The reply, which is advanced past the echo.
+ * @param request
+ * @return false if the reply answers nothing still in
+ * flight, because its request was already given up on.
+ */
+static bool claim_datagram_reply(struct client_t* client, char** reply, struct request_t* request) {
+    char* end = NULL;
+
+    if (strncmp(*reply, "ECHO ", 5) != 0) {
+        return false;
+    }
+
+    uint32_t sequence = (uint32_t) strtoul(*reply + 5, &end, 10);
+
+    if (*end != '\n') {
+        return false;
+    }
+
+    *reply = end + 1;
+
+    if (client->pending_count == 0) {
+        return false;
+    }
+
+    uint32_t offset = sequence - client->pending[client->pending_head].sequence;
+
+    if (offset >= client->pending_count) {
+        return false;
+    }
+
+    struct request_t* pending = &client->pending[(client->pending_head + offset) % CLIENT_PENDING_LIMIT];
+
+    if (pending->answered) {
+        return false;
+    }
+
+    pending->answered = true;
+    *request = *pending;
+
+    skip_answered(client);
+
+    return true;
+}
+
+/**
+ * @brief Read whatever replies have arrived, and hand each
+ * one to the callback together with the request it answers.
+ *
+ * @details Replies that answer nothing in flight, such as
+ * a datagram turning up after its request was already
+ * given up on, are ignored.
+ *
+ * @param client
+ * @param callback
+ * @param context
+ * @return false if the server closed the connection.
+ */
+bool client_receive(struct client_t* client, reply_callback_t callback, void* context) {
+    struct request_t request;
+
+    if (client->datagram) {
+        while (1) {
+            ssize_t bytes_received = recv(client->socket, client->input, CLIENT_INPUT_SIZE - 1, 0);
+
+            if (bytes_received < 0) {
+                return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) || (errno == ECONNREFUSED);
+            }
+
+            char* reply = client->input;
+
+            client->input[bytes_received] = '\0';
+
+            if (claim_datagram_reply(client, &reply, &request)) {
+                reply[strcspn(reply, "\n")] = '\0';
+                callback(context, client, &request, reply);
+            }
+        }
+    }
+
+    ssize_t bytes_received = recv(client->socket, client->input + client->input_length, CLIENT_INPUT_SIZE - client->input_length, 0);
+
+    if (bytes_received == 0) {
+        return false;
+    }
+
+    if (bytes_received < 0) {
+        return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    }
+
+    size_t start = client->input_length;
+    size_t consumed = 0;
+    client->input_length += bytes_received;
+
+    for (size_t i = start; i < client->input_length; ++i) {
+        if (client->input[i] != '\n') {
+            continue;
+        }
+
+        client->input[i] = '\0';
+
+        if (client_pop_pending(client, &request)) {
+            callback(context, client, &request, client->input + consumed);
+        }
+
+        consumed = i + 1;
+    }
+
+    client->input_length -= consumed;
+    memmove(client->input, client->input + consumed, client->input_length);
+
+    if (client->input_length == CLIENT_INPUT_SIZE) {
+        fprintf(stderr, "%s\n", "Reply too long; giving up.");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
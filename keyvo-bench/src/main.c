@@ -0,0 +1,312 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "keyvo.h"
+#include "bench.h"
+
+/**
+ * @brief The command-line options the load generator
+ * accepts.
+ *
+ */
+static struct option long_options[] = {
+    { "transport",      required_argument,  0,  't' },
+    { "host",           required_argument,  0,  'H' },
+    { "port",           required_argument,  0,  'p' },
+    { "socket-path",    required_argument,  0,  's' },
+    { "rate",           required_argument,  0,  'r' },
+    { "duration",       required_argument,  0,  'd' },
+    { "connections",    required_argument,  0,  'c' },
+    { "timeout",        required_argument,  0,  'T' },
+    { "keys",           required_argument,  0,  'k' },
+    { "distribution",   required_argument,  0,  'D' },
+    { "zipf-theta",     required_argument,  0,  'z' },
+    { "value-size",     required_argument,  0,  'V' },
+    { "read-ratio",     required_argument,  0,  'R' },
+    { "seed",           required_argument,  0,  'S' },
+    { "no-preload",     no_argument,        0,  'n' },
+    { "cache-aside",    no_argument,        0,  'a' },
+    { "help",           no_argument,        0,  'h' },
+    { 0,                0,                  0,   0  }
+};
+
+/**
+ * @brief Print the usage message.
+ *
+ * @param stream
+ */
+static void print_usage(FILE* stream) {
+    fprintf(stream, "%s\n",
+        "Usage: keyvo-bench [OPTION]...\n"
+        "Drive a keyvo server with open-loop load and report its latency.\n"
+        "\n"
+        "  -t, --transport=udp|tcp|unix  how to reach the server (udp)\n"
+        "  -H, --host=HOST               server host (127.0.0.1)\n"
+        "  -p, --port=PORT               server port (8080)\n"
+        "  -s, --socket-path=PATH        server socket, for the unix transport\n"
+        "  -r, --rate=N                  requests per second, in total (10000)\n"
+        "  -d, --duration=SECONDS        length of the measured run (10)\n"
+        "  -c, --connections=N           connections to spread the load over (1)\n"
+        "  -T, --timeout=MS              give up on a request after this long (1000)\n"
+        "  -k, --keys=N                  size of the key space (100000)\n"
+        "  -D, --distribution=uniform|zipf  key popularity (zipf)\n"
+        "  -z, --zipf-theta=THETA        skew of the Zipfian distribution (0.99)\n"
+        "  -V, --value-size=N[-M]        value size in bytes, or a range (100)\n"
+        "  -R, --read-ratio=FRACTION     share of requests that are reads (0.9)\n"
+        "  -S, --seed=N                  random seed\n"
+        "  -n, --no-preload              do not define every key before the run\n"
+        "  -a, --cache-aside             define a key again after a read misses\n"
+        "  -h, --help                    show this message");
+}
+
+/**
+ * @brief Parse a strictly positive number.
+ *
+ * @param argument
+ * @param value
+ * @return true
+ * @return false
+ */
+static bool parse_number(const char* argument, double* value) {
+    char* end = NULL;
+    errno = 0;
+    *value = strtod(argument, &end);
+
+    return (errno == 0) && (end != argument) && (*end == '\0') && (*value > 0);
+}
+
+/**
+ * @brief Parse a value size, given either as a single size
+ * or as an inclusive range such as 100-1000.
+ *
+ * @param argument
+ * @param workload
+ * @return true
+ * @return false
+ */
+static bool parse_value_size(const char* argument, struct workload_t* workload) {
+    char* end = NULL;
+    errno = 0;
+    unsigned long minimum = strtoul(argument, &end, 10);
+    unsigned long maximum = minimum;
+
+    if ((errno != 0) || (end == argument)) {
+        return false;
+    }
+
+    if (*end == '-') {
+        const char* start = end + 1;
+        maximum = strtoul(start, &end, 10);
+
+        if ((errno != 0) || (end == start)) {
+            return false;
+        }
+    }
+
+    if ((*end != '\0') || (minimum == 0) || (minimum > maximum) || (maximum > VALUE_SIZE_MAXIMUM)) {
+        return false;
+    }
+
+    workload->value_size_minimum = minimum;
+    workload->value_size_maximum = maximum;
+
+    return true;
+}
+
+/**
+ * @brief Report an invalid option argument and exit.
+ *
+ * @param what
+ * @param argument
+ */
+static void invalid_argument(const char* what, const char* argument) {
+    fprintf(stderr, "%s: %s\n", what, argument);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief This is the entry point of the load generator. It
+ * connects to the server, preloads the key space, drives
+ * the configured load for the configured duration, and
+ * prints what it measured.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[])
+{
+    struct bench_options_t options = {
+        .transport = TRANSPORT_UDP,
+        .host = "127.0.0.1",
+        .port = "8080",
+        .socket_path = NULL,
+        .rate = 10000,
+        .duration = 10,
+        .connections = 1,
+        .timeout = 1000000000,
+        .preload = true,
+        .cache_aside = false
+    };
+
+    struct workload_t workload = {
+        .distribution = DISTRIBUTION_ZIPF,
+        .keys = 100000,
+        .read_ratio = 0.9,
+        .value_size_minimum = 100,
+        .value_size_maximum = 100,
+        .theta = 0.99
+    };
+
+    uint64_t seed = (uint64_t) time(NULL);
+    double number = 0;
+    int c = 0;
+
+    while ((c = getopt_long(argc, argv, "t:H:p:s:r:d:c:T:k:D:z:V:R:S:nah", long_options, NULL)) != -1) {
+        switch (c) {
+            case 't': {
+                if (strcmp(optarg, "udp") == 0) {
+                    options.transport = TRANSPORT_UDP;
+                } else if (strcmp(optarg, "tcp") == 0) {
+                    options.transport = TRANSPORT_TCP;
+                } else if (strcmp(optarg, "unix") == 0) {
+                    options.transport = TRANSPORT_UNIX;
+                } else {
+                    invalid_argument("Invalid transport", optarg);
+                }
+            } break;
+
+            case 'H': {
+                options.host = optarg;
+            } break;
+
+            case 'p': {
+                options.port = optarg;
+            } break;
+
+            case 's': {
+                options.socket_path = optarg;
+            } break;
+
+            case 'r': {
+                if (!parse_number(optarg, &options.rate)) {
+                    invalid_argument("Invalid rate", optarg);
+                }
+            } break;
+
+            case 'd': {
+                if (!parse_number(optarg, &options.duration)) {
+                    invalid_argument("Invalid duration", optarg);
+                }
+            } break;
+
+            case 'c': {
+                if (!parse_number(optarg, &number) || (number != (size_t) number)) {
+                    invalid_argument("Invalid connection count", optarg);
+                }
+
+                options.connections = (size_t) number;
+            } break;
+
+            case 'T': {
+                if (!parse_number(optarg, &number)) {
+                    invalid_argument("Invalid timeout", optarg);
+                }
+
+                options.timeout = (uint64_t) (number * 1e6);
+            } break;
+
+            case 'k': {
+                if (!parse_number(optarg, &number) || (number != (uint64_t) number)) {
+                    invalid_argument("Invalid key count", optarg);
+                }
+
+                workload.keys = (uint64_t) number;
+            } break;
+
+            case 'D': {
+                if (strcmp(optarg, "uniform") == 0) {
+                    workload.distribution = DISTRIBUTION_UNIFORM;
+                } else if (strcmp(optarg, "zipf") == 0) {
+                    workload.distribution = DISTRIBUTION_ZIPF;
+                } else {
+                    invalid_argument("Invalid distribution", optarg);
+                }
+            } break;
+
+            case 'z': {
+                if (!parse_number(optarg, &workload.theta) || (workload.theta >= 1.0)) {
+                    invalid_argument("Invalid Zipfian theta; it must lie strictly between 0 and 1", optarg);
+                }
+            } break;
+
+            case 'V': {
+                if (!parse_value_size(optarg, &workload)) {
+                    invalid_argument("Invalid value size", optarg);
+                }
+            } break;
+
+            case 'R': {
+                char* end = NULL;
+                workload.read_ratio = strtod(optarg, &end);
+
+                if ((end == optarg) || (*end != '\0') || (workload.read_ratio < 0.0) || (workload.read_ratio > 1.0)) {
+                    invalid_argument("Invalid read ratio", optarg);
+                }
+            } break;
+
+            case 'S': {
+                seed = strtoull(optarg, NULL, 0);
+            } break;
+
+            case 'n': {
+                options.preload = false;
+            } break;
+
+            case 'a': {
+                options.cache_aside = true;
+            } break;
+
+            case 'h': {
+                print_usage(stdout);
+                return EXIT_SUCCESS;
+            } break;
+
+            default: {
+                print_usage(stderr);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if ((options.transport == TRANSPORT_UNIX) && (options.socket_path == NULL)) {
+        fprintf(stderr, "%s\n", "The unix transport needs a --socket-path.");
+        return EXIT_FAILURE;
+    }
+
+    workload_initialize(&workload, seed);
+
+    static struct bench_t bench;
+    bench_initialize(&bench, &options, &workload);
+
+    if (options.preload) {
+        bench_preload(&bench);
+    }
+
+    bench_run(&bench);
+    bench_report(&bench, stdout);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "workload.h"
+
+/**
+ * @brief Compute the generalized harmonic number
+ * sum(1 / i^theta) for i from 1 to n.
+ *
+ * @param n
+ * @param theta
+ * @return double
+ */
+static double zeta(uint64_t n, double theta) {
+    double sum = 0.0;
+
+    for (uint64_t i = 1; i <= n; ++i) {
+        sum += 1.0 / pow((double) i, theta);
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Prepare the workload for drawing requests. The
+ * distribution, key count, skew, read ratio and value sizes
+ * must already have been filled in.
+ *
+ * @details Setting up the Zipfian generator takes time
+ * linear in the number of keys, but it only happens once,
+ * before any load is generated.
+ *
+ * @param workload
+ * @param seed
+ */
+void workload_initialize(struct workload_t* workload, uint64_t seed) {
+    workload->random_state = seed ? seed : UINT64_C(0x9E3779B97F4A7C15);
+
+    if (workload->distribution == DISTRIBUTION_ZIPF) {
+        double theta = workload->theta;
+        double zeta2 = zeta(2, theta);
+
+        workload->alpha = 1.0 / (1.0 - theta);
+        workload->zetan = zeta(workload->keys, theta);
+        workload->eta = (1.0 - pow(2.0 / (double) workload->keys, 1.0 - theta)) / (1.0 - (zeta2 / workload->zetan));
+    }
+}
+
+/**
+ * @brief Draw the key for the next request.
+ *
+ * @param workload
+ * @return uint64_t
+ */
+uint64_t workload_next_key(struct workload_t* workload) {
+    if (workload->distribution == DISTRIBUTION_UNIFORM) {
+        return random_next(&workload->random_state) % workload->keys;
+    }
+
+    double u = random_unit(&workload->random_state);
+    double uz = u * workload->zetan;
+
+    if (uz < 1.0) {
+        return 0;
+    }
+
+    if (uz < 1.0 + pow(0.5, workload->theta)) {
+        return 1 % workload->keys;
+    }
+
+    uint64_t key = (uint64_t) ((double) workload->keys * pow((workload->eta * u) - workload->eta + 1.0, workload->alpha));
+
+    return (key < workload->keys) ? key : workload->keys - 1;
+}
+
+/**
+ * @brief Decide whether the next request is a read.
+ *
+ * @param workload
+ * @return true
+ * @return false
+ */
+bool workload_next_is_read(struct workload_t* workload) {
+    return random_unit(&workload->random_state) < workload->read_ratio;
+}
+
+/**
+ * @brief Draw the size of the next value written, uniformly
+ * from the configured range.
+ *
+ * @param workload
+ * @return size_t
+ */
+size_t workload_next_value_size(struct workload_t* workload) {
+    size_t range = workload->value_size_maximum - workload->value_size_minimum + 1;
+
+    return workload->value_size_minimum + (random_next(&workload->random_state) % range);
+}
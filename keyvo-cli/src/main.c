@@ -56,8 +56,18 @@ int main(void)
     while (1) {
         fd_set reads = master;
 
+        /**
+         * @brief A signal or a momentary shortage of memory
+         * only means this round of waiting was cut short.
+         * Anything else is a bug, and retrying would spin.
+         *
+         */
         if (select(max_socket + 1, &reads, 0, 0, 0) < 0) {
-            fprintf(stderr, "%s\n", "select() failed");
+            if ((errno == EINTR) || (errno == ENOMEM)) {
+                continue;
+            }
+
+            fprintf(stderr, "%s: %s\n", "select() failed", strerror(errno));
             return EXIT_FAILURE;
         }
 
@@ -69,9 +79,25 @@ int main(void)
 
             int bytes_received = recvfrom(listener_socket, read, 1024, 0, (struct sockaddr *) &client_address, &client_len);
 
-            if (bytes_received < 1) {
-                fprintf(stderr, "%s\n", "The connection was closed.");
-                return EXIT_FAILURE;
+            /**
+             * @brief There is no connection to lose on a
+             * datagram socket. A failed receive, such as a
+             * client's earlier reply bouncing back as
+             * ECONNREFUSED, only affects that one datagram,
+             * and an empty datagram is a valid request that
+             * simply has nothing to answer.
+             *
+             */
+            if (bytes_received < 0) {
+                if ((errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                    fprintf(stderr, "%s: %s\n", "Error in call to recvfrom()", strerror(errno));
+                }
+
+                continue;
+            }
+
+            if (bytes_received == 0) {
+                continue;
             }
 
             for (int i = 0; i < bytes_received; ++i) {
@@ -86,8 +112,8 @@ int main(void)
             ssize_t result = sendto(listener_socket, read, bytes_received, 0, (struct sockaddr *) &client_address, client_len);
 
             if (result == -1) {
-                fprintf(stderr, "%s\n", "Error in call to sendto()");
-                break;
+                fprintf(stderr, "%s: %s\n", "Error in call to sendto()", strerror(errno));
+                continue;
             }
         }
     }
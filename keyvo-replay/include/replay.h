@@ -0,0 +1,199 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_REPLAY_H
+#define PROJECT_INCLUDES_REPLAY_H
+
+#include "keyvo.h"
+#include "histogram.h"
+#include "trace.h"
+
+/**
+ * @brief The longest the replayer will sleep in select()
+ * at a time, in microseconds.
+ *
+ */
+#ifndef REPLAY_POLL_INTERVAL
+#define REPLAY_POLL_INTERVAL 1000
+#endif
+
+/**
+ * @brief The most requests any one stream connection may
+ * have in flight. When a connection reaches this limit, the
+ * replayer waits for replies before sending on it again.
+ *
+ */
+#ifndef REPLAY_PENDING_LIMIT
+#define REPLAY_PENDING_LIMIT 1024
+#endif
+
+/**
+ * @brief The most requests any one datagram connection may
+ * have in flight when replaying at full speed. Keeping the
+ * window small stops the replayer from overrunning the
+ * server's socket buffer and losing datagrams.
+ *
+ */
+#ifndef REPLAY_DATAGRAM_WINDOW
+#define REPLAY_DATAGRAM_WINDOW 64
+#endif
+
+/**
+ * @brief Room for two of the longest requests the server
+ * accepts, or for two of its longest replies.
+ *
+ */
+#ifndef REPLAY_BUFFER_SIZE
+#define REPLAY_BUFFER_SIZE (2 * 65536)
+#endif
+
+/**
+ * @brief The ways the replayer can reach the server.
+ *
+ */
+enum transport_t {
+    TRANSPORT_UDP,
+    TRANSPORT_TCP,
+    TRANSPORT_UNIX,
+    TRANSPORT_CAPTURED
+};
+
+/**
+ * @brief How the trace is to be replayed, as given on the
+ * command line.
+ *
+ * @details A speed of zero replays the trace as fast as the
+ * server will take it; otherwise the gaps between requests
+ * are divided by the speed. The transport is normally the
+ * one each client was captured on, but can be overridden.
+ *
+ */
+struct replay_options_t {
+    enum transport_t transport;
+    const char* host;
+    const char* port;
+    const char* socket_path;
+
+    double speed;
+    size_t connections;
+    uint64_t timeout;
+};
+
+/**
+ * @brief A request that has been sent and not yet answered.
+ *
+ * @details Stream requests are answered with a known number
+ * of lines, except for STATS, whose reply runs until an END
+ * line. Datagram requests are answered with one datagram,
+ * and also carry a sequence number, which the server echoes
+ * back in its reply.
+ *
+ */
+struct pending_t {
+    uint64_t intended;
+    uint64_t sent;
+    uint32_t replies;
+    bool until_end;
+
+    uint32_t sequence;
+    bool answered;
+};
+
+/**
+ * @brief A single connection to the server, and the part of
+ * the trace that is replayed over it.
+ *
+ * @details Every captured client is replayed over exactly
+ * one connection, in order. When the trace has more clients
+ * than the replayer has connections, several clients share
+ * a connection, which still keeps each one's requests in
+ * order.
+ *
+ * Datagrams can be lost, so their replies cannot be matched
+ * up by order alone: every datagram that expects a reply is
+ * prefixed with an ECHO of its sequence number, and the
+ * reply is matched up by that, as in keyvo-bench.
+ *
+ */
+struct replay_connection_t {
+    int socket;
+    enum transport_t transport;
+    bool datagram;
+    bool subscribed;
+
+    const struct trace_record_t** records;
+    size_t record_count;
+    size_t next;
+
+    struct pending_t pending[REPLAY_PENDING_LIMIT];
+    size_t pending_head;
+    size_t pending_count;
+    uint32_t next_sequence;
+
+    size_t input_length;
+    char input[REPLAY_BUFFER_SIZE];
+
+    size_t output_length;
+    size_t output_sent;
+    char output[REPLAY_BUFFER_SIZE];
+};
+
+/**
+ * @brief What happened during a replay.
+ *
+ * @details As in keyvo-bench, the corrected histogram
+ * measures every request from when the trace says it should
+ * have been sent, and the uncorrected one from when it
+ * actually was.
+ *
+ */
+struct replay_results_t {
+    uint64_t sent;
+    uint64_t completed;
+    uint64_t lost;
+    uint64_t errors;
+    uint64_t busy;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t send_lag;
+    uint64_t elapsed;
+
+    struct histogram_t corrected;
+    struct histogram_t uncorrected;
+};
+
+/**
+ * @brief A trace being replayed, and the connections it is
+ * replayed over.
+ *
+ */
+struct replay_t {
+    const struct replay_options_t* options;
+    const struct trace_t* trace;
+
+    struct replay_connection_t** connections;
+    size_t connection_count;
+    int max_socket;
+
+    struct replay_results_t results;
+};
+
+void replay_initialize(struct replay_t* replay, const struct replay_options_t* options, const struct trace_t* trace);
+
+void replay_run(struct replay_t* replay);
+
+void replay_report(const struct replay_t* replay, FILE* stream);
+
+#endif /** PROJECT_INCLUDES_REPLAY_H */
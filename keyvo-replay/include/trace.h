@@ -0,0 +1,126 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_TRACE_H
+#define PROJECT_INCLUDES_TRACE_H
+
+#include "keyvo.h"
+
+/**
+ * @brief Every trace starts with these eight bytes. The
+ * layout below must be kept in step with the server's
+ * capture.h, which writes it.
+ *
+ */
+#define TRACE_MAGIC "KEYVOCAP"
+
+#define TRACE_FORMAT_VERSION 1
+
+/**
+ * @brief How a captured request reached the server.
+ *
+ */
+enum trace_transport_t {
+    TRACE_UDP,
+    TRACE_TCP,
+    TRACE_UNIX,
+    TRACE_TRANSPORTS
+};
+
+/**
+ * @brief The header at the start of a trace file.
+ *
+ */
+struct trace_file_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample;
+    uint64_t started;
+};
+
+/**
+ * @brief The header in front of every captured request, as
+ * it is laid out on disk.
+ *
+ */
+struct trace_record_header_t {
+    uint64_t timestamp;
+    uint32_t connection;
+    uint16_t length;
+    uint8_t transport;
+    uint8_t reserved;
+};
+
+_Static_assert(sizeof (struct trace_file_header_t) == 24, "the trace header layout is part of the file format");
+_Static_assert(sizeof (struct trace_record_header_t) == 16, "the record header layout is part of the file format");
+
+/**
+ * @brief A captured request, once the trace has been
+ * loaded. The payload points into the trace's own copy of
+ * the file.
+ *
+ * @details The session numbers the client the request came
+ * from, counting from zero in order of first appearance.
+ *
+ */
+struct trace_record_t {
+    uint64_t timestamp;
+    const char* payload;
+    uint32_t session;
+    uint16_t length;
+    uint8_t transport;
+};
+
+/**
+ * @brief A trace, loaded into memory in full.
+ *
+ * @details Records are kept in the order the server
+ * captured them, which is also the order their timestamps
+ * run in.
+ *
+ */
+struct trace_t {
+    char* data;
+    size_t size;
+
+    struct trace_file_header_t header;
+
+    struct trace_record_t* records;
+    size_t count;
+
+    /** The transport of every session, indexed by session */
+    uint8_t* session_transports;
+    size_t sessions;
+
+    /** Whether the file ended partway through a record */
+    bool truncated;
+};
+
+bool trace_load(struct trace_t* trace, const char* filename);
+
+void trace_destroy(struct trace_t* trace);
+
+/**
+ * @brief Return the time between the first and the last
+ * request in the trace, in nanoseconds.
+ *
+ * @param trace
+ * @return uint64_t
+ */
+static inline uint64_t trace_span(const struct trace_t* trace) {
+    return trace->count ? trace->records[trace->count - 1].timestamp - trace->records[0].timestamp : 0;
+}
+
+#endif /** PROJECT_INCLUDES_TRACE_H */
@@ -0,0 +1,198 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "keyvo.h"
+#include "replay.h"
+
+/**
+ * @brief The command-line options the replayer accepts.
+ *
+ */
+static struct option long_options[] = {
+    { "transport",      required_argument,  0,  't' },
+    { "host",           required_argument,  0,  'H' },
+    { "port",           required_argument,  0,  'p' },
+    { "socket-path",    required_argument,  0,  's' },
+    { "speed",          required_argument,  0,  'x' },
+    { "connections",    required_argument,  0,  'c' },
+    { "timeout",        required_argument,  0,  'T' },
+    { "help",           no_argument,        0,  'h' },
+    { 0,                0,                  0,   0  }
+};
+
+/**
+ * @brief Print the usage message.
+ *
+ * @param stream
+ */
+static void print_usage(FILE* stream) {
+    fprintf(stream, "%s\n",
+        "Usage: keyvo-replay [OPTION]... TRACE\n"
+        "Replay a trace captured with keyvo --capture against a server, and report its latency.\n"
+        "\n"
+        "  -t, --transport=captured|udp|tcp|unix  how to reach the server (captured)\n"
+        "  -H, --host=HOST               server host (127.0.0.1)\n"
+        "  -p, --port=PORT               server port (8080)\n"
+        "  -s, --socket-path=PATH        server socket, for unix-domain clients\n"
+        "  -x, --speed=N|max             replay N times as fast as captured, or flat out (1)\n"
+        "  -c, --connections=N           most connections per transport (64)\n"
+        "  -T, --timeout=MS              give up on a request after this long (1000)\n"
+        "  -h, --help                    show this message");
+}
+
+/**
+ * @brief Parse a strictly positive number.
+ *
+ * @param argument
+ * @param value
+ * @return true
+ * @return false
+ */
+static bool parse_number(const char* argument, double* value) {
+    char* end = NULL;
+    errno = 0;
+    *value = strtod(argument, &end);
+
+    return (errno == 0) && (end != argument) && (*end == '\0') && (*value > 0);
+}
+
+/**
+ * @brief Report an invalid option argument and exit.
+ *
+ * @param what
+ * @param argument
+ */
+static void invalid_argument(const char* what, const char* argument) {
+    fprintf(stderr, "%s: %s\n", what, argument);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief This is the entry point of the replayer. It loads
+ * the trace, connects to the server, replays the trace at
+ * the requested speed, and prints what it measured.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[])
+{
+    struct replay_options_t options = {
+        .transport = TRANSPORT_CAPTURED,
+        .host = "127.0.0.1",
+        .port = "8080",
+        .socket_path = NULL,
+        .speed = 1,
+        .connections = 64,
+        .timeout = 1000000000
+    };
+
+    double number = 0;
+    int c = 0;
+
+    while ((c = getopt_long(argc, argv, "t:H:p:s:x:c:T:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 't': {
+                if (strcmp(optarg, "captured") == 0) {
+                    options.transport = TRANSPORT_CAPTURED;
+                } else if (strcmp(optarg, "udp") == 0) {
+                    options.transport = TRANSPORT_UDP;
+                } else if (strcmp(optarg, "tcp") == 0) {
+                    options.transport = TRANSPORT_TCP;
+                } else if (strcmp(optarg, "unix") == 0) {
+                    options.transport = TRANSPORT_UNIX;
+                } else {
+                    invalid_argument("Invalid transport", optarg);
+                }
+            } break;
+
+            case 'H': {
+                options.host = optarg;
+            } break;
+
+            case 'p': {
+                options.port = optarg;
+            } break;
+
+            case 's': {
+                options.socket_path = optarg;
+            } break;
+
+            case 'x': {
+                if (strcmp(optarg, "max") == 0) {
+                    options.speed = 0;
+                } else if (!parse_number(optarg, &options.speed)) {
+                    invalid_argument("Invalid speed", optarg);
+                }
+            } break;
+
+            case 'c': {
+                if (!parse_number(optarg, &number) || (number != (size_t) number)) {
+                    invalid_argument("Invalid connection count", optarg);
+                }
+
+                options.connections = (size_t) number;
+            } break;
+
+            case 'T': {
+                if (!parse_number(optarg, &number)) {
+                    invalid_argument("Invalid timeout", optarg);
+                }
+
+                options.timeout = (uint64_t) (number * 1e6);
+            } break;
+
+            case 'h': {
+                print_usage(stdout);
+                return EXIT_SUCCESS;
+            } break;
+
+            default: {
+                print_usage(stderr);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (optind != argc - 1) {
+        print_usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    if ((options.transport == TRANSPORT_UNIX) && (options.socket_path == NULL)) {
+        fprintf(stderr, "%s\n", "The unix transport needs a --socket-path.");
+        return EXIT_FAILURE;
+    }
+
+    static struct trace_t trace;
+
+    if (!trace_load(&trace, argv[optind])) {
+        return EXIT_FAILURE;
+    }
+
+    if (trace.truncated) {
+        fprintf(stderr, "%s\n", "Warning: the trace ends partway through a record; replaying what came before it.");
+    }
+
+    static struct replay_t replay;
+    replay_initialize(&replay, &options, &trace);
+    replay_run(&replay);
+    replay_report(&replay, stdout);
+
+    trace_destroy(&trace);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,887 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "replay.h"
+
+#include <inttypes.h>
+
+/**
+ * @brief The wire name of every transport, indexed by its
+ * transport_t.
+ *
+ */
+static const char* const transport_names[] = { "udp", "tcp", "unix", "as captured" };
+
+/**
+ * @brief Report a memory-allocation failure and exit.
+ *
+ */
+static void out_of_memory(void) {
+    fprintf(stderr, "%s\n", "Memory-allocation failure.");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Open a socket to the server over the given
+ * transport. Failing to reach the server is fatal.
+ *
+ * @param transport
+ * @param options
+ * @return int
+ */
+static int open_socket(enum transport_t transport, const struct replay_options_t* options) {
+    int client_socket = -1;
+
+    if (transport == TRANSPORT_UNIX) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof (struct sockaddr_un));
+        address.sun_family = AF_UNIX;
+
+        if (strlen(options->socket_path) >= sizeof (address.sun_path)) {
+            fprintf(stderr, "%s: %s\n", "Socket path is too long", options->socket_path);
+            exit(EXIT_FAILURE);
+        }
+
+        strcpy(address.sun_path, options->socket_path);
+
+        if ((client_socket = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+            perror("socket");
+            exit(EXIT_FAILURE);
+        }
+
+        if (connect(client_socket, (struct sockaddr *) &address, sizeof (address))) {
+            fprintf(stderr, "%s %s: %s\n", "Could not connect to", options->socket_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        return client_socket;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof (struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = (transport == TRANSPORT_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+
+    struct addrinfo* server_address = NULL;
+
+    int error = 0;
+
+    if ((error = getaddrinfo(options->host, options->port, &hints, &server_address)) != 0) {
+        fprintf(stderr, "%s\n", gai_strerror(error));
+        exit(EXIT_FAILURE);
+    }
+
+    for (struct addrinfo* address = server_address; address; address = address->ai_next) {
+        client_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+        if (client_socket == -1) {
+            continue;
+        }
+
+        if (connect(client_socket, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+
+        close(client_socket);
+        client_socket = -1;
+    }
+
+    freeaddrinfo(server_address);
+
+    if (client_socket == -1) {
+        fprintf(stderr, "%s %s:%s\n", "Could not connect to", options->host, options->port);
+        exit(EXIT_FAILURE);
+    }
+
+    if (transport == TRANSPORT_TCP) {
+        int enable = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof (enable));
+    }
+
+    return client_socket;
+}
+
+/**
+ * @brief Open a new, non-blocking connection to the server.
+ *
+ * @param replay
+ * @param transport
+ * @return The index of the new connection.
+ */
+static size_t open_connection(struct replay_t* replay, enum transport_t transport) {
+    struct replay_connection_t* connection = malloc(sizeof (struct replay_connection_t));
+
+    if (connection == NULL) {
+        out_of_memory();
+    }
+
+    connection->socket = open_socket(transport, replay->options);
+    connection->transport = transport;
+    connection->datagram = (transport == TRANSPORT_UDP);
+    connection->subscribed = false;
+    connection->records = NULL;
+    connection->record_count = 0;
+    connection->next = 0;
+    connection->pending_head = 0;
+    connection->pending_count = 0;
+    connection->next_sequence = 0;
+    connection->input_length = 0;
+    connection->output_length = 0;
+    connection->output_sent = 0;
+
+    if (connection->socket >= FD_SETSIZE) {
+        fprintf(stderr, "%s\n", "Too many connections.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (connection->socket > replay->max_socket) {
+        replay->max_socket = connection->socket;
+    }
+
+    int flags = fcntl(connection->socket, F_GETFL, 0);
+    fcntl(connection->socket, F_SETFL, flags | O_NONBLOCK);
+
+    replay->connections[replay->connection_count] = connection;
+
+    return replay->connection_count++;
+}
+
+/**
+ * @brief Decide which transport a captured client is to be
+ * replayed over. Unix-domain clients fall back to TCP when
+ * no socket path was given.
+ *
+ * @param options
+ * @param captured
+ * @return enum transport_t
+ */
+static enum transport_t replay_transport(const struct replay_options_t* options, uint8_t captured) {
+    if (options->transport != TRANSPORT_CAPTURED) {
+        return options->transport;
+    }
+
+    switch (captured) {
+        case TRACE_UDP: return TRANSPORT_UDP;
+        case TRACE_UNIX: return options->socket_path ? TRANSPORT_UNIX : TRANSPORT_TCP;
+        default: return TRANSPORT_TCP;
+    }
+}
+
+/**
+ * @brief Assign every captured client to a connection,
+ * opening connections as they are needed, and deal each
+ * connection its share of the trace.
+ *
+ * @details Clients are assigned round-robin, in order of
+ * first appearance, to at most the configured number of
+ * connections per transport.
+ *
+ * @param replay
+ * @param options
+ * @param trace
+ */
+void replay_initialize(struct replay_t* replay, const struct replay_options_t* options, const struct trace_t* trace) {
+    replay->options = options;
+    replay->trace = trace;
+    replay->connection_count = 0;
+    replay->max_socket = -1;
+    memset(&replay->results, 0, sizeof (struct replay_results_t));
+
+    size_t* assigned = malloc(trace->sessions * sizeof (size_t));
+    size_t* opened[TRANSPORT_CAPTURED];
+    size_t seen[TRANSPORT_CAPTURED] = { 0 };
+
+    replay->connections = calloc(TRANSPORT_CAPTURED * options->connections, sizeof (struct replay_connection_t*));
+
+    if ((assigned == NULL) || (replay->connections == NULL)) {
+        out_of_memory();
+    }
+
+    for (size_t t = 0; t < TRANSPORT_CAPTURED; ++t) {
+        if ((opened[t] = malloc(options->connections * sizeof (size_t))) == NULL) {
+            out_of_memory();
+        }
+    }
+
+    for (size_t session = 0; session < trace->sessions; ++session) {
+        enum transport_t transport = replay_transport(options, trace->session_transports[session]);
+        size_t ordinal = seen[transport]++;
+
+        if (ordinal < options->connections) {
+            opened[transport][ordinal] = open_connection(replay, transport);
+        }
+
+        assigned[session] = opened[transport][ordinal % options->connections];
+    }
+
+    for (size_t i = 0; i < trace->count; ++i) {
+        replay->connections[assigned[trace->records[i].session]]->record_count += 1;
+    }
+
+    for (size_t c = 0; c < replay->connection_count; ++c) {
+        struct replay_connection_t* connection = replay->connections[c];
+
+        if ((connection->records = malloc(connection->record_count * sizeof (struct trace_record_t*))) == NULL) {
+            out_of_memory();
+        }
+
+        connection->record_count = 0;
+    }
+
+    for (size_t i = 0; i < trace->count; ++i) {
+        struct replay_connection_t* connection = replay->connections[assigned[trace->records[i].session]];
+
+        connection->records[connection->record_count++] = &trace->records[i];
+    }
+
+    for (size_t t = 0; t < TRANSPORT_CAPTURED; ++t) {
+        free(opened[t]);
+    }
+
+    free(assigned);
+}
+
+/**
+ * @brief Check whether a word in a request matches the
+ * given command name.
+ *
+ * @param word
+ * @param length
+ * @param name
+ * @return true
+ * @return false
+ */
+static bool is_command(const char* word, size_t length, const char* name) {
+    return (strlen(name) == length) && (strncasecmp(word, name, length) == 0);
+}
+
+/**
+ * @brief Work out how the server will answer a request,
+ * the same way it splits up the command line.
+ *
+ * @param connection
+ * @param record
+ * @param pending
+ * @param subscribe Set if the request is a SUBSCRIBE.
+ * @return false if the server will not answer at all.
+ */
+static bool expect_reply(const struct replay_connection_t* connection, const struct trace_record_t* record, struct pending_t* pending, bool* subscribe) {
+    static const char separators[] = " \t\r";
+
+    const char* payload = record->payload;
+    size_t length = record->length;
+
+    pending->replies = 1;
+    pending->until_end = false;
+    *subscribe = false;
+
+    if (connection->datagram) {
+        for (size_t i = 0; i < length; ++i) {
+            if ((payload[i] != '\n') && !memchr(separators, payload[i], 3)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    size_t words = 0;
+    const char* command = NULL;
+    size_t command_length = 0;
+
+    for (size_t i = 0; i < length; ) {
+        if (memchr(separators, payload[i], 3)) {
+            ++i;
+            continue;
+        }
+
+        size_t start = i;
+
+        while ((i < length) && !memchr(separators, payload[i], 3)) {
+            ++i;
+        }
+
+        if (words++ == 0) {
+            command = payload + start;
+            command_length = i - start;
+        }
+    }
+
+    if (words == 0) {
+        return false;
+    }
+
+    if (is_command(command, command_length, "STATS")) {
+        pending->until_end = true;
+    } else if (is_command(command, command_length, "MGET") && (words > 1)) {
+        pending->replies = (uint32_t) (words - 1);
+    } else if (is_command(command, command_length, "SUBSCRIBE") && (words == 1)) {
+        *subscribe = true;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write as much of the queued request data as the
+ * server will currently accept, and make room for more.
+ *
+ * @param connection
+ * @return false if the connection has failed.
+ */
+static bool connection_flush(struct replay_connection_t* connection) {
+    bool healthy = true;
+
+    while (connection->output_sent < connection->output_length) {
+        ssize_t sent = send(connection->socket, connection->output + connection->output_sent, connection->output_length - connection->output_sent, MSG_NOSIGNAL);
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            healthy = (errno == EAGAIN) || (errno == EWOULDBLOCK);
+            break;
+        }
+
+        connection->output_sent += sent;
+    }
+
+    connection->output_length -= connection->output_sent;
+    memmove(connection->output, connection->output + connection->output_sent, connection->output_length);
+    connection->output_sent = 0;
+
+    return healthy;
+}
+
+/**
+ * @brief Send the next request due on a connection, and
+ * remember it so that its reply can be matched up with it.
+ *
+ * @details A stream request goes out as one line; a datagram
+ * request goes out as it was captured, behind an ECHO of its
+ * sequence number if the server is going to answer it.
+ *
+ * @param replay
+ * @param connection
+ * @param intended
+ * @param now
+ * @return false if the connection has no room for it yet,
+ * and it should be retried later.
+ */
+static bool replay_send(struct replay_t* replay, struct replay_connection_t* connection, uint64_t intended, uint64_t now) {
+    const struct trace_record_t* record = connection->records[connection->next];
+    struct pending_t pending = { intended, now, 0, false, connection->next_sequence, false };
+    bool subscribe = false;
+    bool answered = expect_reply(connection, record, &pending, &subscribe);
+
+    size_t window = (connection->datagram && (replay->options->speed == 0)) ? REPLAY_DATAGRAM_WINDOW : REPLAY_PENDING_LIMIT;
+
+    if (connection->pending_count >= window) {
+        return false;
+    }
+
+    if (connection->datagram) {
+        static char datagram[REPLAY_BUFFER_SIZE + 32];
+        size_t header_length = 0;
+
+        if (answered) {
+            header_length = (size_t) snprintf(datagram, sizeof (datagram), "ECHO %" PRIu32 "\n", pending.sequence);
+        }
+
+        memcpy(datagram + header_length, record->payload, record->length);
+
+        if (send(connection->socket, datagram, header_length + record->length, 0) == -1) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS) || (errno == EINTR)) {
+                return false;
+            }
+
+            perror("send");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        if (REPLAY_BUFFER_SIZE - connection->output_length < (size_t) record->length + 1) {
+            return false;
+        }
+
+        memcpy(connection->output + connection->output_length, record->payload, record->length);
+        connection->output[connection->output_length + record->length] = '\n';
+        connection->output_length += (size_t) record->length + 1;
+        connection->subscribed |= subscribe;
+    }
+
+    if (answered) {
+        connection->pending[(connection->pending_head + connection->pending_count) % REPLAY_PENDING_LIMIT] = pending;
+        connection->pending_count += 1;
+        connection->next_sequence += 1;
+    }
+
+    if (!connection->datagram) {
+        connection_flush(connection);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Count a reply line by what kind of answer it is.
+ *
+ * @param results
+ * @param line
+ */
+static void tally(struct replay_results_t* results, const char* line) {
+    if (strncmp(line, "VALUE", 5) == 0) {
+        results->hits += 1;
+    } else if (strcmp(line, "NOT_FOUND") == 0) {
+        results->misses += 1;
+    } else if (strncmp(line, "ERROR", 5) == 0) {
+        results->errors += 1;
+    } else if (strcmp(line, "BUSY") == 0) {
+        results->busy += 1;
+    }
+}
+
+/**
+ * @brief Record the latency of a request that has just been
+ * answered in full.
+ *
+ * @param replay
+ * @param pending
+ */
+static void record_latency(struct replay_t* replay, const struct pending_t* pending) {
+    uint64_t now = monotonic_nanoseconds();
+
+    histogram_record(&replay->results.corrected, now - pending->intended);
+    histogram_record(&replay->results.uncorrected, now - pending->sent);
+    replay->results.completed += 1;
+}
+
+/**
+ * @brief Drop the requests at the front of the FIFO that
+ * have already been answered out of turn.
+ *
+ * @param connection
+ */
+static void skip_answered(struct replay_connection_t* connection) {
+    while ((connection->pending_count != 0) && connection->pending[connection->pending_head].answered) {
+        connection->pending_head = (connection->pending_head + 1) % REPLAY_PENDING_LIMIT;
+        connection->pending_count -= 1;
+    }
+}
+
+/**
+ * @brief Retire the oldest request in flight on a
+ * connection, now that it has been answered in full.
+ *
+ * @param replay
+ * @param connection
+ */
+static void complete(struct replay_t* replay, struct replay_connection_t* connection) {
+    record_latency(replay, &connection->pending[connection->pending_head]);
+
+    connection->pending_head = (connection->pending_head + 1) % REPLAY_PENDING_LIMIT;
+    connection->pending_count -= 1;
+}
+
+/**
+ * @brief Find the request a datagram reply answers, from
+ * the sequence number the server echoed back at the start
+ * of it, and mark it as answered.
+ *
+ * @param connection
+ * @param reply The reply, which is advanced past the echo.
+ * @return The request, or NULL if the reply answers nothing
+ * still in flight, because its request was already given
+ * up on.
+ */
+static struct pending_t* claim_datagram_reply(struct replay_connection_t* connection, char** reply) {
+    char* end = NULL;
+
+    if ((strncmp(*reply, "ECHO ", 5) != 0) || (connection->pending_count == 0)) {
+        return NULL;
+    }
+
+    uint32_t sequence = (uint32_t) strtoul(*reply + 5, &end, 10);
+
+    if (*end != '\n') {
+        return NULL;
+    }
+
+    *reply = end + 1;
+
+    uint32_t offset = sequence - connection->pending[connection->pending_head].sequence;
+
+    if (offset >= connection->pending_count) {
+        return NULL;
+    }
+
+    struct pending_t* pending = &connection->pending[(connection->pending_head + offset) % REPLAY_PENDING_LIMIT];
+
+    if (pending->answered) {
+        return NULL;
+    }
+
+    pending->answered = true;
+
+    return pending;
+}
+
+/**
+ * @brief Match a reply line from a stream up with the
+ * request it answers. Invalidations pushed to a connection
+ * that replayed a SUBSCRIBE are not replies, and are
+ * skipped.
+ *
+ * @param replay
+ * @param connection
+ * @param line
+ */
+static void handle_line(struct replay_t* replay, struct replay_connection_t* connection, const char* line) {
+    if (connection->subscribed && (strncmp(line, "INVALIDATE ", 11) == 0)) {
+        return;
+    }
+
+    if (connection->pending_count == 0) {
+        return;
+    }
+
+    struct pending_t* pending = &connection->pending[connection->pending_head];
+
+    if (pending->until_end) {
+        if (strcmp(line, "END") == 0) {
+            complete(replay, connection);
+        }
+
+        return;
+    }
+
+    tally(&replay->results, line);
+
+    if (--pending->replies == 0) {
+        complete(replay, connection);
+    }
+}
+
+/**
+ * @brief Read whatever replies have arrived on a connection.
+ *
+ * @param replay
+ * @param connection
+ * @return false if the server closed the connection.
+ */
+static bool connection_receive(struct replay_t* replay, struct replay_connection_t* connection) {
+    if (connection->datagram) {
+        while (1) {
+            ssize_t bytes_received = recv(connection->socket, connection->input, REPLAY_BUFFER_SIZE - 1, 0);
+
+            if (bytes_received < 0) {
+                return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) || (errno == ECONNREFUSED);
+            }
+
+            char* reply = connection->input;
+            connection->input[bytes_received] = '\0';
+
+            struct pending_t* pending = claim_datagram_reply(connection, &reply);
+
+            if (pending == NULL) {
+                continue;
+            }
+
+            char* saveptr = NULL;
+
+            for (char* line = strtok_r(reply, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+                tally(&replay->results, line);
+            }
+
+            record_latency(replay, pending);
+            skip_answered(connection);
+        }
+    }
+
+    ssize_t bytes_received = recv(connection->socket, connection->input + connection->input_length, REPLAY_BUFFER_SIZE - connection->input_length, 0);
+
+    if (bytes_received == 0) {
+        return false;
+    }
+
+    if (bytes_received < 0) {
+        return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    }
+
+    size_t start = connection->input_length;
+    size_t consumed = 0;
+    connection->input_length += bytes_received;
+
+    for (size_t i = start; i < connection->input_length; ++i) {
+        if (connection->input[i] != '\n') {
+            continue;
+        }
+
+        connection->input[i] = '\0';
+        handle_line(replay, connection, connection->input + consumed);
+        consumed = i + 1;
+    }
+
+    connection->input_length -= consumed;
+    memmove(connection->input, connection->input + consumed, connection->input_length);
+
+    if (connection->input_length == REPLAY_BUFFER_SIZE) {
+        fprintf(stderr, "%s\n", "Reply too long; giving up.");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Return the number of requests in flight across
+ * every connection.
+ *
+ * @param replay
+ * @return uint64_t
+ */
+static uint64_t outstanding(const struct replay_t* replay) {
+    uint64_t count = 0;
+
+    for (size_t c = 0; c < replay->connection_count; ++c) {
+        count += replay->connections[c]->pending_count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Wait up to the given number of nanoseconds for the
+ * connections to become ready, then move data both ways.
+ * Datagrams that have gone unanswered for longer than the
+ * timeout are counted as lost.
+ *
+ * @param replay
+ * @param wait
+ */
+static void replay_poll(struct replay_t* replay, uint64_t wait) {
+    fd_set reads;
+    fd_set writes;
+    FD_ZERO(&reads);
+    FD_ZERO(&writes);
+
+    for (size_t c = 0; c < replay->connection_count; ++c) {
+        struct replay_connection_t* connection = replay->connections[c];
+
+        FD_SET(connection->socket, &reads);
+
+        if (connection->output_length != 0) {
+            FD_SET(connection->socket, &writes);
+        }
+    }
+
+    struct timeval timeout = { (time_t) (wait / 1000000000), (suseconds_t) ((wait % 1000000000) / 1000) };
+
+    if (select(replay->max_socket + 1, &reads, &writes, 0, &timeout) < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+
+        perror("select");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t c = 0; c < replay->connection_count; ++c) {
+        struct replay_connection_t* connection = replay->connections[c];
+
+        if (FD_ISSET(connection->socket, &writes) && !connection_flush(connection)) {
+            fprintf(stderr, "%s\n", "Lost the connection to the server.");
+            exit(EXIT_FAILURE);
+        }
+
+        if (FD_ISSET(connection->socket, &reads) && !connection_receive(replay, connection)) {
+            fprintf(stderr, "%s\n", "The server closed the connection.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t now = monotonic_nanoseconds();
+
+    for (size_t c = 0; c < replay->connection_count; ++c) {
+        struct replay_connection_t* connection = replay->connections[c];
+
+        if (!connection->datagram) {
+            continue;
+        }
+
+        while ((connection->pending_count != 0) && (connection->pending[connection->pending_head].sent + replay->options->timeout <= now)) {
+            connection->pending_head = (connection->pending_head + 1) % REPLAY_PENDING_LIMIT;
+            connection->pending_count -= 1;
+            replay->results.lost += 1;
+
+            skip_answered(connection);
+        }
+    }
+}
+
+/**
+ * @brief Replay the trace and measure it.
+ *
+ * @details Each connection works through its share of the
+ * trace in order. At a given speed, a request is due when
+ * its capture timestamp, divided by the speed, has elapsed
+ * since the start of the replay; it is sent then, whether
+ * or not earlier requests have been answered. When the
+ * replayer cannot keep up, the requests it holds back are
+ * sent as soon as it can, and their latency is still
+ * measured from when they were due. At full speed, every
+ * request is due straight away, and each connection sends
+ * as fast as its window allows.
+ *
+ * @param replay
+ */
+void replay_run(struct replay_t* replay) {
+    const struct replay_options_t* options = replay->options;
+    struct replay_results_t* results = &replay->results;
+
+    uint64_t first = replay->trace->count ? replay->trace->records[0].timestamp : 0;
+    uint64_t start = monotonic_nanoseconds();
+    uint64_t deadline = UINT64_MAX;
+    uint64_t now = start;
+
+    while (1) {
+        now = monotonic_nanoseconds();
+
+        uint64_t next_due = UINT64_MAX;
+
+        for (size_t c = 0; c < replay->connection_count; ++c) {
+            struct replay_connection_t* connection = replay->connections[c];
+
+            while (connection->next < connection->record_count) {
+                uint64_t intended = now;
+
+                if (options->speed != 0) {
+                    intended = start + (uint64_t) ((double) (connection->records[connection->next]->timestamp - first) / options->speed);
+                }
+
+                if (intended > now) {
+                    if (intended < next_due) {
+                        next_due = intended;
+                    }
+
+                    break;
+                }
+
+                if (!replay_send(replay, connection, intended, now)) {
+                    break;
+                }
+
+                if (now - intended > results->send_lag) {
+                    results->send_lag = now - intended;
+                }
+
+                results->sent += 1;
+                connection->next += 1;
+            }
+        }
+
+        if ((results->sent == replay->trace->count) && (deadline == UINT64_MAX)) {
+            deadline = now + options->timeout;
+        }
+
+        if ((results->sent == replay->trace->count) && ((outstanding(replay) == 0) || (now >= deadline))) {
+            break;
+        }
+
+        uint64_t wait = REPLAY_POLL_INTERVAL * 1000;
+
+        if ((next_due != UINT64_MAX) && (next_due - now < wait)) {
+            wait = next_due - now;
+        }
+
+        replay_poll(replay, wait);
+    }
+
+    results->elapsed = now - start;
+
+    for (size_t c = 0; c < replay->connection_count; ++c) {
+        struct replay_connection_t* connection = replay->connections[c];
+
+        for (size_t i = 0; i < connection->pending_count; ++i) {
+            results->lost += !connection->pending[(connection->pending_head + i) % REPLAY_PENDING_LIMIT].answered;
+        }
+
+        connection->pending_count = 0;
+    }
+}
+
+/**
+ * @brief Convert a latency to microseconds for printing.
+ *
+ * @param nanoseconds
+ * @return double
+ */
+static double microseconds(uint64_t nanoseconds) {
+    return (double) nanoseconds / 1000.0;
+}
+
+/**
+ * @brief Print what happened during the replay.
+ *
+ * @param replay
+ * @param stream
+ */
+void replay_report(const struct replay_t* replay, FILE* stream) {
+    const struct replay_options_t* options = replay->options;
+    const struct replay_results_t* results = &replay->results;
+    const struct trace_t* trace = replay->trace;
+
+    double seconds = (double) results->elapsed / 1e9;
+    uint64_t lookups = results->hits + results->misses;
+
+    fprintf(stream, "%-16s %zu requests from %zu clients over %.3f s (1 in %" PRIu32 " sampled)%s\n", "trace",
+        trace->count, trace->sessions, (double) trace_span(trace) / 1e9, trace->header.sample, trace->truncated ? ", truncated" : "");
+    fprintf(stream, "%-16s %s\n", "transport", transport_names[options->transport]);
+    fprintf(stream, "%-16s %zu\n", "connections", replay->connection_count);
+
+    if (options->speed == 0) {
+        fprintf(stream, "%-16s %s\n", "speed", "max");
+    } else {
+        fprintf(stream, "%-16s %gx\n", "speed", options->speed);
+    }
+
+    fprintf(stream, "%-16s %.3f s\n", "elapsed", seconds);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "sent", results->sent);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "completed", results->completed);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "lost", results->lost);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "errors", results->errors);
+    fprintf(stream, "%-16s %" PRIu64 "\n", "busy", results->busy);
+    fprintf(stream, "%-16s %.0f req/s\n", "throughput", seconds > 0 ? (double) results->completed / seconds : 0.0);
+    fprintf(stream, "%-16s %.4f (%" PRIu64 " hits, %" PRIu64 " misses)\n", "hit ratio", lookups ? (double) results->hits / (double) lookups : 0.0, results->hits, results->misses);
+    fprintf(stream, "%-16s %.1f us\n", "max send lag", microseconds(results->send_lag));
+
+    fprintf(stream, "\n%-16s %12s %12s\n", "latency (us)", "corrected", "uncorrected");
+
+    static const struct {
+        const char* name;
+        double percentile;
+    } rows[] = {
+        { "p50",   50.0 },
+        { "p99",   99.0 },
+        { "p99.9", 99.9 },
+        { "max",  100.0 }
+    };
+
+    for (size_t row = 0; row < sizeof (rows) / sizeof (rows[0]); ++row) {
+        fprintf(stream, "%-16s %12.1f %12.1f\n", rows[row].name,
+            microseconds(histogram_percentile(&results->corrected, rows[row].percentile)),
+            microseconds(histogram_percentile(&results->uncorrected, rows[row].percentile)));
+    }
+}
@@ -0,0 +1,284 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "trace.h"
+
+/**
+ * @brief A map from a client, as the server identified it,
+ * to its session number. Keys pack the transport above the
+ * connection identifier, and are stored plus one so that
+ * zero can mark an empty slot.
+ *
+ */
+struct session_map_t {
+    uint64_t* keys;
+    uint32_t* sessions;
+    size_t capacity;
+};
+
+/**
+ * @brief Report a memory-allocation failure and exit.
+ *
+ */
+static void out_of_memory(void) {
+    fprintf(stderr, "%s\n", "Memory-allocation failure.");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Mix a key into a slot index.
+ *
+ * @param key
+ * @return uint64_t
+ */
+static uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
+/**
+ * @brief Insert a key into the map, which must have room.
+ *
+ * @param map
+ * @param key
+ * @param session
+ */
+static void session_map_put(struct session_map_t* map, uint64_t key, uint32_t session) {
+    size_t slot = mix(key) & (map->capacity - 1);
+
+    while (map->keys[slot] != 0) {
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+
+    map->keys[slot] = key;
+    map->sessions[slot] = session;
+}
+
+/**
+ * @brief Double the capacity of the map.
+ *
+ * @param map
+ */
+static void session_map_grow(struct session_map_t* map) {
+    struct session_map_t grown = { NULL, NULL, map->capacity ? 2 * map->capacity : 64 };
+
+    grown.keys = calloc(grown.capacity, sizeof (uint64_t));
+    grown.sessions = malloc(grown.capacity * sizeof (uint32_t));
+
+    if ((grown.keys == NULL) || (grown.sessions == NULL)) {
+        out_of_memory();
+    }
+
+    for (size_t i = 0; i < map->capacity; ++i) {
+        if (map->keys[i] != 0) {
+            session_map_put(&grown, map->keys[i], map->sessions[i]);
+        }
+    }
+
+    free(map->keys);
+    free(map->sessions);
+    *map = grown;
+}
+
+/**
+ * @brief Look up the session a client belongs to, starting
+ * a new one the first time the client is seen.
+ *
+ * @param trace
+ * @param map
+ * @param transport
+ * @param connection
+ * @return uint32_t
+ */
+static uint32_t find_session(struct trace_t* trace, struct session_map_t* map, uint8_t transport, uint32_t connection) {
+    uint64_t key = (((uint64_t) transport << 32) | connection) + 1;
+
+    if (2 * (trace->sessions + 1) > map->capacity) {
+        session_map_grow(map);
+    }
+
+    size_t slot = mix(key) & (map->capacity - 1);
+
+    for (; map->keys[slot] != 0; slot = (slot + 1) & (map->capacity - 1)) {
+        if (map->keys[slot] == key) {
+            return map->sessions[slot];
+        }
+    }
+
+    uint8_t* transports = realloc(trace->session_transports, trace->sessions + 1);
+
+    if (transports == NULL) {
+        out_of_memory();
+    }
+
+    trace->session_transports = transports;
+    trace->session_transports[trace->sessions] = transport;
+
+    map->keys[slot] = key;
+    map->sessions[slot] = (uint32_t) trace->sessions;
+
+    return (uint32_t) trace->sessions++;
+}
+
+/**
+ * @brief Read the whole of a file into memory.
+ *
+ * @param filename
+ * @param size
+ * @return The contents, or NULL if the file could not be
+ * read.
+ */
+static char* read_file(const char* filename, size_t* size) {
+    FILE* file = fopen(filename, "rb");
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 1 << 20;
+    size_t length = 0;
+    char* data = malloc(capacity);
+
+    if (data == NULL) {
+        out_of_memory();
+    }
+
+    size_t bytes_read = 0;
+
+    while ((bytes_read = fread(data + length, 1, capacity - length, file)) > 0) {
+        length += bytes_read;
+
+        if (length == capacity) {
+            char* grown = realloc(data, capacity *= 2);
+
+            if (grown == NULL) {
+                out_of_memory();
+            }
+
+            data = grown;
+        }
+    }
+
+    bool failed = ferror(file);
+    fclose(file);
+
+    if (failed) {
+        free(data);
+        return NULL;
+    }
+
+    *size = length;
+    return data;
+}
+
+/**
+ * @brief Load a trace written by the server's --capture
+ * option.
+ *
+ * @details A server that is killed while capturing can
+ * leave part of a record at the end of the file. Loading
+ * stops at the first incomplete or damaged record, and the
+ * trace is marked as truncated.
+ *
+ * @param trace
+ * @param filename
+ * @return false if the file could not be read, or is not a
+ * trace this version understands.
+ */
+bool trace_load(struct trace_t* trace, const char* filename) {
+    memset(trace, 0, sizeof (struct trace_t));
+
+    if ((trace->data = read_file(filename, &trace->size)) == NULL) {
+        fprintf(stderr, "%s %s: %s\n", "Could not read", filename, strerror(errno));
+        return false;
+    }
+
+    if ((trace->size < sizeof (struct trace_file_header_t)) || (memcmp(trace->data, TRACE_MAGIC, 8) != 0)) {
+        fprintf(stderr, "%s: %s\n", "Not a keyvo trace", filename);
+        return false;
+    }
+
+    memcpy(&trace->header, trace->data, sizeof (struct trace_file_header_t));
+
+    if (trace->header.version != TRACE_FORMAT_VERSION) {
+        bool swapped = (__builtin_bswap32(trace->header.version) == TRACE_FORMAT_VERSION);
+
+        fprintf(stderr, "%s: %s\n", swapped ? "Trace was written with a different byte order" : "Unsupported trace version", filename);
+        return false;
+    }
+
+    struct session_map_t map = { NULL, NULL, 0 };
+    size_t capacity = 0;
+    size_t offset = sizeof (struct trace_file_header_t);
+
+    while (offset < trace->size) {
+        struct trace_record_header_t header;
+
+        if (trace->size - offset < sizeof (header)) {
+            trace->truncated = true;
+            break;
+        }
+
+        memcpy(&header, trace->data + offset, sizeof (header));
+        offset += sizeof (header);
+
+        if ((trace->size - offset < header.length) || (header.transport >= TRACE_TRANSPORTS)) {
+            trace->truncated = true;
+            break;
+        }
+
+        if (trace->count == capacity) {
+            capacity = capacity ? 2 * capacity : 4096;
+
+            struct trace_record_t* records = realloc(trace->records, capacity * sizeof (struct trace_record_t));
+
+            if (records == NULL) {
+                out_of_memory();
+            }
+
+            trace->records = records;
+        }
+
+        struct trace_record_t* record = &trace->records[trace->count++];
+
+        record->timestamp = header.timestamp;
+        record->payload = trace->data + offset;
+        record->length = header.length;
+        record->transport = header.transport;
+        record->session = find_session(trace, &map, header.transport, header.connection);
+
+        offset += header.length;
+    }
+
+    free(map.keys);
+    free(map.sessions);
+
+    return true;
+}
+
+/**
+ * @brief Release everything a loaded trace holds on to.
+ *
+ * @param trace
+ */
+void trace_destroy(struct trace_t* trace) {
+    free(trace->data);
+    free(trace->records);
+    free(trace->session_transports);
+    memset(trace, 0, sizeof (struct trace_t));
+}
@@ -0,0 +1,110 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_ADMISSION_H
+#define PROJECT_INCLUDES_ADMISSION_H
+
+#include "keyvo.h"
+#include "metrics.h"
+
+/**
+ * @brief The most command lines a single stream client may
+ * have executed in one pass of the event loop. Anything it
+ * has pipelined beyond that waits in its input buffer for
+ * the next pass, and nothing more is read from its socket
+ * until the backlog has been worked off, so a client that
+ * floods the server only ever delays itself.
+ *
+ */
+#ifndef ADMISSION_BATCH
+#define ADMISSION_BATCH 32
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief The number of token buckets datagram clients are
+ * spread over. Datagram clients have no connection to keep
+ * a bucket in, so they share these by hashing their
+ * address; two clients only ever share a limit by bad luck.
+ *
+ */
+#ifndef ADMISSION_DATAGRAM_BUCKETS
+#define ADMISSION_DATAGRAM_BUCKETS 4096
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief The default queueing delay, in milliseconds, past
+ * which the server starts shedding load.
+ *
+ */
+#ifndef ADMISSION_SHED_DELAY
+#define ADMISSION_SHED_DELAY 5
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How the server decides which requests to turn
+ * away.
+ *
+ * @details Every client may run at most rate commands a
+ * second, with bursts of up to burst commands; a rate of
+ * zero means clients are not limited.
+ *
+ * Independently of that, a request that has waited longer
+ * than shed_delay nanoseconds to be executed is a sign the
+ * server is overloaded. Writes are shed first, then bulk
+ * reads at twice the delay, and single-key reads only at
+ * four times the delay. A shed_delay of zero turns load
+ * shedding off.
+ *
+ */
+struct admission_policy_t {
+    uint32_t rate;
+    uint32_t burst;
+    uint64_t shed_delay;
+};
+
+/**
+ * @brief A per-client token bucket.
+ *
+ * @details The bucket is kept as the single timestamp of
+ * the generic cell rate algorithm: the time at which the
+ * client will next have a full bucket. Each command pushes
+ * it one token's worth of time further out, and the client
+ * is over its limit when that would put it more than a
+ * whole burst ahead of the present.
+ *
+ */
+struct token_bucket_t {
+    uint64_t full_at;
+};
+
+/**
+ * @brief What to do with a command.
+ *
+ */
+enum admission_verdict_t {
+    ADMISSION_ACCEPT,
+    ADMISSION_SHED,
+    ADMISSION_RATE_LIMITED
+};
+
+void admission_configure(const struct admission_policy_t* policy);
+
+bool admission_rate_limited(void);
+
+struct token_bucket_t* admission_datagram_bucket(uint32_t client_id);
+
+enum admission_verdict_t admission_check(struct token_bucket_t* bucket, enum command_id_t command, uint64_t cost, uint64_t queue_delay, uint64_t now);
+
+#endif /** PROJECT_INCLUDES_ADMISSION_H */
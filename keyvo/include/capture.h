@@ -0,0 +1,148 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_CAPTURE_H
+#define PROJECT_INCLUDES_CAPTURE_H
+
+#include "keyvo.h"
+#include "log.h"
+
+/**
+ * @brief The size, in bytes, of the ring captured requests
+ * are staged in on their way to disk. This must be a power
+ * of two. If the writer falls this far behind, requests are
+ * left out of the trace rather than slowing the server down.
+ *
+ */
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE (4 * 1024 * 1024)
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How long, in microseconds, the writer thread
+ * sleeps when it finds the ring empty.
+ *
+ */
+#ifndef CAPTURE_DRAIN_INTERVAL
+#define CAPTURE_DRAIN_INTERVAL 1000
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief Every trace starts with these eight bytes.
+ *
+ */
+#define CAPTURE_MAGIC "KEYVOCAP"
+
+#define CAPTURE_FORMAT_VERSION 1
+
+/**
+ * @brief How a captured request reached the server.
+ *
+ */
+enum capture_transport_t {
+    CAPTURE_UDP,
+    CAPTURE_TCP,
+    CAPTURE_UNIX
+};
+
+/**
+ * @brief The header at the start of a trace file. Every
+ * field is in the byte order of the server that wrote it.
+ *
+ */
+struct capture_file_header_t {
+    char magic[8];
+    uint32_t version;
+
+    /** Only one in this many clients was captured */
+    uint32_t sample;
+
+    /** Wall-clock time the capture began, in nanoseconds */
+    uint64_t started;
+};
+
+/**
+ * @brief The header in front of every captured request.
+ *
+ * @details For a stream client, each record holds exactly
+ * one command line, without its newline. For a datagram
+ * client, it holds the whole datagram as it arrived. The
+ * connection identifies the client for the life of the
+ * capture: stream clients are numbered as they connect,
+ * and datagram clients are identified by their address.
+ *
+ */
+struct capture_record_t {
+    /** Nanoseconds since the capture began */
+    uint64_t timestamp;
+    uint32_t connection;
+
+    /** Length of the payload that follows the header */
+    uint16_t length;
+
+    /** One of capture_transport_t */
+    uint8_t transport;
+    uint8_t reserved;
+};
+
+_Static_assert(sizeof (struct capture_file_header_t) == 24, "the trace header layout is part of the file format");
+_Static_assert(sizeof (struct capture_record_t) == 16, "the record header layout is part of the file format");
+
+/**
+ * @brief One in this many clients is captured, or none at
+ * all while this is zero.
+ *
+ */
+extern uint32_t capture_sample;
+
+/**
+ * @brief Decide whether a client's requests should go into
+ * the trace.
+ *
+ * @details The decision is made per client rather than per
+ * request, so that every captured client's requests are
+ * all in the trace, and can be replayed in order. The
+ * identifier is mixed first, since stream clients are
+ * numbered sequentially.
+ *
+ * @param connection
+ * @return true
+ * @return false
+ */
+static inline bool capture_sampled(uint32_t connection) {
+    if (capture_sample == 0) {
+        return false;
+    }
+
+    connection ^= connection >> 16;
+    connection *= 0x7feb352dU;
+    connection ^= connection >> 15;
+    connection *= 0x846ca68bU;
+    connection ^= connection >> 16;
+
+    return (connection % capture_sample) == 0;
+}
+
+void capture_request(uint32_t connection, enum capture_transport_t transport, const char* payload, size_t length);
+
+void start_capture(const char* filename, uint32_t sample);
+
+void stop_capture(void);
+
+uint64_t capture_records_written(void);
+
+uint64_t capture_records_dropped(void);
+
+#endif /** PROJECT_INCLUDES_CAPTURE_H */
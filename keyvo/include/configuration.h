@@ -0,0 +1,25 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_CONFIGURATION_H
+#define PROJECT_INCLUDES_CONFIGURATION_H
+
+#include "keyvo.h"
+#include "log.h"
+#include "symbol_table.h"
+
+size_t load_configuration(struct symbol_table_t* symbol_table, const char* filename);
+
+#endif /** PROJECT_INCLUDES_CONFIGURATION_H */
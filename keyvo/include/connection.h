@@ -0,0 +1,155 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_CONNECTION_H
+#define PROJECT_INCLUDES_CONNECTION_H
+
+#include "keyvo.h"
+#include "log.h"
+#include "admission.h"
+
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+/**
+ * @brief The longest command line a stream client may send.
+ * A client that sends a longer line is disconnected.
+ *
+ */
+#ifndef CONNECTION_INPUT_SIZE
+#define CONNECTION_INPUT_SIZE 65536
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief The most reply data the server will hold on to for
+ * a client that is not reading it. A client that falls
+ * further behind than this is disconnected.
+ *
+ */
+#ifndef CONNECTION_OUTPUT_LIMIT
+#define CONNECTION_OUTPUT_LIMIT (4 * 1024 * 1024)
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How much reply data a client may leave unread
+ * before the server stops executing its commands. Once it
+ * has caught up, the server carries on where it left off.
+ *
+ */
+#ifndef CONNECTION_OUTPUT_HIGH_WATER
+#define CONNECTION_OUTPUT_HIGH_WATER (256 * 1024)
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief The state of a single TCP or Unix-domain client.
+ *
+ * @details Stream clients may pipeline as many commands as
+ * they like. Input is accumulated until a full line has
+ * arrived, and replies are queued up in the output buffer
+ * and written out as fast as the client will take them.
+ *
+ * A client that has sent SUBSCRIBE is also pushed an
+ * INVALIDATE line for every key that changes. If it falls
+ * too far behind on those, it is marked as failed and
+ * disconnected, which tells it to forget everything it has
+ * cached.
+ *
+ * While traffic is being captured, the id and transport
+ * identify the client in the trace, and captured says
+ * whether it was sampled.
+ *
+ * The input buffer doubles as the client's request queue.
+ * When it holds complete lines that have not been executed
+ * yet, backlogged is set, and nothing more is read from the
+ * socket until they have been; arrived is when they were
+ * first seen waiting to be read, which is what their
+ * queueing delay is measured from. That is the time
+ * select() woke up to say the socket was readable, or, if
+ * bytes were still left in the kernel's socket buffer after
+ * the last read, readable: the time they were found there.
+ * Either way, the delay includes the time a request sat in
+ * the socket buffer, not just in ours.
+ *
+ */
+struct connection_t {
+    int socket;
+
+    uint32_t id;
+    uint8_t transport;
+    bool captured;
+
+    size_t input_length;
+    char input[CONNECTION_INPUT_SIZE];
+    bool backlogged;
+    uint64_t arrived;
+    uint64_t readable;
+
+    struct token_bucket_t bucket;
+
+    char* output;
+    size_t output_length;
+    size_t output_sent;
+    size_t output_capacity;
+
+    bool subscribed;
+    bool failed;
+};
+
+struct connection_t* connection_open(int socket);
+
+void connection_close(struct connection_t* connection);
+
+bool connection_append_output(struct connection_t* connection, const char* data, size_t length);
+
+bool connection_flush(struct connection_t* connection);
+
+/**
+ * @brief Check whether the connection still has replies
+ * waiting to be written.
+ *
+ * @param connection
+ * @return true
+ * @return false
+ */
+static inline bool connection_pending_output(const struct connection_t* connection) {
+    return connection->output_sent < connection->output_length;
+}
+
+/**
+ * @brief Check whether the client has left so many replies
+ * unread that the server should stop executing its
+ * commands until it catches up.
+ *
+ * @param connection
+ * @return true
+ * @return false
+ */
+static inline bool connection_output_backlogged(const struct connection_t* connection) {
+    return connection->output_length - connection->output_sent > CONNECTION_OUTPUT_HIGH_WATER;
+}
+
+/**
+ * @brief Check whether the client has queued commands the
+ * server could execute right away.
+ *
+ * @param connection
+ * @return true
+ * @return false
+ */
+static inline bool connection_runnable(const struct connection_t* connection) {
+    return connection->backlogged && !connection_output_backlogged(connection);
+}
+
+#endif /** PROJECT_INCLUDES_CONNECTION_H */
@@ -0,0 +1,114 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_FROZEN_TABLE_H
+#define PROJECT_INCLUDES_FROZEN_TABLE_H
+
+#include "keyvo.h"
+#include "log.h"
+#include "symbol_table.h"
+
+#include <sys/mman.h>
+
+/**
+ * @brief The average number of keys that share a
+ * displacement seed. Larger buckets make the index smaller
+ * but the build slower.
+ *
+ */
+#ifndef FROZEN_BUCKET_LOAD
+#define FROZEN_BUCKET_LOAD 4
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief The percentage of slots the keys fill. Leaving a
+ * few slots free means the last buckets to be placed still
+ * have somewhere to go, which keeps the seed search short
+ * even over millions of keys.
+ *
+ */
+#ifndef FROZEN_LOAD_PERCENT
+#define FROZEN_LOAD_PERCENT 99
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How many seeds the build tries for a bucket before
+ * giving up and starting over with a different hash salt.
+ *
+ */
+#ifndef FROZEN_MAXIMUM_SEED
+#define FROZEN_MAXIMUM_SEED (1 << 20)
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How many hash salts the build tries before giving
+ * up on freezing the table altogether.
+ *
+ */
+#ifndef FROZEN_MAXIMUM_ATTEMPTS
+#define FROZEN_MAXIMUM_ATTEMPTS 16
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief An immutable table, indexed by a perfect hash
+ * function.
+ *
+ * @details The hash function is built with the CHD
+ * (compress, hash and displace) algorithm. Every key is
+ * hashed once; the hash picks a bucket, and the bucket's
+ * seed displaces the hash onto a slot. The seeds are chosen
+ * so that the n keys land on n distinct slots, so every
+ * lookup is exactly one probe. There are slightly more
+ * slots than keys (see FROZEN_LOAD_PERCENT); the offsets
+ * array maps the slots back onto the n packed entries, and
+ * the spare slots point at an arbitrary entry whose key
+ * will simply fail to match.
+ *
+ * The seeds, the slot offsets and every key and value live
+ * in a single read-only mapping, which is put on huge pages
+ * when they are enabled:
+ *
+ *     [ seeds: uint32_t x bucket_count ]
+ *     [ offsets: uint32_t x slot_count ]
+ *     [ entries, in slot order ]
+ *
+ * Each entry is a uint32_t key length, followed by the
+ * NUL-terminated key and value, padded to four bytes.
+ *
+ */
+struct frozen_table_t {
+    char* blob;
+    size_t blob_size;
+
+    const uint32_t* seeds;
+    const uint32_t* offsets;
+    const char* entries;
+
+    size_t bucket_count;
+    size_t slot_count;
+    size_t count;
+    uint64_t salt;
+
+    uint64_t hits;
+    uint64_t misses;
+};
+
+bool frozen_table_build(struct frozen_table_t* frozen_table, const struct symbol_table_t* symbol_table);
+
+void frozen_table_destroy(struct frozen_table_t* frozen_table);
+
+const char* frozen_table_lookup(struct frozen_table_t* frozen_table, const char* key);
+
+#endif /** PROJECT_INCLUDES_FROZEN_TABLE_H */
@@ -0,0 +1,101 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_HUGE_PAGES_H
+#define PROJECT_INCLUDES_HUGE_PAGES_H
+
+#include "keyvo.h"
+#include "log.h"
+
+#include <sys/mman.h>
+
+/**
+ * @brief The size of a huge page on x86-64 and most other
+ * platforms we care about.
+ *
+ */
+#ifndef HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief Set by --huge-pages. While this is false, every
+ * function below behaves exactly like the plain allocator
+ * it stands in for.
+ *
+ */
+extern bool huge_pages_enabled;
+
+/**
+ * @brief How much memory ended up on huge pages, and how.
+ *
+ */
+struct huge_page_stats_t {
+    /** Bytes backed by the reserved hugetlbfs pool */
+    uint64_t reserved_bytes;
+
+    /** Bytes backed by transparent huge pages */
+    uint64_t transparent_bytes;
+
+    /** Huge-page mappings made so far */
+    uint64_t mappings;
+
+    /** Mappings that fell back from reserved to THP */
+    uint64_t fallbacks;
+};
+
+/**
+ * @brief A pool of fixed-size objects, carved out of huge-
+ * page chunks when huge pages are enabled.
+ *
+ * @details Objects that are released go onto a free list
+ * and are handed out again before a new chunk is mapped.
+ * Chunks are only returned to the system when the whole
+ * pool is destroyed.
+ *
+ */
+struct object_pool_t {
+    size_t object_size;
+
+    void* free_list;
+
+    char* chunk;
+    size_t chunk_used;
+
+    char** chunks;
+    size_t chunk_count;
+};
+
+size_t huge_pages_mapping_size(size_t size);
+
+void* huge_pages_map(size_t size);
+
+void huge_pages_unmap(void* memory, size_t size);
+
+void* huge_pages_allocate(size_t size);
+
+void huge_pages_release(void* memory, size_t size);
+
+void huge_pages_statistics(struct huge_page_stats_t* stats);
+
+void object_pool_initialize(struct object_pool_t* pool, size_t object_size);
+
+void* object_pool_allocate(struct object_pool_t* pool);
+
+void object_pool_release(struct object_pool_t* pool, void* object);
+
+void object_pool_destroy(struct object_pool_t* pool);
+
+#endif /** PROJECT_INCLUDES_HUGE_PAGES_H */
@@ -17,21 +17,28 @@
 #define PROJECT_INCLUDES_KEYVO_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <signal.h>
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
 
 #if !defined(unix) || !defined(linux)
     #include <unistd.h>
 
     #include <sys/resource.h>
+    #include <sys/select.h>
     #include <sys/socket.h>
     #include <sys/stat.h>
     #include <sys/types.h>
+    #include <sys/un.h>
     
     #include <arpa/inet.h>
 
@@ -49,6 +56,10 @@
 #define LOCKFILE "/var/tmp/keyvo.lock"
 #endif /** Keyvo lockfile */
 
+#ifndef PORT
+#define PORT "8080"
+#endif /** Default port the server listens on */
+
 #ifndef LOCKMODE
 #define LOCKMODE (S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)
 #endif /** @todo Move to a configuration file */
@@ -0,0 +1,167 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_LOG_H
+#define PROJECT_INCLUDES_LOG_H
+
+#include "keyvo.h"
+
+/**
+ * @brief The number of records in each thread's ring. This
+ * must be a power of two.
+ *
+ */
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 4096
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How long, in microseconds, the background thread
+ * sleeps when it finds every ring empty.
+ *
+ */
+#ifndef LOG_DRAIN_INTERVAL
+#define LOG_DRAIN_INTERVAL 1000
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief A log record holds at most this many arguments
+ * besides its format string.
+ *
+ */
+#define LOG_RECORD_ARGUMENTS 4
+
+/**
+ * @brief String arguments are copied into the record, and
+ * share this many bytes between them. Longer strings are
+ * truncated.
+ *
+ */
+#define LOG_RECORD_TEXT 64
+
+/**
+ * @brief The type of each argument, as captured at the
+ * call site, so the background thread knows how to format
+ * it.
+ *
+ */
+enum log_argument_type_t {
+    LOG_ARGUMENT_SIGNED,
+    LOG_ARGUMENT_UNSIGNED,
+    LOG_ARGUMENT_DOUBLE,
+    LOG_ARGUMENT_STRING,
+    LOG_ARGUMENT_POINTER
+};
+
+/**
+ * @brief A single argument to a log call. String arguments
+ * still point at the caller's memory here; they are copied
+ * into the record when it is written to the ring.
+ *
+ */
+struct log_argument_t {
+    uint8_t type;
+
+    union {
+        long long s;
+        unsigned long long u;
+        double d;
+        const char* string;
+        const void* pointer;
+    } value;
+};
+
+/**
+ * @brief The following helpers are selected by the
+ * LOG_ARGUMENT() macro below, based on the static type of
+ * each argument.
+ *
+ */
+static inline struct log_argument_t log_argument_signed(long long value) {
+    return (struct log_argument_t) { .type = LOG_ARGUMENT_SIGNED, .value.s = value };
+}
+
+static inline struct log_argument_t log_argument_unsigned(unsigned long long value) {
+    return (struct log_argument_t) { .type = LOG_ARGUMENT_UNSIGNED, .value.u = value };
+}
+
+static inline struct log_argument_t log_argument_double(double value) {
+    return (struct log_argument_t) { .type = LOG_ARGUMENT_DOUBLE, .value.d = value };
+}
+
+static inline struct log_argument_t log_argument_string(const char* value) {
+    return (struct log_argument_t) { .type = LOG_ARGUMENT_STRING, .value.string = value };
+}
+
+static inline struct log_argument_t log_argument_pointer(const void* value) {
+    return (struct log_argument_t) { .type = LOG_ARGUMENT_POINTER, .value.pointer = value };
+}
+
+#define LOG_ARGUMENT(x) _Generic((x),                      \
+    _Bool:              log_argument_unsigned,              \
+    char:               log_argument_signed,                \
+    signed char:        log_argument_signed,                \
+    short:              log_argument_signed,                \
+    int:                log_argument_signed,                \
+    long:               log_argument_signed,                \
+    long long:          log_argument_signed,                \
+    unsigned char:      log_argument_unsigned,              \
+    unsigned short:     log_argument_unsigned,              \
+    unsigned int:       log_argument_unsigned,              \
+    unsigned long:      log_argument_unsigned,              \
+    unsigned long long: log_argument_unsigned,              \
+    float:              log_argument_double,                \
+    double:             log_argument_double,                \
+    char*:              log_argument_string,                \
+    const char*:        log_argument_string,                \
+    default:            log_argument_pointer)(x)
+
+#define LOG_0(priority, format) \
+    log_event(priority, format, 0, NULL)
+#define LOG_1(priority, format, a) \
+    log_event(priority, format, 1, (struct log_argument_t[]) { LOG_ARGUMENT(a) })
+#define LOG_2(priority, format, a, b) \
+    log_event(priority, format, 2, (struct log_argument_t[]) { LOG_ARGUMENT(a), LOG_ARGUMENT(b) })
+#define LOG_3(priority, format, a, b, c) \
+    log_event(priority, format, 3, (struct log_argument_t[]) { LOG_ARGUMENT(a), LOG_ARGUMENT(b), LOG_ARGUMENT(c) })
+#define LOG_4(priority, format, a, b, c, d) \
+    log_event(priority, format, 4, (struct log_argument_t[]) { LOG_ARGUMENT(a), LOG_ARGUMENT(b), LOG_ARGUMENT(c), LOG_ARGUMENT(d) })
+
+#define LOG_SELECT(_0, _1, _2, _3, _4, NAME, ...) NAME
+
+/**
+ * @brief This is the drop-in replacement for syslog() that
+ * the rest of the server uses.
+ *
+ * @details The format string must be a string literal, or
+ * at least outlive the process, since only a pointer to it
+ * is recorded. Everything else is captured by value at the
+ * call site, and the actual formatting happens later on the
+ * background thread. The format supports the conversions
+ * printf does, minus '*' widths, plus syslog's %m.
+ *
+ */
+#define keyvo_log(priority, ...) \
+    LOG_SELECT(__VA_ARGS__, LOG_4, LOG_3, LOG_2, LOG_1, LOG_0, LOG_0)(priority, __VA_ARGS__)
+
+void log_event(int priority, const char* format, unsigned int argc, const struct log_argument_t* argv);
+
+void start_logger(const char* filename);
+
+void stop_logger(void);
+
+uint64_t log_records_dropped(void);
+
+#endif /** PROJECT_INCLUDES_LOG_H */
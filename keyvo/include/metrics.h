@@ -0,0 +1,287 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_METRICS_H
+#define PROJECT_INCLUDES_METRICS_H
+
+#include "keyvo.h"
+#include "symbol_table.h"
+#include "frozen_table.h"
+
+#include <stdatomic.h>
+
+/**
+ * @brief The commands the server keeps separate counters
+ * and latency histograms for.
+ *
+ */
+enum command_id_t {
+    COMMAND_GET,
+    COMMAND_DEFINE,
+    COMMAND_UPDATE,
+    COMMAND_DROP,
+    COMMAND_MGET,
+    COMMAND_GETV,
+    COMMAND_CHECK,
+    COMMAND_COUNT
+};
+
+/**
+ * @brief The wire name of every command, indexed by its
+ * command_id_t.
+ *
+ */
+extern const char* const command_names[COMMAND_COUNT];
+
+/**
+ * @brief Every power of two in the histogram is split into
+ * 2^HISTOGRAM_SUB_BUCKET_BITS linear sub-buckets, so any
+ * recorded value is off by at most about three percent.
+ *
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS     (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * @brief Values are recorded in nanoseconds; anything from
+ * 2^40 ns (about eighteen minutes) up is lumped together in
+ * the last bucket.
+ *
+ */
+#define HISTOGRAM_MAXIMUM_BITS    40
+#define HISTOGRAM_BUCKETS         ((HISTOGRAM_MAXIMUM_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @brief An HDR-style log-linear latency histogram.
+ *
+ * @details Every field is only ever written by the thread
+ * that owns the histogram. The fields are atomic purely so
+ * that the thread merging them for a STATS request can read
+ * them without tearing; the owner updates them with a
+ * relaxed load and store, which compiles down to an
+ * ordinary increment with no lock prefix.
+ *
+ */
+struct histogram_t {
+    _Atomic uint64_t counts[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t total;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+};
+
+/**
+ * @brief A plain snapshot of one or more histograms, summed
+ * together for reporting.
+ *
+ */
+struct histogram_snapshot_t {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/**
+ * @brief The counters owned by a single thread. Each group
+ * of counters starts on its own cache line, and the whole
+ * structure is cache-line aligned, so no two threads ever
+ * write to the same line.
+ *
+ */
+struct thread_metrics_t {
+    _Alignas(64) _Atomic uint64_t requests;
+    _Atomic uint64_t errors;
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t commands[COMMAND_COUNT];
+    _Atomic uint64_t shed[COMMAND_COUNT];
+    _Atomic uint64_t rate_limited;
+
+    _Alignas(64) struct histogram_t latency[COMMAND_COUNT];
+    struct histogram_t queue_delay;
+
+    struct thread_metrics_t* next;
+};
+
+/**
+ * @brief Return the current value of the monotonic clock,
+ * in nanoseconds. This is what command latencies are
+ * measured with.
+ *
+ * @return uint64_t
+ */
+static inline uint64_t monotonic_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Add to a counter owned by the calling thread.
+ *
+ * @param counter
+ * @param value
+ */
+static inline void counter_add(_Atomic uint64_t* counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/**
+ * @brief The calling thread's counters, or NULL until the
+ * thread records its first metric.
+ *
+ */
+extern _Thread_local struct thread_metrics_t* current_thread_metrics;
+
+struct thread_metrics_t* register_thread_metrics(void);
+
+/**
+ * @brief Return the calling thread's counters, creating
+ * them on first use.
+ *
+ * @return struct thread_metrics_t*
+ */
+static inline struct thread_metrics_t* thread_metrics(void) {
+    struct thread_metrics_t* metrics = current_thread_metrics;
+
+    if (metrics == NULL) {
+        metrics = register_thread_metrics();
+    }
+
+    return metrics;
+}
+
+/**
+ * @brief Map a value onto its histogram bucket. Values
+ * below 2^(HISTOGRAM_SUB_BUCKET_BITS + 1) each get their own
+ * bucket; above that, every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS evenly-sized buckets.
+ *
+ * @param value
+ * @return size_t
+ */
+static inline size_t histogram_bucket(uint64_t value) {
+    if (value < (UINT64_C(2) << HISTOGRAM_SUB_BUCKET_BITS)) {
+        return value;
+    }
+
+    unsigned int magnitude = 63 - __builtin_clzll(value);
+
+    if (magnitude >= HISTOGRAM_MAXIMUM_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    unsigned int shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return ((size_t) (shift + 1) << HISTOGRAM_SUB_BUCKET_BITS) + ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+/**
+ * @brief Record a value in a histogram owned by the
+ * calling thread.
+ *
+ * @param histogram
+ * @param value
+ */
+static inline void histogram_record(struct histogram_t* histogram, uint64_t value) {
+    counter_add(&histogram->counts[histogram_bucket(value)], 1);
+    counter_add(&histogram->total, 1);
+    counter_add(&histogram->sum, value);
+
+    if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed)) {
+        atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+    }
+}
+
+uint64_t histogram_percentile(const struct histogram_snapshot_t* snapshot, double percentile);
+
+/**
+ * @brief Count a request and the bytes that came in with it.
+ *
+ * @param bytes
+ */
+static inline void metrics_record_request(size_t bytes) {
+    struct thread_metrics_t* metrics = thread_metrics();
+
+    counter_add(&metrics->requests, 1);
+    counter_add(&metrics->bytes_in, bytes);
+}
+
+/**
+ * @brief Count the bytes sent back in a response.
+ *
+ * @param bytes
+ */
+static inline void metrics_record_response(size_t bytes) {
+    counter_add(&thread_metrics()->bytes_out, bytes);
+}
+
+/**
+ * @brief Count a command and record how long it took.
+ *
+ * @param command
+ * @param nanoseconds
+ */
+static inline void metrics_record_command(enum command_id_t command, uint64_t nanoseconds) {
+    struct thread_metrics_t* metrics = thread_metrics();
+
+    counter_add(&metrics->commands[command], 1);
+    histogram_record(&metrics->latency[command], nanoseconds);
+}
+
+/**
+ * @brief Record how long a command waited to be executed.
+ *
+ * @param nanoseconds
+ */
+static inline void metrics_record_queue_delay(uint64_t nanoseconds) {
+    histogram_record(&thread_metrics()->queue_delay, nanoseconds);
+}
+
+/**
+ * @brief Count a command that was turned away because the
+ * server was overloaded.
+ *
+ * @param command
+ */
+static inline void metrics_record_shed(enum command_id_t command) {
+    counter_add(&thread_metrics()->shed[command], 1);
+}
+
+/**
+ * @brief Count a command that was turned away because its
+ * client was over its rate limit.
+ *
+ */
+static inline void metrics_record_rate_limited(void) {
+    counter_add(&thread_metrics()->rate_limited, 1);
+}
+
+/**
+ * @brief Count a request that was answered with an error.
+ *
+ */
+static inline void metrics_record_error(void) {
+    counter_add(&thread_metrics()->errors, 1);
+}
+
+void metrics_set_frozen_table(const struct frozen_table_t* frozen_table);
+
+size_t render_stats(const struct symbol_table_t* symbol_table, char* buffer, size_t capacity);
+
+size_t render_prometheus(const struct symbol_table_t* symbol_table, char* buffer, size_t capacity);
+
+#endif /** PROJECT_INCLUDES_METRICS_H */
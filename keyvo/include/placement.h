@@ -0,0 +1,85 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_PLACEMENT_H
+#define PROJECT_INCLUDES_PLACEMENT_H
+
+#include "keyvo.h"
+#include "log.h"
+
+#include <sched.h>
+
+/**
+ * @brief The most pages STATS looks up when checking where
+ * the table's memory actually lives.
+ *
+ */
+#ifndef PLACEMENT_SAMPLE_PAGES
+#define PLACEMENT_SAMPLE_PAGES 256
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief Where the command line asked the server to run.
+ * Either field may be -1 to leave it up to the kernel.
+ *
+ */
+struct placement_t {
+    /** The CPU the event loop is pinned to */
+    int cpu;
+
+    /** The NUMA node memory is allocated from */
+    int node;
+};
+
+/**
+ * @brief The CPU the event loop was last seen running on,
+ * and how many times it has been seen to move.
+ *
+ */
+extern int placement_current_cpu;
+extern uint64_t placement_cpu_migrations;
+
+/**
+ * @brief Note which CPU the event loop is running on. This
+ * is called once per turn of the loop, and costs no system
+ * call, so it stays on even when the loop is not pinned;
+ * that way the migration count shows why pinning helps.
+ *
+ */
+static inline void placement_note_cpu(void) {
+    int cpu = sched_getcpu();
+
+    if (cpu != placement_current_cpu) {
+        if (placement_current_cpu != -1) {
+            ++placement_cpu_migrations;
+        }
+
+        placement_current_cpu = cpu;
+    }
+}
+
+bool placement_parse_node(const char* argument, int* node);
+
+bool placement_apply(struct placement_t* placement);
+
+void placement_pin_event_loop(const struct placement_t* placement);
+
+int placement_node_of_cpu(int cpu);
+
+int placement_memory_node(void);
+
+void placement_page_locality(void* const* addresses, size_t count, int node, uint64_t* local, uint64_t* remote);
+
+#endif /** PROJECT_INCLUDES_PLACEMENT_H */
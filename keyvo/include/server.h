@@ -0,0 +1,87 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_SERVER_H
+#define PROJECT_INCLUDES_SERVER_H
+
+#include "keyvo.h"
+#include "log.h"
+#include "symbol_table.h"
+#include "connection.h"
+#include "frozen_table.h"
+
+/**
+ * @brief The largest request or response the server will
+ * handle in a single datagram.
+ *
+ */
+#ifndef DATAGRAM_SIZE
+#define DATAGRAM_SIZE 65536
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How often, in milliseconds, the event loop wakes
+ * up to actively expire keys when there are any keys with
+ * a time-to-live in the table.
+ *
+ */
+#ifndef EXPIRY_INTERVAL
+#define EXPIRY_INTERVAL 10
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief The largest metrics report the HTTP endpoint will
+ * serve.
+ *
+ */
+#ifndef METRICS_RESPONSE_SIZE
+#define METRICS_RESPONSE_SIZE 65536
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief How long, in milliseconds, a scrape of the metrics
+ * endpoint may take from start to finish before it is cut
+ * off.
+ *
+ */
+#ifndef METRICS_TIMEOUT
+#define METRICS_TIMEOUT 1000
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief Everything the command line can tell the event
+ * loop about where and how to listen.
+ *
+ */
+struct server_options_t {
+    /** Port for both the UDP and the TCP listener */
+    const char* port;
+
+    /** Path of the Unix-domain listener, or NULL for none */
+    const char* socket_path;
+
+    /** Port for the Prometheus endpoint, or NULL for none */
+    const char* metrics_port;
+
+    /** The read-only table to serve instead, or NULL */
+    struct frozen_table_t* frozen_table;
+
+    /** Rate limits and load shedding */
+    struct admission_policy_t admission;
+};
+
+void serve(struct symbol_table_t* symbol_table, const struct server_options_t* options);
+
+#endif /** PROJECT_INCLUDES_SERVER_H */
@@ -0,0 +1,196 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_SYMBOL_TABLE_H
+#define PROJECT_INCLUDES_SYMBOL_TABLE_H
+
+#include "keyvo.h"
+#include "log.h"
+#include "timing_wheel.h"
+#include "huge_pages.h"
+
+/**
+ * @brief A time-to-live of zero means the key never
+ * expires on its own.
+ *
+ */
+#define SYMBOL_TABLE_NO_TTL 0
+
+/**
+ * @brief The maximum number of keys the active-expiry pass
+ * will process on any single tick of the event loop. Keys
+ * past this limit are either picked up on the next tick or
+ * lazily, the next time someone asks for them.
+ *
+ */
+#ifndef EXPIRY_BUDGET
+#define EXPIRY_BUDGET 1024
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief Fraction of the memory budget, in percent, that
+ * S3-FIFO reserves for the small probationary queue.
+ *
+ */
+#ifndef SMALL_QUEUE_PERCENT
+#define SMALL_QUEUE_PERCENT 10
+#endif /** @todo Move to a configuration file */
+
+/**
+ * @brief Entries are counted as having been accessed at
+ * most this many times, which is all S3-FIFO needs.
+ *
+ */
+#define MAXIMUM_FREQUENCY 3
+
+/**
+ * @brief The two eviction queues an entry can live in.
+ *
+ */
+enum eviction_queue_id_t {
+    QUEUE_SMALL,
+    QUEUE_MAIN
+};
+
+/**
+ * @brief This struct contains two mutable char pointers
+ * which will point at a dynamic configuration setting.
+ *
+ * @details Entries are chained off of the bucket they hash
+ * into, and carry their own expiry timer so that giving a
+ * key a time-to-live never requires an extra allocation.
+ *
+ */
+struct key_val_t {
+    char* key;
+    char* val;
+
+    /** The next entry in the same bucket */
+    struct key_val_t* next;
+
+    /** The full hash of the key, so rehashing is cheap */
+    uint64_t hash;
+
+    /** Monotonic expiry time in milliseconds, or zero */
+    uint64_t expires_at;
+
+    /** Bumped every time the value changes */
+    uint64_t version;
+
+    struct wheel_timer_t timer;
+
+    /** Neighbours in whichever eviction queue holds us */
+    struct key_val_t* newer;
+    struct key_val_t* older;
+
+    /** Bytes charged against the memory budget */
+    size_t size;
+
+    /** Saturating access count, bumped on every hit */
+    uint8_t frequency;
+
+    /** Which eviction queue the entry is in */
+    uint8_t queue;
+};
+
+/**
+ * @brief The function the symbol table calls whenever a
+ * key's value changes or the key goes away, for whatever
+ * reason: an update, a drop, expiry or eviction.
+ *
+ */
+typedef void (*symbol_table_change_callback_t)(void* context, const char* key);
+
+/**
+ * @brief A FIFO of entries, linked through the entries
+ * themselves. Entries are only ever pushed at the head and
+ * taken from the tail, never moved on access.
+ *
+ */
+struct eviction_queue_t {
+    struct key_val_t* head;
+    struct key_val_t* tail;
+    size_t bytes;
+};
+
+/**
+ * @brief This is the primary datastructure in the server,
+ * as a collection of key-value pairs is the definition of
+ * a configuration.
+ *
+ */
+struct symbol_table_t {
+    struct key_val_t** buckets;
+    size_t bucket_count;
+    size_t count;
+
+    /** Expiry schedule for every key with a time-to-live */
+    struct timing_wheel_t expiry;
+
+    /** Key, value and metadata bytes currently in use */
+    size_t memory_used;
+
+    /** Memory budget in bytes, or zero for no limit */
+    size_t memory_limit;
+
+    /** S3-FIFO queues; see evict_one() for the details */
+    struct eviction_queue_t queues[2];
+
+    /** Hashes of recently-evicted keys, indexed by hash */
+    uint64_t* ghosts;
+    size_t ghost_count;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+    /** The last version handed out to an entry */
+    uint64_t version;
+
+    /** Told about every change, if set */
+    symbol_table_change_callback_t on_change;
+    void* on_change_context;
+
+    /** Where entries are allocated from */
+    struct object_pool_t entries;
+};
+
+/**
+ * @brief Result codes for the operations which modify the
+ * symbol table.
+ *
+ */
+enum symbol_table_status_t {
+    SYMBOL_TABLE_OK,
+    SYMBOL_TABLE_EXISTS,
+    SYMBOL_TABLE_NOT_FOUND,
+    SYMBOL_TABLE_TOO_LARGE
+};
+
+void initialize_symbol_table(struct symbol_table_t* symbol_table);
+
+void destroy_symbol_table(struct symbol_table_t* symbol_table);
+
+struct key_val_t* symbol_table_lookup(struct symbol_table_t* symbol_table, const char* key, uint64_t now);
+
+enum symbol_table_status_t symbol_table_define(struct symbol_table_t* symbol_table, const char* key, const char* val, uint64_t ttl, uint64_t now);
+
+enum symbol_table_status_t symbol_table_update(struct symbol_table_t* symbol_table, const char* key, const char* val, uint64_t ttl, uint64_t now);
+
+enum symbol_table_status_t symbol_table_drop(struct symbol_table_t* symbol_table, const char* key, uint64_t now);
+
+size_t symbol_table_expire(struct symbol_table_t* symbol_table, uint64_t now, size_t budget);
+
+#endif /** PROJECT_INCLUDES_SYMBOL_TABLE_H */
@@ -0,0 +1,137 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_TIMING_WHEEL_H
+#define PROJECT_INCLUDES_TIMING_WHEEL_H
+
+#include "keyvo.h"
+
+/**
+ * @brief Each level of the wheel is indexed by six bits of
+ * the expiration tick, so every level has 64 slots.
+ *
+ */
+#define TIMING_WHEEL_SLOT_BITS 6
+#define TIMING_WHEEL_SLOTS     (1 << TIMING_WHEEL_SLOT_BITS)
+#define TIMING_WHEEL_SLOT_MASK (TIMING_WHEEL_SLOTS - 1)
+
+/**
+ * @brief With one-millisecond ticks, five levels cover
+ * 2^30 ms, or a little over twelve days. Timers further out
+ * than that are parked in the top level and re-filed every
+ * time that level comes around.
+ *
+ */
+#define TIMING_WHEEL_LEVELS    5
+
+/**
+ * @brief This is an intrusive timer node. It is meant to be
+ * embedded in whichever structure needs to expire, so that
+ * scheduling and cancelling a timer never has to allocate.
+ *
+ */
+struct wheel_timer_t {
+    struct wheel_timer_t* next;
+    struct wheel_timer_t* prev;
+    uint64_t expires;
+    uint8_t level;
+    uint8_t slot;
+};
+
+/**
+ * @brief A hierarchical timing wheel, in the style of the
+ * one described by Varghese and Lauck and used by the Linux
+ * kernel.
+ *
+ * @details Scheduling and cancelling are O(1). Advancing
+ * the wheel is done in bounded steps: the caller hands us
+ * a work budget, and if the budget runs out in the middle
+ * of a slot we simply stop and pick up where we left off
+ * the next time around, so that a million keys expiring in
+ * the same millisecond can never stall the event loop.
+ *
+ */
+struct timing_wheel_t {
+    /** The next tick that has not yet been fully processed */
+    uint64_t current;
+
+    /** The number of timers currently scheduled */
+    size_t count;
+
+    /** One bit per non-empty slot, for skipping idle time */
+    uint64_t occupied[TIMING_WHEEL_LEVELS];
+
+    /** Slot list heads; each is a circular sentinel node */
+    struct wheel_timer_t slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+};
+
+/**
+ * @brief Signature of the function called once for every
+ * timer whose expiration tick has been reached. The timer
+ * has already been removed from the wheel when the callback
+ * runs, so the callback is free to release its container.
+ *
+ */
+typedef void (*timer_callback_t)(struct wheel_timer_t* timer, void* context);
+
+/**
+ * @brief Return the current value of the monotonic clock,
+ * in milliseconds. This is the time base of the wheel.
+ *
+ * @return uint64_t
+ */
+static inline uint64_t monotonic_milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000) + ((uint64_t) now.tv_nsec / 1000000);
+}
+
+void timing_wheel_initialize(struct timing_wheel_t* wheel, uint64_t now);
+
+void timer_initialize(struct wheel_timer_t* timer);
+
+/**
+ * @brief Check whether the given timer is currently sitting
+ * in one of the wheel's slots.
+ *
+ * @param timer
+ * @return true
+ * @return false
+ */
+static inline bool timer_pending(const struct wheel_timer_t* timer) {
+    return timer->next != NULL;
+}
+
+void timing_wheel_schedule(struct timing_wheel_t* wheel, struct wheel_timer_t* timer, uint64_t expires);
+
+void timing_wheel_cancel(struct timing_wheel_t* wheel, struct wheel_timer_t* timer);
+
+size_t timing_wheel_advance(struct timing_wheel_t* wheel, uint64_t now, size_t budget, timer_callback_t expire, void* context);
+
+/**
+ * @brief Check whether the last call to advance the wheel
+ * ran out of budget before catching up with the clock.
+ *
+ * @param wheel
+ * @param now
+ * @return true
+ * @return false
+ */
+static inline bool timing_wheel_behind(const struct timing_wheel_t* wheel, uint64_t now) {
+    return (wheel->count != 0) && (wheel->current <= now);
+}
+
+#endif /** PROJECT_INCLUDES_TIMING_WHEEL_H */
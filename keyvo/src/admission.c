@@ -0,0 +1,162 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "admission.h"
+
+/**
+ * @brief The policy the event loop is running under. It
+ * starts out admitting everything.
+ *
+ */
+static struct admission_policy_t admission_policy = { 0, 0, 0 };
+
+/**
+ * @brief How long a single token takes to come back, in
+ * nanoseconds, and how far ahead of the present a client's
+ * bucket may run before it is limited.
+ *
+ */
+static uint64_t token_interval = 0;
+static uint64_t burst_tolerance = 0;
+
+/**
+ * @brief The buckets shared out between datagram clients.
+ *
+ */
+static struct token_bucket_t datagram_buckets[ADMISSION_DATAGRAM_BUCKETS];
+
+/**
+ * @brief Set the policy every subsequent admission decision
+ * is made under. A burst of zero defaults to one second's
+ * worth of requests.
+ *
+ * @param policy
+ */
+void admission_configure(const struct admission_policy_t* policy) {
+    admission_policy = *policy;
+
+    if (admission_policy.rate == 0) {
+        return;
+    }
+
+    if (admission_policy.burst == 0) {
+        admission_policy.burst = admission_policy.rate;
+    }
+
+    token_interval = 1000000000 / admission_policy.rate;
+    burst_tolerance = token_interval * admission_policy.burst;
+}
+
+/**
+ * @brief Check whether clients are being rate limited at
+ * all, so that the server need not work out who a datagram
+ * came from when they are not.
+ *
+ * @return true
+ * @return false
+ */
+bool admission_rate_limited(void) {
+    return admission_policy.rate != 0;
+}
+
+/**
+ * @brief Return the token bucket a datagram client draws
+ * from.
+ *
+ * @param client_id
+ * @return struct token_bucket_t*
+ */
+struct token_bucket_t* admission_datagram_bucket(uint32_t client_id) {
+    return &datagram_buckets[client_id % ADMISSION_DATAGRAM_BUCKETS];
+}
+
+/**
+ * @brief Take cost tokens from a bucket, if it has them. A
+ * cost larger than the whole burst is charged as a full
+ * burst, so that a client can still get a large MGET
+ * through by waiting for its bucket to fill.
+ *
+ * @param bucket
+ * @param cost
+ * @param now
+ * @return false if the client is over its limit.
+ */
+static bool take_tokens(struct token_bucket_t* bucket, uint64_t cost, uint64_t now) {
+    if (cost > admission_policy.burst) {
+        cost = admission_policy.burst;
+    }
+
+    uint64_t full_at = (bucket->full_at > now) ? bucket->full_at : now;
+    uint64_t charged = full_at + (cost * token_interval);
+
+    if (charged > now + burst_tolerance) {
+        return false;
+    }
+
+    bucket->full_at = charged;
+    return true;
+}
+
+/**
+ * @brief Decide whether to execute a command.
+ *
+ * @details Load is shed before any tokens are taken, so a
+ * client is not charged for requests the server could not
+ * get round to. Single-key reads are the cheapest commands
+ * and what well-behaved clients mostly send, so they are
+ * the last to go; writes, which also fan out invalidations
+ * to every subscriber, go first.
+ *
+ * @param bucket The client's token bucket, or NULL if it
+ * is not rate limited.
+ * @param command
+ * @param cost The number of tokens the command costs: one
+ * per key it touches.
+ * @param queue_delay How long, in nanoseconds, the command
+ * waited before the server got round to it.
+ * @param now The current time on the monotonic clock, in
+ * nanoseconds.
+ * @return enum admission_verdict_t
+ */
+enum admission_verdict_t admission_check(struct token_bucket_t* bucket, enum command_id_t command, uint64_t cost, uint64_t queue_delay, uint64_t now) {
+    if (admission_policy.shed_delay != 0) {
+        uint64_t limit = admission_policy.shed_delay;
+
+        switch (command) {
+            case COMMAND_GET:
+            case COMMAND_GETV:
+            case COMMAND_CHECK: {
+                limit *= 4;
+            } break;
+
+            case COMMAND_MGET: {
+                limit *= 2;
+            } break;
+
+            default: {
+            } break;
+        }
+
+        if (queue_delay > limit) {
+            return ADMISSION_SHED;
+        }
+    }
+
+    if ((bucket != NULL) && (admission_policy.rate != 0) && !take_tokens(bucket, cost, now)) {
+        return ADMISSION_RATE_LIMITED;
+    }
+
+    return ADMISSION_ACCEPT;
+}
@@ -0,0 +1,297 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "capture.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * @brief The staging ring is a single-producer, single-
+ * consumer byte queue. The event loop appends records at
+ * the head, and the writer thread writes them out from the
+ * tail. Records are copied in whole or not at all, but may
+ * wrap around the end of the ring.
+ *
+ */
+static char* ring = NULL;
+
+static _Alignas(64) _Atomic uint64_t head = 0;
+static _Alignas(64) _Atomic uint64_t tail = 0;
+
+static _Atomic uint64_t records = 0;
+static _Atomic uint64_t dropped = 0;
+
+uint32_t capture_sample = 0;
+
+/**
+ * @brief Whether the writer thread is running.
+ *
+ */
+static atomic_bool running = false;
+
+static pthread_t writer_thread;
+
+static int capture_file = -1;
+
+/**
+ * @brief The monotonic time the capture began, which record
+ * timestamps are relative to.
+ *
+ */
+static uint64_t started = 0;
+
+/**
+ * @brief Return the current value of the given clock, in
+ * nanoseconds.
+ *
+ * @param clock
+ * @return uint64_t
+ */
+static uint64_t clock_nanoseconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Copy bytes into the ring at the given position,
+ * wrapping around the end if need be.
+ *
+ * @param position
+ * @param data
+ * @param length
+ */
+static void ring_copy(uint64_t position, const void* data, size_t length) {
+    size_t offset = position & (CAPTURE_RING_SIZE - 1);
+    size_t first = CAPTURE_RING_SIZE - offset;
+
+    if (first > length) {
+        first = length;
+    }
+
+    memcpy(ring + offset, data, first);
+    memcpy(ring, (const char*) data + first, length - first);
+}
+
+/**
+ * @brief Add a request to the trace.
+ *
+ * @details This only ever runs on the event loop, and costs
+ * a clock read and a copy. If the ring is too full, or the
+ * payload is too long to record, the request is counted as
+ * dropped instead.
+ *
+ * @param connection
+ * @param transport
+ * @param payload
+ * @param length
+ */
+void capture_request(uint32_t connection, enum capture_transport_t transport, const char* payload, size_t length) {
+    if (ring == NULL) {
+        return;
+    }
+
+    uint64_t position = atomic_load_explicit(&head, memory_order_relaxed);
+    uint64_t free_space = CAPTURE_RING_SIZE - (position - atomic_load_explicit(&tail, memory_order_acquire));
+
+    if ((length > UINT16_MAX) || (sizeof (struct capture_record_t) + length > free_space)) {
+        atomic_store_explicit(&dropped, atomic_load_explicit(&dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+
+    struct capture_record_t record = {
+        .timestamp = clock_nanoseconds(CLOCK_MONOTONIC) - started,
+        .connection = connection,
+        .length = (uint16_t) length,
+        .transport = (uint8_t) transport,
+        .reserved = 0
+    };
+
+    ring_copy(position, &record, sizeof (record));
+    ring_copy(position + sizeof (record), payload, length);
+
+    atomic_store_explicit(&head, position + sizeof (record) + length, memory_order_release);
+    atomic_store_explicit(&records, atomic_load_explicit(&records, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Write out everything currently in the ring.
+ *
+ * @return false if the trace file could not be written to.
+ */
+static bool drain_ring(void) {
+    uint64_t from = atomic_load_explicit(&tail, memory_order_relaxed);
+    uint64_t to = atomic_load_explicit(&head, memory_order_acquire);
+
+    while (from != to) {
+        size_t offset = from & (CAPTURE_RING_SIZE - 1);
+        size_t length = CAPTURE_RING_SIZE - offset;
+
+        if (length > to - from) {
+            length = to - from;
+        }
+
+        ssize_t written = write(capture_file, ring + offset, length);
+
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        from += written;
+        atomic_store_explicit(&tail, from, memory_order_release);
+    }
+
+    return true;
+}
+
+/**
+ * @brief This is the writer thread's main loop. It keeps
+ * the ring drained until it is told to stop, and then
+ * drains it one last time.
+ *
+ * @details Should the trace file stop accepting writes, the
+ * writer gives up, and from then on every request is
+ * counted as dropped once the ring fills up.
+ *
+ * @param argument
+ * @return void*
+ */
+static void* writer_loop(void* argument) {
+    (void) argument;
+
+    const struct timespec interval = { 0, CAPTURE_DRAIN_INTERVAL * 1000 };
+
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        uint64_t before = atomic_load_explicit(&tail, memory_order_relaxed);
+
+        if (!drain_ring()) {
+            keyvo_log(LOG_ERR, "Error writing the traffic capture: %m");
+            return NULL;
+        }
+
+        if (atomic_load_explicit(&tail, memory_order_relaxed) == before) {
+            nanosleep(&interval, NULL);
+        }
+    }
+
+    if (!drain_ring()) {
+        keyvo_log(LOG_ERR, "Error writing the traffic capture: %m");
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start capturing requests to the given file, which
+ * is replaced if it already exists.
+ *
+ * @details Like the logger, this has to wait until after
+ * daemonize(). If anything goes wrong, the server carries
+ * on without capturing, and says so.
+ *
+ * @param filename
+ * @param sample Capture one in this many clients.
+ */
+void start_capture(const char* filename, uint32_t sample) {
+    capture_file = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+
+    if (capture_file == -1) {
+        keyvo_log(LOG_ERR, "Could not open capture file %s: %m", filename);
+        return;
+    }
+
+    struct capture_file_header_t header = {
+        .version = CAPTURE_FORMAT_VERSION,
+        .sample = sample,
+        .started = clock_nanoseconds(CLOCK_REALTIME)
+    };
+
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof (header.magic));
+
+    if (write(capture_file, &header, sizeof (header)) != (ssize_t) sizeof (header)) {
+        keyvo_log(LOG_ERR, "Could not write capture file %s: %m", filename);
+        close(capture_file);
+        return;
+    }
+
+    if ((ring = malloc(CAPTURE_RING_SIZE)) == NULL) {
+        keyvo_log(LOG_ERR, "%s", "Memory-allocation failure; not capturing traffic.");
+        close(capture_file);
+        return;
+    }
+
+    started = clock_nanoseconds(CLOCK_MONOTONIC);
+    atomic_store_explicit(&running, true, memory_order_release);
+
+    if (pthread_create(&writer_thread, NULL, writer_loop, NULL) != 0) {
+        atomic_store_explicit(&running, false, memory_order_release);
+        keyvo_log(LOG_ERR, "%s", "Could not start the capture thread; not capturing traffic.");
+        free(ring);
+        ring = NULL;
+        close(capture_file);
+        return;
+    }
+
+    capture_sample = sample;
+
+    if (atexit(stop_capture) != 0) {
+        keyvo_log(LOG_WARNING, "%s", "Failed to register the capture shutdown callback.");
+    }
+
+    keyvo_log(LOG_DEBUG, "Capturing one in %u clients to %s", sample, filename);
+}
+
+/**
+ * @brief Stop capturing, once everything captured so far
+ * has been written out.
+ *
+ */
+void stop_capture(void) {
+    capture_sample = 0;
+
+    if (!atomic_exchange_explicit(&running, false, memory_order_acq_rel)) {
+        return;
+    }
+
+    pthread_join(writer_thread, NULL);
+
+    close(capture_file);
+    capture_file = -1;
+}
+
+/**
+ * @brief Return the number of requests added to the trace.
+ *
+ * @return uint64_t
+ */
+uint64_t capture_records_written(void) {
+    return atomic_load_explicit(&records, memory_order_relaxed);
+}
+
+/**
+ * @brief Return the number of sampled requests left out of
+ * the trace because the writer could not keep up.
+ *
+ * @return uint64_t
+ */
+uint64_t capture_records_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
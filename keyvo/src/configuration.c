@@ -0,0 +1,96 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "configuration.h"
+
+/**
+ * @brief Load the key-value pairs in a configuration file
+ * into the symbol table.
+ *
+ * @details The file holds one pair per line, written either
+ * as "key value" or as "key = value". Blank lines and lines
+ * starting with a '#' are ignored. Like values sent over the
+ * wire, values are a single whitespace-delimited word. If a
+ * key appears more than once, the last definition wins.
+ *
+ * Not being able to read the file is fatal, since the
+ * server would otherwise come up serving nothing. Lines
+ * that cannot be parsed are logged and skipped.
+ *
+ * @param symbol_table
+ * @param filename
+ * @return The number of pairs loaded.
+ */
+size_t load_configuration(struct symbol_table_t* symbol_table, const char* filename) {
+    FILE* file = fopen(filename, "r");
+
+    if (file == NULL) {
+        keyvo_log(LOG_ERR, "Could not open configuration file %s: %m", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    char* line = NULL;
+    size_t line_capacity = 0;
+    size_t line_number = 0;
+    size_t loaded = 0;
+    uint64_t now = monotonic_milliseconds();
+
+    while (getline(&line, &line_capacity, file) != -1) {
+        ++line_number;
+
+        char* saveptr = NULL;
+        char* key = strtok_r(line, " \t\r\n", &saveptr);
+
+        if ((key == NULL) || (*key == '#')) {
+            continue;
+        }
+
+        char* val = strtok_r(NULL, " \t\r\n", &saveptr);
+
+        if ((val != NULL) && (strcmp(val, "=") == 0)) {
+            val = strtok_r(NULL, " \t\r\n", &saveptr);
+        }
+
+        if ((val == NULL) || (strtok_r(NULL, " \t\r\n", &saveptr) != NULL)) {
+            keyvo_log(LOG_WARNING, "Skipping malformed line %zu of the configuration file.", line_number);
+            continue;
+        }
+
+        enum symbol_table_status_t status = symbol_table_define(symbol_table, key, val, SYMBOL_TABLE_NO_TTL, now);
+
+        if (status == SYMBOL_TABLE_EXISTS) {
+            status = symbol_table_update(symbol_table, key, val, SYMBOL_TABLE_NO_TTL, now);
+        }
+
+        if (status == SYMBOL_TABLE_TOO_LARGE) {
+            keyvo_log(LOG_WARNING, "Skipping line %zu of the configuration file: the pair does not fit in the memory budget.", line_number);
+            continue;
+        }
+
+        ++loaded;
+    }
+
+    if (ferror(file)) {
+        keyvo_log(LOG_ERR, "Could not read configuration file %s: %m", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    free(line);
+    fclose(file);
+
+    keyvo_log(LOG_DEBUG, "Loaded %zu pairs from %s", loaded, filename);
+
+    return loaded;
+}
@@ -0,0 +1,149 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "connection.h"
+
+/**
+ * @brief Set up the state for a freshly-accepted client.
+ * The socket is switched to non-blocking mode, so a slow
+ * client can never stall the event loop.
+ *
+ * @param socket
+ * @return The new connection, or NULL if it could not be
+ * allocated, in which case the socket is closed.
+ */
+struct connection_t* connection_open(int socket) {
+    struct connection_t* connection = malloc(sizeof (struct connection_t));
+
+    if (connection == NULL) {
+        keyvo_log(LOG_WARNING, "Memory-allocation failure; refusing connection.");
+        close(socket);
+        return NULL;
+    }
+
+    int flags = fcntl(socket, F_GETFL, 0);
+    fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+
+    connection->socket = socket;
+    connection->id = 0;
+    connection->transport = 0;
+    connection->captured = false;
+    connection->input_length = 0;
+    connection->backlogged = false;
+    connection->arrived = 0;
+    connection->readable = 0;
+    connection->bucket.full_at = 0;
+    connection->output = NULL;
+    connection->output_length = 0;
+    connection->output_sent = 0;
+    connection->output_capacity = 0;
+    connection->subscribed = false;
+    connection->failed = false;
+
+    return connection;
+}
+
+/**
+ * @brief Close the client's socket and release its state.
+ *
+ * @param connection
+ */
+void connection_close(struct connection_t* connection) {
+    close(connection->socket);
+    free(connection->output);
+    free(connection);
+}
+
+/**
+ * @brief Queue reply data to be written to the client.
+ *
+ * @details Data that has already been sent is discarded
+ * first, so the buffer only grows when the client really
+ * is falling behind.
+ *
+ * @param connection
+ * @param data
+ * @param length
+ * @return false if the client has fallen too far behind,
+ * or the buffer could not be grown.
+ */
+bool connection_append_output(struct connection_t* connection, const char* data, size_t length) {
+    if (connection->output_sent == connection->output_length) {
+        connection->output_sent = 0;
+        connection->output_length = 0;
+    }
+
+    size_t pending = connection->output_length - connection->output_sent;
+
+    if (pending + length > CONNECTION_OUTPUT_LIMIT) {
+        return false;
+    }
+
+    if (connection->output_length + length > connection->output_capacity) {
+        if (connection->output_sent != 0) {
+            memmove(connection->output, connection->output + connection->output_sent, pending);
+            connection->output_sent = 0;
+            connection->output_length = pending;
+        }
+
+        size_t capacity = connection->output_capacity ? connection->output_capacity : 4096;
+
+        while (capacity < connection->output_length + length) {
+            capacity *= 2;
+        }
+
+        if (capacity != connection->output_capacity) {
+            char* output = realloc(connection->output, capacity);
+
+            if (output == NULL) {
+                return false;
+            }
+
+            connection->output = output;
+            connection->output_capacity = capacity;
+        }
+    }
+
+    memcpy(connection->output + connection->output_length, data, length);
+    connection->output_length += length;
+
+    return true;
+}
+
+/**
+ * @brief Write as much of the queued reply data as the
+ * client will currently accept.
+ *
+ * @param connection
+ * @return false if the connection has failed and should be
+ * closed.
+ */
+bool connection_flush(struct connection_t* connection) {
+    while (connection_pending_output(connection)) {
+        ssize_t sent = send(connection->socket, connection->output + connection->output_sent, connection->output_length - connection->output_sent, MSG_NOSIGNAL);
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+        }
+
+        connection->output_sent += sent;
+    }
+
+    return true;
+}
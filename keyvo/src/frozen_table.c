@@ -0,0 +1,459 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "frozen_table.h"
+
+/**
+ * @brief A key being placed while the table is built.
+ *
+ */
+struct frozen_key_t {
+    const struct key_val_t* key_val;
+    size_t key_length;
+    uint64_t hash;
+    uint32_t slot;
+};
+
+/**
+ * @brief The scratch space used while searching for seeds.
+ *
+ */
+struct frozen_build_t {
+    struct frozen_key_t* keys;
+    size_t count;
+    size_t bucket_count;
+    size_t slot_count;
+
+    /** Key indices, grouped by bucket */
+    size_t* members;
+
+    /** Where each bucket's group starts in members */
+    size_t* bucket_start;
+
+    /** Bucket indices, largest bucket first */
+    size_t* bucket_order;
+
+    /** One bit per slot, set once the slot is claimed */
+    uint64_t* taken;
+
+    uint32_t* seeds;
+};
+
+/**
+ * @brief The MurmurHash3 finalizer. FNV-1a alone does not
+ * mix its high bits well enough to derive both a bucket
+ * and a slot from a single hash.
+ *
+ * @param x
+ * @return uint64_t
+ */
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= UINT64_C(0xFF51AFD7ED558CCD);
+    x ^= x >> 33;
+    x *= UINT64_C(0xC4CEB9FE1A85EC53);
+    x ^= x >> 33;
+
+    return x;
+}
+
+/**
+ * @brief Hash a key with the table's salt, measuring its
+ * length along the way.
+ *
+ * @param key
+ * @param salt
+ * @param length
+ * @return uint64_t
+ */
+static inline uint64_t frozen_hash(const char* key, uint64_t salt, size_t* length) {
+    uint64_t hash = UINT64_C(14695981039346656037) ^ salt;
+    const unsigned char* c = (const unsigned char*) key;
+
+    for (; *c; ++c) {
+        hash ^= *c;
+        hash *= UINT64_C(1099511628211);
+    }
+
+    *length = (size_t) (c - (const unsigned char*) key);
+
+    return mix(hash);
+}
+
+/**
+ * @brief Displace a hash onto a slot.
+ *
+ * @param hash
+ * @param seed
+ * @param count
+ * @return size_t
+ */
+static inline size_t slot_of(uint64_t hash, uint32_t seed, size_t count) {
+    return mix(hash ^ ((uint64_t) seed * UINT64_C(0x9E3779B97F4A7C15))) % count;
+}
+
+/**
+ * @brief Allocate scratch memory for the build, bailing out
+ * of the process entirely if the allocation fails.
+ *
+ * @param count
+ * @param size
+ * @return void*
+ */
+static void* allocate(size_t count, size_t size) {
+    void* memory = calloc(count ? count : 1, size);
+
+    if (memory == NULL) {
+        keyvo_log(LOG_ERR, "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    return memory;
+}
+
+/**
+ * @brief Group the keys by bucket, and order the buckets
+ * from largest to smallest, so that the hardest buckets to
+ * place are placed while the most slots are still free.
+ *
+ * @param build
+ */
+static void sort_buckets(struct frozen_build_t* build) {
+    size_t* bucket_start = build->bucket_start;
+    size_t bucket_count = build->bucket_count;
+
+    memset(bucket_start, 0, (bucket_count + 1) * sizeof (size_t));
+
+    for (size_t i = 0; i < build->count; ++i) {
+        bucket_start[(build->keys[i].hash % bucket_count) + 1] += 1;
+    }
+
+    size_t largest = 0;
+
+    for (size_t b = 0; b < bucket_count; ++b) {
+        if (bucket_start[b + 1] > largest) {
+            largest = bucket_start[b + 1];
+        }
+
+        bucket_start[b + 1] += bucket_start[b];
+    }
+
+    size_t* fill = allocate(bucket_count, sizeof (size_t));
+    memcpy(fill, bucket_start, bucket_count * sizeof (size_t));
+
+    for (size_t i = 0; i < build->count; ++i) {
+        build->members[fill[build->keys[i].hash % bucket_count]++] = i;
+    }
+
+    size_t* by_size = allocate(largest + 2, sizeof (size_t));
+
+    for (size_t b = 0; b < bucket_count; ++b) {
+        by_size[largest - (bucket_start[b + 1] - bucket_start[b]) + 1] += 1;
+    }
+
+    for (size_t s = 0; s <= largest; ++s) {
+        by_size[s + 1] += by_size[s];
+    }
+
+    for (size_t b = 0; b < bucket_count; ++b) {
+        build->bucket_order[by_size[largest - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+
+    free(by_size);
+    free(fill);
+}
+
+/**
+ * @brief Search for a seed that sends every key in a bucket
+ * to a distinct free slot, and claim those slots.
+ *
+ * @param build
+ * @param bucket
+ * @return false if no seed up to FROZEN_MAXIMUM_SEED works.
+ */
+static bool place_bucket(struct frozen_build_t* build, size_t bucket) {
+    size_t first = build->bucket_start[bucket];
+    size_t last = build->bucket_start[bucket + 1];
+
+    for (uint32_t seed = 0; seed < FROZEN_MAXIMUM_SEED; ++seed) {
+        size_t placed = first;
+
+        for (; placed < last; ++placed) {
+            struct frozen_key_t* key = &build->keys[build->members[placed]];
+            size_t slot = slot_of(key->hash, seed, build->slot_count);
+
+            if (build->taken[slot / 64] & (UINT64_C(1) << (slot % 64))) {
+                break;
+            }
+
+            size_t other = first;
+
+            while ((other < placed) && (build->keys[build->members[other]].slot != slot)) {
+                ++other;
+            }
+
+            if (other != placed) {
+                break;
+            }
+
+            key->slot = (uint32_t) slot;
+        }
+
+        if (placed == last) {
+            for (size_t i = first; i < last; ++i) {
+                uint32_t slot = build->keys[build->members[i]].slot;
+                build->taken[slot / 64] |= UINT64_C(1) << (slot % 64);
+            }
+
+            build->seeds[bucket] = seed;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Try to build the perfect hash function with the
+ * given salt.
+ *
+ * @param build
+ * @param salt
+ * @return true
+ * @return false
+ */
+static bool place_keys(struct frozen_build_t* build, uint64_t salt) {
+    for (size_t i = 0; i < build->count; ++i) {
+        struct frozen_key_t* key = &build->keys[i];
+        key->hash = frozen_hash(key->key_val->key, salt, &key->key_length);
+    }
+
+    sort_buckets(build);
+
+    memset(build->taken, 0, ((build->slot_count + 63) / 64) * sizeof (uint64_t));
+
+    for (size_t b = 0; b < build->bucket_count; ++b) {
+        if (!place_bucket(build, build->bucket_order[b])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Free the build's scratch space.
+ *
+ * @param build
+ */
+static void release_build(struct frozen_build_t* build) {
+    free(build->keys);
+    free(build->members);
+    free(build->bucket_start);
+    free(build->bucket_order);
+    free(build->taken);
+    free(build->seeds);
+}
+
+/**
+ * @brief Return the space an entry takes up in the blob.
+ *
+ * @param key
+ * @return size_t
+ */
+static inline size_t entry_size(const struct frozen_key_t* key) {
+    size_t size = sizeof (uint32_t) + key->key_length + 1 + strlen(key->key_val->val) + 1;
+
+    return (size + 3) & ~(size_t) 3;
+}
+
+/**
+ * @brief Build a frozen table holding every key in the
+ * symbol table.
+ *
+ * @details Building the perfect hash function takes
+ * expected linear time. In the unlikely event that some
+ * bucket cannot be placed, the build starts over with a
+ * different salt. Once the blob has been filled in, it is
+ * made read-only, so nothing can scribble over it.
+ *
+ * @param frozen_table
+ * @param symbol_table
+ * @return false if the table could not be built.
+ */
+bool frozen_table_build(struct frozen_table_t* frozen_table, const struct symbol_table_t* symbol_table) {
+    struct frozen_build_t build;
+
+    build.count = symbol_table->count;
+    build.bucket_count = (build.count + FROZEN_BUCKET_LOAD - 1) / FROZEN_BUCKET_LOAD;
+
+    if (build.bucket_count == 0) {
+        build.bucket_count = 1;
+    }
+
+    build.slot_count = ((build.count * 100) + FROZEN_LOAD_PERCENT - 1) / FROZEN_LOAD_PERCENT;
+
+    if (build.slot_count == 0) {
+        build.slot_count = 1;
+    }
+
+    build.keys = allocate(build.count, sizeof (struct frozen_key_t));
+    build.members = allocate(build.count, sizeof (size_t));
+    build.bucket_start = allocate(build.bucket_count + 1, sizeof (size_t));
+    build.bucket_order = allocate(build.bucket_count, sizeof (size_t));
+    build.taken = allocate((build.slot_count + 63) / 64, sizeof (uint64_t));
+    build.seeds = allocate(build.bucket_count, sizeof (uint32_t));
+
+    size_t k = 0;
+
+    for (size_t b = 0; b < symbol_table->bucket_count; ++b) {
+        for (const struct key_val_t* key_val = symbol_table->buckets[b]; key_val; key_val = key_val->next) {
+            build.keys[k++].key_val = key_val;
+        }
+    }
+
+    uint64_t salt = 0;
+    bool placed = false;
+
+    for (size_t attempt = 0; !placed && (attempt < FROZEN_MAXIMUM_ATTEMPTS); ++attempt) {
+        salt = mix(attempt + 1);
+        placed = place_keys(&build, salt);
+    }
+
+    size_t header_size = (build.bucket_count + build.slot_count) * sizeof (uint32_t);
+    size_t entries_size = 0;
+
+    for (size_t i = 0; i < build.count; ++i) {
+        entries_size += entry_size(&build.keys[i]);
+    }
+
+    if (!placed || (entries_size > UINT32_MAX) || (build.slot_count > UINT32_MAX)) {
+        keyvo_log(LOG_ERR, "Could not build the frozen table over %zu keys.", build.count);
+
+        release_build(&build);
+
+        return false;
+    }
+
+    frozen_table->blob_size = header_size + entries_size;
+    frozen_table->blob = huge_pages_map(frozen_table->blob_size);
+
+    if (frozen_table->blob == NULL) {
+        keyvo_log(LOG_ERR, "Could not map the frozen table: %m");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t* seeds = (uint32_t*) frozen_table->blob;
+    uint32_t* offsets = seeds + build.bucket_count;
+    char* entries = frozen_table->blob + header_size;
+
+    memcpy(seeds, build.seeds, build.bucket_count * sizeof (uint32_t));
+
+    /**
+     * @brief Lay the entries out in slot order, so that a
+     * scan of the table walks the blob front to back. The
+     * spare slots are left pointing at the first entry.
+     *
+     */
+    size_t* by_slot = allocate(build.slot_count, sizeof (size_t));
+
+    for (size_t i = 0; i < build.count; ++i) {
+        by_slot[build.keys[i].slot] = i + 1;
+    }
+
+    size_t offset = 0;
+
+    for (size_t slot = 0; slot < build.slot_count; ++slot) {
+        if (by_slot[slot] == 0) {
+            offsets[slot] = 0;
+            continue;
+        }
+
+        const struct frozen_key_t* key = &build.keys[by_slot[slot] - 1];
+        uint32_t key_length = (uint32_t) key->key_length;
+        char* entry = entries + offset;
+
+        memcpy(entry, &key_length, sizeof (uint32_t));
+        memcpy(entry + sizeof (uint32_t), key->key_val->key, key->key_length + 1);
+        strcpy(entry + sizeof (uint32_t) + key->key_length + 1, key->key_val->val);
+
+        offsets[slot] = (uint32_t) offset;
+        offset += entry_size(key);
+    }
+
+    free(by_slot);
+
+    mprotect(frozen_table->blob, huge_pages_mapping_size(frozen_table->blob_size), PROT_READ);
+
+    frozen_table->seeds = seeds;
+    frozen_table->offsets = offsets;
+    frozen_table->entries = entries;
+    frozen_table->bucket_count = build.bucket_count;
+    frozen_table->slot_count = build.slot_count;
+    frozen_table->count = build.count;
+    frozen_table->salt = salt;
+    frozen_table->hits = 0;
+    frozen_table->misses = 0;
+
+    release_build(&build);
+
+    keyvo_log(LOG_DEBUG, "Froze %zu keys into %zu bytes (the mutable table used %zu).", frozen_table->count, frozen_table->blob_size, symbol_table->memory_used);
+
+    return true;
+}
+
+/**
+ * @brief Release the frozen table's memory.
+ *
+ * @param frozen_table
+ */
+void frozen_table_destroy(struct frozen_table_t* frozen_table) {
+    huge_pages_unmap(frozen_table->blob, frozen_table->blob_size);
+    memset(frozen_table, 0, sizeof (struct frozen_table_t));
+}
+
+/**
+ * @brief Look up a key. The perfect hash function sends
+ * every key in the table to its own slot, so one probe and
+ * one comparison decide the matter.
+ *
+ * @param frozen_table
+ * @param key
+ * @return The value, or NULL if the key is not in the
+ * table.
+ */
+const char* frozen_table_lookup(struct frozen_table_t* frozen_table, const char* key) {
+    if (frozen_table->count == 0) {
+        ++frozen_table->misses;
+        return NULL;
+    }
+
+    size_t length = 0;
+    uint64_t hash = frozen_hash(key, frozen_table->salt, &length);
+    uint32_t seed = frozen_table->seeds[hash % frozen_table->bucket_count];
+    const char* entry = frozen_table->entries + frozen_table->offsets[slot_of(hash, seed, frozen_table->slot_count)];
+
+    uint32_t key_length = 0;
+    memcpy(&key_length, entry, sizeof (uint32_t));
+
+    if ((key_length != length) || (memcmp(entry + sizeof (uint32_t), key, length) != 0)) {
+        ++frozen_table->misses;
+        return NULL;
+    }
+
+    ++frozen_table->hits;
+
+    return entry + sizeof (uint32_t) + length + 1;
+}
@@ -0,0 +1,274 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "huge_pages.h"
+
+bool huge_pages_enabled = false;
+
+/**
+ * @brief The number of huge-page mappings made, and how
+ * many of them could not get pages from the reserved pool.
+ *
+ */
+static uint64_t mappings = 0;
+static uint64_t fallbacks = 0;
+
+/**
+ * @brief Return the length a mapping of the given size
+ * really takes up. Mappings that are big enough to be worth
+ * it are rounded up to a whole number of huge pages, and
+ * everything else to a whole number of ordinary ones.
+ *
+ * @param size
+ * @return size_t
+ */
+size_t huge_pages_mapping_size(size_t size) {
+    size_t page = (huge_pages_enabled && (size >= HUGE_PAGE_SIZE)) ? HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+
+    if (size == 0) {
+        size = 1;
+    }
+
+    return (size + page - 1) & ~(page - 1);
+}
+
+/**
+ * @brief Map a zero-filled, page-aligned region of memory.
+ *
+ * @details With huge pages enabled, regions of at least one
+ * huge page come from the reserved hugetlbfs pool if it has
+ * room. Otherwise they are mapped normally, aligned to a
+ * huge-page boundary, and advised for transparent huge
+ * pages, which the kernel will use if it can.
+ *
+ * @param size
+ * @return The region, or NULL if it could not be mapped.
+ */
+void* huge_pages_map(size_t size) {
+    size_t length = huge_pages_mapping_size(size);
+
+    if (!huge_pages_enabled || (length < HUGE_PAGE_SIZE)) {
+        void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        return (memory == MAP_FAILED) ? NULL : memory;
+    }
+
+    ++mappings;
+
+    void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (memory != MAP_FAILED) {
+        return memory;
+    }
+
+    ++fallbacks;
+
+    /**
+     * @brief Map an extra huge page's worth, so that the
+     * region can be trimmed down to start on a huge-page
+     * boundary. THP can only back aligned 2 MB extents.
+     *
+     */
+    char* raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    char* aligned = (char*) (((uintptr_t) raw + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1));
+    size_t head = aligned - raw;
+
+    if (head != 0) {
+        munmap(raw, head);
+    }
+
+    if (head != HUGE_PAGE_SIZE) {
+        munmap(aligned + length, HUGE_PAGE_SIZE - head);
+    }
+
+    madvise(aligned, length, MADV_HUGEPAGE);
+
+    return aligned;
+}
+
+/**
+ * @brief Unmap a region returned by huge_pages_map().
+ *
+ * @param memory
+ * @param size The size it was mapped with.
+ */
+void huge_pages_unmap(void* memory, size_t size) {
+    munmap(memory, huge_pages_mapping_size(size));
+}
+
+/**
+ * @brief Allocate a zero-filled array. Arrays of at least
+ * one huge page are mapped with huge_pages_map() when huge
+ * pages are enabled; everything else comes from calloc().
+ *
+ * @param size
+ * @return The array, or NULL if it could not be allocated.
+ */
+void* huge_pages_allocate(size_t size) {
+    if (!huge_pages_enabled || (size < HUGE_PAGE_SIZE)) {
+        return calloc(1, size);
+    }
+
+    return huge_pages_map(size);
+}
+
+/**
+ * @brief Release an array returned by huge_pages_allocate().
+ *
+ * @param memory
+ * @param size The size it was allocated with.
+ */
+void huge_pages_release(void* memory, size_t size) {
+    if (!huge_pages_enabled || (size < HUGE_PAGE_SIZE)) {
+        free(memory);
+        return;
+    }
+
+    if (memory) {
+        huge_pages_unmap(memory, size);
+    }
+}
+
+/**
+ * @brief Report how much of the process really is on huge
+ * pages, as the kernel sees it, along with our own counts.
+ *
+ * @details The byte counts come from /proc/self/smaps_rollup,
+ * so they include transparent huge pages the kernel chose
+ * to use on its own, and exclude any we asked for but did
+ * not get.
+ *
+ * @param stats
+ */
+void huge_pages_statistics(struct huge_page_stats_t* stats) {
+    memset(stats, 0, sizeof (struct huge_page_stats_t));
+
+    stats->mappings = mappings;
+    stats->fallbacks = fallbacks;
+
+    FILE* smaps = fopen("/proc/self/smaps_rollup", "r");
+
+    if (smaps == NULL) {
+        return;
+    }
+
+    char line[256];
+    unsigned long long kilobytes = 0;
+
+    while (fgets(line, sizeof (line), smaps)) {
+        if (sscanf(line, "AnonHugePages: %llu kB", &kilobytes) == 1) {
+            stats->transparent_bytes = kilobytes * 1024;
+        } else if (sscanf(line, "Private_Hugetlb: %llu kB", &kilobytes) == 1) {
+            stats->reserved_bytes = kilobytes * 1024;
+        }
+    }
+
+    fclose(smaps);
+}
+
+/**
+ * @brief Set up an empty pool of objects of the given size.
+ *
+ * @param pool
+ * @param object_size
+ */
+void object_pool_initialize(struct object_pool_t* pool, size_t object_size) {
+    size_t alignment = _Alignof (max_align_t);
+
+    pool->object_size = (object_size + alignment - 1) & ~(alignment - 1);
+    pool->free_list = NULL;
+    pool->chunk = NULL;
+    pool->chunk_used = 0;
+    pool->chunks = NULL;
+    pool->chunk_count = 0;
+}
+
+/**
+ * @brief Take an object from the pool. Its contents are
+ * undefined, just as with malloc().
+ *
+ * @param pool
+ * @return The object, or NULL if the pool could not grow.
+ */
+void* object_pool_allocate(struct object_pool_t* pool) {
+    if (!huge_pages_enabled) {
+        return malloc(pool->object_size);
+    }
+
+    if (pool->free_list) {
+        void* object = pool->free_list;
+        pool->free_list = *(void**) object;
+
+        return object;
+    }
+
+    if ((pool->chunk == NULL) || (pool->chunk_used + pool->object_size > HUGE_PAGE_SIZE)) {
+        char** chunks = realloc(pool->chunks, (pool->chunk_count + 1) * sizeof (char*));
+
+        if (chunks == NULL) {
+            return NULL;
+        }
+
+        pool->chunks = chunks;
+
+        if ((pool->chunk = huge_pages_map(HUGE_PAGE_SIZE)) == NULL) {
+            return NULL;
+        }
+
+        pool->chunks[pool->chunk_count++] = pool->chunk;
+        pool->chunk_used = 0;
+    }
+
+    void* object = pool->chunk + pool->chunk_used;
+    pool->chunk_used += pool->object_size;
+
+    return object;
+}
+
+/**
+ * @brief Give an object back to the pool.
+ *
+ * @param pool
+ * @param object
+ */
+void object_pool_release(struct object_pool_t* pool, void* object) {
+    if (!huge_pages_enabled) {
+        free(object);
+        return;
+    }
+
+    *(void**) object = pool->free_list;
+    pool->free_list = object;
+}
+
+/**
+ * @brief Return every chunk the pool has mapped. Any object
+ * still handed out becomes invalid.
+ *
+ * @param pool
+ */
+void object_pool_destroy(struct object_pool_t* pool) {
+    for (size_t i = 0; i < pool->chunk_count; ++i) {
+        huge_pages_unmap(pool->chunks[i], HUGE_PAGE_SIZE);
+    }
+
+    free(pool->chunks);
+    object_pool_initialize(pool, pool->object_size);
+}
@@ -0,0 +1,556 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "log.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * @brief This is what actually goes into the ring: a fixed-
+ * size, two-cache-line record holding the format pointer
+ * and the raw argument values, rather than formatted text.
+ *
+ */
+struct log_record_t {
+    uint64_t timestamp;
+    const char* format;
+    int saved_errno;
+    uint8_t priority;
+    uint8_t argc;
+    uint8_t types[LOG_RECORD_ARGUMENTS];
+
+    union {
+        long long s;
+        unsigned long long u;
+        double d;
+        size_t offset;
+        const void* pointer;
+    } values[LOG_RECORD_ARGUMENTS];
+
+    char text[LOG_RECORD_TEXT];
+};
+
+_Static_assert(sizeof (struct log_record_t) == 128, "log records should be exactly two cache lines");
+
+/**
+ * @brief Every thread that logs gets its own single-
+ * producer, single-consumer ring, so producers never
+ * contend with each other. The head is only written by the
+ * owning thread and the tail only by the background thread,
+ * and each lives on its own cache line.
+ *
+ */
+struct log_ring_t {
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint64_t dropped;
+
+    _Alignas(64) _Atomic uint64_t tail;
+    uint64_t dropped_reported;
+
+    struct log_ring_t* next;
+
+    struct log_record_t records[LOG_RING_SIZE];
+};
+
+/**
+ * @brief The list of every thread's ring. Rings are pushed
+ * onto the front and never removed, so the background
+ * thread can walk the list without taking a lock.
+ *
+ */
+static _Atomic(struct log_ring_t*) rings = NULL;
+
+/**
+ * @brief The calling thread's ring, created the first time
+ * the thread logs anything.
+ *
+ */
+static _Thread_local struct log_ring_t* thread_ring = NULL;
+
+/**
+ * @brief Whether the background thread is currently
+ * draining the rings. When it is not, log_event() formats
+ * and writes the message synchronously instead.
+ *
+ */
+static atomic_bool running = false;
+
+static pthread_t drain_thread;
+
+/**
+ * @brief The file records are written to, or NULL to send
+ * them to the system log.
+ *
+ */
+static FILE* log_file = NULL;
+
+/**
+ * @brief Allocate a ring for the calling thread and link it
+ * into the list the background thread drains.
+ *
+ * @return struct log_ring_t*
+ */
+static struct log_ring_t* register_ring(void) {
+    struct log_ring_t* ring = aligned_alloc(64, sizeof (struct log_ring_t));
+
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->tail, 0);
+    ring->dropped_reported = 0;
+
+    ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(&rings, &ring->next, ring, memory_order_release, memory_order_relaxed)) {
+        ;
+    }
+
+    return ring;
+}
+
+/**
+ * @brief Capture the arguments of a log call into a record,
+ * copying any strings into the record's own text area.
+ *
+ * @param record
+ * @param argc
+ * @param argv
+ */
+static void capture_arguments(struct log_record_t* record, unsigned int argc, const struct log_argument_t* argv) {
+    size_t used = 0;
+
+    if (argc > LOG_RECORD_ARGUMENTS) {
+        argc = LOG_RECORD_ARGUMENTS;
+    }
+
+    record->argc = argc;
+
+    for (unsigned int i = 0; i < argc; ++i) {
+        record->types[i] = argv[i].type;
+
+        switch (argv[i].type) {
+            case LOG_ARGUMENT_SIGNED: {
+                record->values[i].s = argv[i].value.s;
+            } break;
+
+            case LOG_ARGUMENT_UNSIGNED: {
+                record->values[i].u = argv[i].value.u;
+            } break;
+
+            case LOG_ARGUMENT_DOUBLE: {
+                record->values[i].d = argv[i].value.d;
+            } break;
+
+            case LOG_ARGUMENT_STRING: {
+                const char* string = argv[i].value.string ? argv[i].value.string : "(null)";
+                size_t length = strnlen(string, LOG_RECORD_TEXT);
+
+                if (used + length + 1 > LOG_RECORD_TEXT) {
+                    length = (used < LOG_RECORD_TEXT) ? LOG_RECORD_TEXT - used - 1 : 0;
+                }
+
+                if (used < LOG_RECORD_TEXT) {
+                    memcpy(record->text + used, string, length);
+                    record->text[used + length] = '\0';
+                    record->values[i].offset = used;
+                    used += length + 1;
+                } else {
+                    record->values[i].offset = LOG_RECORD_TEXT - 1;
+                }
+            } break;
+
+            default: {
+                record->values[i].pointer = argv[i].value.pointer;
+            } break;
+        }
+    }
+}
+
+/**
+ * @brief Render a record into a human-readable message.
+ *
+ * @details We walk the format string ourselves, and hand
+ * each conversion to snprintf() one at a time along with
+ * its captured argument. Length modifiers in the format are
+ * ignored, since we already know the real width of every
+ * argument, and they are rewritten to match it.
+ *
+ * @param record
+ * @param buffer
+ * @param capacity
+ */
+static void format_record(const struct log_record_t* record, char* buffer, size_t capacity) {
+    size_t length = 0;
+    unsigned int arg = 0;
+
+    for (const char* c = record->format; *c && (length + 1 < capacity); ++c) {
+        if (*c != '%') {
+            buffer[length++] = *c;
+            continue;
+        }
+
+        if (c[1] == '%') {
+            buffer[length++] = '%';
+            ++c;
+            continue;
+        }
+
+        /**
+         * @brief Copy the flags, width and precision, skip
+         * the length modifiers, and find the conversion.
+         *
+         */
+        char spec[32] = "%";
+        size_t spec_length = 1;
+
+        ++c;
+
+        while (*c && strchr("-+ #0123456789.", *c) && (spec_length < sizeof (spec) - 4)) {
+            spec[spec_length++] = *c++;
+        }
+
+        while (*c && strchr("hlLqjzt", *c)) {
+            ++c;
+        }
+
+        if (*c == '\0') {
+            break;
+        }
+
+        char conversion = *c;
+        int written = 0;
+        char* out = buffer + length;
+        size_t room = capacity - length;
+
+        if (conversion == 'm') {
+            char error[128];
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            written = snprintf(out, room, spec, strerror_r(record->saved_errno, error, sizeof (error)));
+        } else if (arg >= record->argc) {
+            written = snprintf(out, room, "%s", "(missing)");
+        } else {
+            uint8_t type = record->types[arg];
+            const char* string = (type == LOG_ARGUMENT_STRING) ? record->text + record->values[arg].offset : "(?)";
+            long long s = (type == LOG_ARGUMENT_DOUBLE) ? (long long) record->values[arg].d : record->values[arg].s;
+            double d = (type == LOG_ARGUMENT_DOUBLE) ? record->values[arg].d
+                     : (type == LOG_ARGUMENT_SIGNED) ? (double) record->values[arg].s : (double) record->values[arg].u;
+
+            ++arg;
+
+            switch (conversion) {
+                case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+                    spec[spec_length++] = 'l';
+                    spec[spec_length++] = 'l';
+                    spec[spec_length++] = conversion;
+                    spec[spec_length] = '\0';
+                    written = snprintf(out, room, spec, s);
+                } break;
+
+                case 'c': {
+                    spec[spec_length++] = 'c';
+                    spec[spec_length] = '\0';
+                    written = snprintf(out, room, spec, (int) s);
+                } break;
+
+                case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+                    spec[spec_length++] = conversion;
+                    spec[spec_length] = '\0';
+                    written = snprintf(out, room, spec, d);
+                } break;
+
+                case 'p': {
+                    written = snprintf(out, room, "%p", record->values[arg - 1].pointer);
+                } break;
+
+                default: {
+                    spec[spec_length++] = 's';
+                    spec[spec_length] = '\0';
+                    written = snprintf(out, room, spec, string);
+                } break;
+            }
+        }
+
+        if (written > 0) {
+            length += ((size_t) written < room) ? (size_t) written : room - 1;
+        }
+    }
+
+    /**
+     * @brief Drop the trailing newlines some callers still
+     * put at the end of their format strings.
+     *
+     */
+    while ((length > 0) && (buffer[length - 1] == '\n')) {
+        --length;
+    }
+
+    buffer[length] = '\0';
+}
+
+/**
+ * @brief Write a formatted message to wherever the logs are
+ * currently configured to go.
+ *
+ * @param record
+ */
+static void write_record(const struct log_record_t* record) {
+    char message[1024];
+    format_record(record, message, sizeof (message));
+
+    if (log_file == NULL) {
+        syslog(record->priority, "%s", message);
+        return;
+    }
+
+    struct tm tm;
+    char timestamp[32];
+    time_t seconds = record->timestamp / 1000000000;
+
+    localtime_r(&seconds, &tm);
+    strftime(timestamp, sizeof (timestamp), "%Y-%m-%d %H:%M:%S", &tm);
+
+    fprintf(log_file, "%s.%03u keyvo[%d] <%d> %s\n", timestamp, (unsigned int) ((record->timestamp / 1000000) % 1000), (int) getpid(), record->priority, message);
+}
+
+/**
+ * @brief Read the wall clock, in nanoseconds. The coarse
+ * clock is good to a few milliseconds, which is plenty for
+ * log timestamps, and is much cheaper to read.
+ *
+ * @param clock
+ * @return uint64_t
+ */
+static inline uint64_t wall_clock_nanoseconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Record a log event.
+ *
+ * @details On the request path this only has to reserve a
+ * slot in the calling thread's ring and copy a handful of
+ * words into it. If the ring is full, the event is counted
+ * as dropped rather than making the caller wait for the
+ * background thread to catch up.
+ *
+ * When the background thread is not running, either because
+ * it has not been started yet or because the server is
+ * shutting down, the event is formatted and written right
+ * away, the same way syslog() would have.
+ *
+ * @param priority
+ * @param format
+ * @param argc
+ * @param argv
+ */
+void log_event(int priority, const char* format, unsigned int argc, const struct log_argument_t* argv) {
+    int saved_errno = errno;
+
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        struct log_record_t record;
+
+        record.timestamp = wall_clock_nanoseconds(CLOCK_REALTIME);
+        record.format = format;
+        record.saved_errno = saved_errno;
+        record.priority = priority;
+        capture_arguments(&record, argc, argv);
+        write_record(&record);
+
+        errno = saved_errno;
+        return;
+    }
+
+    if ((thread_ring == NULL) && ((thread_ring = register_ring()) == NULL)) {
+        return;
+    }
+
+    struct log_ring_t* ring = thread_ring;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_SIZE) {
+        /**
+         * @brief Only this thread ever writes the drop
+         * counter, so a plain load and store is enough.
+         *
+         */
+        atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+
+    struct log_record_t* record = &ring->records[head & (LOG_RING_SIZE - 1)];
+
+    record->timestamp = wall_clock_nanoseconds(CLOCK_REALTIME_COARSE);
+    record->format = format;
+    record->saved_errno = saved_errno;
+    record->priority = priority;
+    capture_arguments(record, argc, argv);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    errno = saved_errno;
+}
+
+/**
+ * @brief Write out every record currently in the ring, and
+ * report any records that were dropped since last time.
+ *
+ * @param ring
+ * @return The number of records written.
+ */
+static size_t drain_ring(struct log_ring_t* ring) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    for (uint64_t i = tail; i != head; ++i) {
+        write_record(&ring->records[i & (LOG_RING_SIZE - 1)]);
+        atomic_store_explicit(&ring->tail, i + 1, memory_order_release);
+    }
+
+    uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+
+    if (dropped != ring->dropped_reported) {
+        struct log_record_t record = { .format = "%llu log records dropped: ring full", .priority = LOG_WARNING, .argc = 1 };
+
+        record.timestamp = wall_clock_nanoseconds(CLOCK_REALTIME);
+        record.types[0] = LOG_ARGUMENT_UNSIGNED;
+        record.values[0].u = dropped - ring->dropped_reported;
+        write_record(&record);
+
+        ring->dropped_reported = dropped;
+    }
+
+    return head - tail;
+}
+
+/**
+ * @brief Drain every ring once.
+ *
+ * @return The number of records written.
+ */
+static size_t drain_rings(void) {
+    size_t drained = 0;
+
+    for (struct log_ring_t* ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        drained += drain_ring(ring);
+    }
+
+    if ((drained != 0) && (log_file != NULL)) {
+        fflush(log_file);
+    }
+
+    return drained;
+}
+
+/**
+ * @brief This is the background thread's main loop. It
+ * keeps draining until it is told to stop, sleeping
+ * whenever there is nothing to do, and then drains one last
+ * time so nothing logged before shutdown is lost.
+ *
+ * @param argument
+ * @return void*
+ */
+static void* drain_loop(void* argument) {
+    (void) argument;
+
+    const struct timespec interval = { 0, LOG_DRAIN_INTERVAL * 1000 };
+
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        if (drain_rings() == 0) {
+            nanosleep(&interval, NULL);
+        }
+    }
+
+    drain_rings();
+
+    return NULL;
+}
+
+/**
+ * @brief Start the background thread, which from then on
+ * owns all output to the system log or the given file.
+ *
+ * @details This has to happen after daemonize(), since
+ * threads do not survive fork() and every file descriptor
+ * is closed along the way. If the file cannot be opened or
+ * the thread cannot be started, we stay in synchronous
+ * mode and say so.
+ *
+ * @param filename The log file, or NULL for the system log.
+ */
+void start_logger(const char* filename) {
+    if (filename) {
+        log_file = fopen(filename, "a");
+
+        if (log_file == NULL) {
+            keyvo_log(LOG_ERR, "Could not open log file %s: %m", filename);
+        }
+    }
+
+    atomic_store_explicit(&running, true, memory_order_release);
+
+    if (pthread_create(&drain_thread, NULL, drain_loop, NULL) != 0) {
+        atomic_store_explicit(&running, false, memory_order_release);
+        keyvo_log(LOG_WARNING, "%s", "Could not start the logging thread; logging synchronously.");
+        return;
+    }
+
+    if (atexit(stop_logger) != 0) {
+        keyvo_log(LOG_WARNING, "%s", "Failed to register the logger shutdown callback.");
+    }
+}
+
+/**
+ * @brief Stop the background thread once it has written out
+ * everything that was logged up to this point. Anything
+ * logged afterwards is written synchronously.
+ *
+ */
+void stop_logger(void) {
+    if (!atomic_exchange_explicit(&running, false, memory_order_acq_rel)) {
+        return;
+    }
+
+    pthread_join(drain_thread, NULL);
+
+    if (log_file != NULL) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+}
+
+/**
+ * @brief Return the total number of records dropped so far
+ * because a ring was full.
+ *
+ * @return uint64_t
+ */
+uint64_t log_records_dropped(void) {
+    uint64_t dropped = 0;
+
+    for (struct log_ring_t* ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+
+    return dropped;
+}
@@ -14,75 +14,28 @@
  */
 
 #include "keyvo.h"
-
-/**
- * @todo Implement hashing functionality.
- *
- * - gperf
- * - sparsehash
- * - libkeccak
- * - mhash
- * - xxhash
- *
- * - murmurhash3
- * - jenkinshash
- * 
- */
-
-/**
- * @brief This struct contains two mutable char pointers
- * which will point at a dynamic configuration setting.
- */
-struct key_val_t {
-    char* key;
-    char* val;
-};
-
-/**
- * @brief This is the primary datastructure in the server,
- * as a collection of key-value pairs is the definition of
- * a configuration.
- * 
- */
-struct symbol_table_t {
-    struct key_val_t* key_vals;
-};
+#include "capture.h"
+#include "configuration.h"
+#include "frozen_table.h"
+#include "log.h"
+#include "placement.h"
+#include "server.h"
+#include "symbol_table.h"
 
 /**
  * @brief This is the root node of our symbol table.
  *
- * @details For the moment, we are implementing the symbol
- * table as a dynamic array through which we much iterate
- * in order to find a keyval. This is being done for the
- * purposes of prototyping, and not because it's actually
- * not a terrible idea.
- *
  * @author Jose Fernando Lopez Fernandez
  * 
  */
-struct symbol_table_t* symbol_table = NULL;
+struct symbol_table_t symbol_table;
 
 /**
- * @brief This function is meant to be called one and only
- * one time, simply for the purposes of allocating the
- * initial memory to the symbol table. After that, the
- * subroutine which will handle adding elements to the
- * table will handle the necessary baggage to dynamically
- * allocate memory for the symbol table.
- * 
- * @param symbol_table 
- * @return int 
+ * @brief The read-only table the configuration is compiled
+ * into when the server runs with --frozen.
+ *
  */
-void initialize_symbol_table(struct symbol_table_t* symbol_table) {
-    if (symbol_table == NULL) {
-        symbol_table = malloc(10 * sizeof (struct key_val_t));
-
-        if (symbol_table == NULL) {
-            syslog(LOG_ERR, "%s\n", "Memory-allocation failure.");
-            exit(EXIT_FAILURE);
-        }
-    }
-}
+struct frozen_table_t frozen_table;
 
 /**
  * @brief Once the server enters this function, it is ready
@@ -150,7 +103,7 @@ void remove_lock_on_exit(void) {
          * to strerror.
          * 
          */
-        syslog(LOG_ERR, "Could not delete the file lock: %s - %s", strerror(errno), "The filelock mutex was not deleted, and will **prevent the server from starting until it is manually removed**.");
+        keyvo_log(LOG_ERR, "Could not delete the file lock: %m - The filelock mutex was not deleted, and will **prevent the server from starting until it is manually removed**.");
     }
 }
 
@@ -166,7 +119,7 @@ void print_to_syslog_on_exit(void) {
      * print to syslog, and become truly immortal.
      * 
      */
-    syslog(LOG_DEBUG, "%s", "Server shutdown in progress...");
+    keyvo_log(LOG_DEBUG, "Server shutdown in progress...");
 }
 
 /**
@@ -218,7 +171,7 @@ static bool already_running(void) {
          * capacity to handle traffic.
          * 
          */
-        syslog(LOG_ERR, "%s: %s", "Cannot open lock file", LOCKFILE);
+        keyvo_log(LOG_ERR, "Cannot open lock file: %s", LOCKFILE);
 
         /**
          * @brief Return to daemonize().
@@ -269,7 +222,7 @@ void daemonize(void) {
          * what happened and exit with an error status.
          * 
          */
-        syslog(LOG_ERR, "%s\n", "It seems you were already running a primary server. Are looking for replication?");
+        keyvo_log(LOG_ERR, "It seems you were already running a primary server. Are looking for replication?");
 
         /**
          * @brief Exit with an error status so both the
@@ -324,7 +277,7 @@ void daemonize(void) {
              * quick statement.
              * 
              */
-            syslog(LOG_ERR, "%s\n", "Error after calling fork()");
+            keyvo_log(LOG_ERR, "Error after calling fork()");
             exit(EXIT_FAILURE);
         } break;
 
@@ -352,7 +305,7 @@ void daemonize(void) {
              * debugging purposes.
              * 
              */
-            syslog(LOG_DEBUG, "%s\n", "Keyvo parent threat terminating...");
+            keyvo_log(LOG_DEBUG, "Keyvo parent threat terminating...");
 
             /**
              * @brief Go ahead and terminate the parent
@@ -384,7 +337,7 @@ void daemonize(void) {
      * 
      */
     if (chdir("/") < 0) {
-        syslog(LOG_ERR, "%s\n", "Failed to change directory");
+        keyvo_log(LOG_ERR, "Failed to change directory");
         exit(EXIT_FAILURE);
     }
 
@@ -416,7 +369,7 @@ void daemonize(void) {
          * purposes the same thing. Thus, we move on with
          * our lives.
          */
-        syslog(LOG_WARNING, "%s", "Failed to register syslog exit tracer callback.");
+        keyvo_log(LOG_WARNING, "Failed to register syslog exit tracer callback.");
     }
 
     /**
@@ -441,7 +394,7 @@ void daemonize(void) {
          * soon as they look in the first logical place.
          * 
          */
-        syslog(LOG_ERR, "%s", "The filelock mutex deletion callback could not be registered.");
+        keyvo_log(LOG_ERR, "The filelock mutex deletion callback could not be registered.");
     }
 
     /**
@@ -452,7 +405,7 @@ void daemonize(void) {
     struct rlimit rl;
 
     if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
-        syslog(LOG_ERR, "%s", "Error in call to getrlimit()");
+        keyvo_log(LOG_ERR, "Error in call to getrlimit()");
         exit(EXIT_FAILURE);
     }
 
@@ -494,7 +447,7 @@ void daemonize(void) {
     sa.sa_flags = 0;
 
     if (sigaction(SIGHUP, &sa, NULL) < 0) {
-        syslog(LOG_ERR, "%s", "Fatal error after calling sigaction()");
+        keyvo_log(LOG_ERR, "Fatal error after calling sigaction()");
         exit(EXIT_FAILURE);
     }
 
@@ -510,7 +463,7 @@ void daemonize(void) {
      * 
      */
     if ((fd0 != 0) || (fd1 != 1) || (fd2 != 2)) {
-        syslog(LOG_ERR, "%s %s %s", "Unexpected file descriptors", "Unexpected file descriptors", "Unexpected file descriptors");
+        keyvo_log(LOG_ERR, "Unexpected file descriptors %d %d %d", fd0, fd1, fd2);
         exit(EXIT_FAILURE);
     }
 
@@ -519,7 +472,7 @@ void daemonize(void) {
      * completed the daemonization process.
      * 
      */
-    syslog(LOG_DEBUG, "%s", "Daemonization complete; the server has been initialized.");
+    keyvo_log(LOG_DEBUG, "Daemonization complete; the server has been initialized.");
 }
 
 /**
@@ -529,6 +482,31 @@ void daemonize(void) {
  */
 static int verbose = false;
 
+/**
+ * @brief This variable is set by the --frozen command-line
+ * option. A frozen server serves the configuration file it
+ * was started with, and refuses every write.
+ * 
+ */
+static int frozen = false;
+
+/**
+ * @brief This variable is set by the --huge-pages command-
+ * line option. When set, the table's index and entries, and
+ * the frozen table, are put on 2 MB huge pages.
+ * 
+ */
+static int huge_pages = false;
+
+/**
+ * @brief This variable is set by the --cpu ARG or -C ARG
+ * and the --numa-node ARG or -N ARG command-line options.
+ * The event loop is pinned to the CPU, and memory is
+ * allocated from the node; either may be left at -1.
+ * 
+ */
+static struct placement_t placement = { .cpu = -1, .node = -1 };
+
 /**
  * @brief This variable is set by the --filename ARG or
  * -F ARG command-line options.
@@ -536,6 +514,76 @@ static int verbose = false;
  */
 const char* configuration_filename = NULL;
 
+/**
+ * @brief This variable is set by the --port ARG or -p ARG
+ * command-line options.
+ * 
+ */
+const char* port = PORT;
+
+/**
+ * @brief This variable is set by the --max-memory ARG or
+ * -m ARG command-line options. A value of zero means the
+ * symbol table may grow without limit; anything else turns
+ * on cache mode, where keys are evicted to stay within the
+ * budget.
+ * 
+ */
+size_t memory_limit = 0;
+
+/**
+ * @brief This variable is set by the --log-file ARG or
+ * -l ARG command-line options. By default, the server logs
+ * to the system log.
+ * 
+ */
+const char* log_filename = NULL;
+
+/**
+ * @brief This variable is set by the --metrics-port ARG or
+ * -M ARG command-line options. When set, the server also
+ * serves its metrics over HTTP on this port, in the
+ * Prometheus text format.
+ * 
+ */
+const char* metrics_port = NULL;
+
+/**
+ * @brief This variable is set by the --socket-path ARG or
+ * -s ARG command-line options. When set, the server also
+ * accepts clients on a Unix-domain socket at this path.
+ * 
+ */
+const char* socket_path = NULL;
+
+/**
+ * @brief This variable is set by the --capture ARG or
+ * -c ARG command-line options. When set, the server writes
+ * the requests it receives to this file, for keyvo-replay
+ * to play back later.
+ * 
+ */
+const char* capture_filename = NULL;
+
+/**
+ * @brief This variable is set by the --capture-sample ARG
+ * or -S ARG command-line options. Only one in this many
+ * clients is captured.
+ * 
+ */
+uint32_t capture_sample_rate = 1;
+
+/**
+ * @brief This variable is set by the --rate-limit ARG or
+ * -r ARG, the --rate-burst ARG or -b ARG, and the
+ * --shed-delay ARG or -D ARG command-line options. By
+ * default, clients are not rate limited, and the server
+ * starts shedding load once requests have been kept waiting
+ * for ADMISSION_SHED_DELAY milliseconds.
+ * 
+ */
+struct admission_policy_t admission_policy = { 0, 0, ADMISSION_SHED_DELAY * UINT64_C(1000000) };
+
 /**
  * @brief The following table contains a description of the
  * long options supported by the server.
@@ -545,10 +593,92 @@ static struct option long_options[] = {
     { "help",           no_argument,        0,                  'h' },
     { "verbose",        no_argument,        &verbose,            1  },
     { "quiet",          no_argument,        &verbose,            0  },
+    { "frozen",         no_argument,        &frozen,             1  },
+    { "huge-pages",     no_argument,        &huge_pages,         1  },
     { "configuration-filename",         required_argument,  0,  'f' },
+    { "port",           required_argument,  0,                  'p' },
+    { "max-memory",     required_argument,  0,                  'm' },
+    { "log-file",       required_argument,  0,                  'l' },
+    { "metrics-port",   required_argument,  0,                  'M' },
+    { "socket-path",    required_argument,  0,                  's' },
+    { "capture",        required_argument,  0,                  'c' },
+    { "capture-sample", required_argument,  0,                  'S' },
+    { "cpu",            required_argument,  0,                  'C' },
+    { "numa-node",      required_argument,  0,                  'N' },
+    { "rate-limit",     required_argument,  0,                  'r' },
+    { "rate-burst",     required_argument,  0,                  'b' },
+    { "shed-delay",     required_argument,  0,                  'D' },
     {   0,              0,              0, 0 }
 };
 
+/**
+ * @brief Parse a size given on the command line, which may
+ * carry a K, M, or G suffix for binary kilo-, mega-, or
+ * gigabytes.
+ *
+ * @param argument
+ * @param size
+ * @return true
+ * @return false
+ */
+static bool parse_size(const char* argument, size_t* size) {
+    char* end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(argument, &end, 10);
+
+    if ((errno != 0) || (end == argument)) {
+        return false;
+    }
+
+    unsigned int shift = 0;
+
+    switch (toupper((unsigned char) *end)) {
+        case '\0': break;
+        case 'K': shift = 10; ++end; break;
+        case 'M': shift = 20; ++end; break;
+        case 'G': shift = 30; ++end; break;
+        default: return false;
+    }
+
+    if ((*end != '\0') || (value > (SIZE_MAX >> shift))) {
+        return false;
+    }
+
+    *size = (size_t) value << shift;
+    return true;
+}
+
+/**
+ * @brief Turn a path given on the command line into an
+ * absolute one, since daemonizing changes into the root
+ * directory before the file is opened.
+ *
+ * @param path
+ * @return The absolute path, or NULL on failure.
+ */
+static char* absolute_path(const char* path) {
+    if (path[0] == '/') {
+        return strdup(path);
+    }
+
+    char* directory = getcwd(NULL, 0);
+
+    if (directory == NULL) {
+        return NULL;
+    }
+
+    size_t length = strlen(directory) + strlen(path) + 2;
+    char* absolute = malloc(length);
+
+    if (absolute) {
+        snprintf(absolute, length, "%s/%s", directory, path);
+    }
+
+    free(directory);
+
+    return absolute;
+}
+
 /**
  * @brief This is the entry point of the server execution
  * process.
@@ -592,7 +722,7 @@ int main(int argc, char *argv[])
      * @brief Commence command-line argument parsing.
      * 
      */
-    while ((c = getopt_long(argc, argv, "+vqhf:", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "+vqhf:p:m:l:M:s:c:S:C:N:r:b:D:", long_options, &option_index)) != -1) {
         switch (c) {
             case 0: {
                 /** @todo Fix this */
@@ -605,6 +735,106 @@ int main(int argc, char *argv[])
                 printf("Filename: %s\n", optarg);
             } break;
 
+            case 'p': {
+                port = optarg;
+            } break;
+
+            case 'm': {
+                if (!parse_size(optarg, &memory_limit)) {
+                    fprintf(stderr, "%s: %s\n", "Invalid memory limit", optarg);
+                    return EXIT_FAILURE;
+                }
+            } break;
+
+            case 'l': {
+                if ((log_filename = absolute_path(optarg)) == NULL) {
+                    fprintf(stderr, "%s: %s\n", "Invalid log file", optarg);
+                    return EXIT_FAILURE;
+                }
+            } break;
+
+            case 'M': {
+                metrics_port = optarg;
+            } break;
+
+            case 's': {
+                if ((socket_path = absolute_path(optarg)) == NULL) {
+                    fprintf(stderr, "%s: %s\n", "Invalid socket path", optarg);
+                    return EXIT_FAILURE;
+                }
+            } break;
+
+            case 'c': {
+                if ((capture_filename = absolute_path(optarg)) == NULL) {
+                    fprintf(stderr, "%s: %s\n", "Invalid capture file", optarg);
+                    return EXIT_FAILURE;
+                }
+            } break;
+
+            case 'S': {
+                char* end = NULL;
+                errno = 0;
+                unsigned long sample = strtoul(optarg, &end, 10);
+
+                if ((errno != 0) || (end == optarg) || (*end != '\0') || (sample == 0) || (sample > UINT32_MAX)) {
+                    fprintf(stderr, "%s: %s\n", "Invalid capture sample", optarg);
+                    return EXIT_FAILURE;
+                }
+
+                capture_sample_rate = (uint32_t) sample;
+            } break;
+
+            case 'C': {
+                char* end = NULL;
+                errno = 0;
+                long cpu = strtol(optarg, &end, 10);
+
+                if ((errno != 0) || (end == optarg) || (*end != '\0') || (cpu < 0) || (cpu > INT_MAX)) {
+                    fprintf(stderr, "%s: %s\n", "Invalid CPU", optarg);
+                    return EXIT_FAILURE;
+                }
+
+                placement.cpu = (int) cpu;
+            } break;
+
+            case 'N': {
+                if (!placement_parse_node(optarg, &placement.node)) {
+                    fprintf(stderr, "%s: %s\n", "Invalid NUMA node or network interface", optarg);
+                    return EXIT_FAILURE;
+                }
+            } break;
+
+            case 'r':
+            case 'b': {
+                char* end = NULL;
+                errno = 0;
+                unsigned long value = strtoul(optarg, &end, 10);
+
+                if ((errno != 0) || (end == optarg) || (*end != '\0') || (value > 1000000000)) {
+                    fprintf(stderr, "%s: %s\n", (c == 'r') ? "Invalid rate limit" : "Invalid rate burst", optarg);
+                    return EXIT_FAILURE;
+                }
+
+                if (c == 'r') {
+                    admission_policy.rate = (uint32_t) value;
+                } else {
+                    admission_policy.burst = (uint32_t) value;
+                }
+            } break;
+
+            case 'D': {
+                char* end = NULL;
+                errno = 0;
+                unsigned long milliseconds = strtoul(optarg, &end, 10);
+
+                if ((errno != 0) || (end == optarg) || (*end != '\0') || (milliseconds > UINT32_MAX)) {
+                    fprintf(stderr, "%s: %s\n", "Invalid shed delay", optarg);
+                    return EXIT_FAILURE;
+                }
+
+                admission_policy.shed_delay = milliseconds * UINT64_C(1000000);
+            } break;
+
             case 'h': {
                 /** @todo Remove after testing */
                 printf("Help Menu\n");
@@ -665,12 +895,56 @@ int main(int argc, char *argv[])
     /** @todo Remove after testing */
     printf("Verbose: %d\n", verbose);
 
-    // TODO: Read command-line line args
-    // TODO: Read configuration file ----------
-    // TODO: Daemonize
     // TODO: Listen for SIGHUP to reload configuration
-    // TODO: Wait for incoming socket connections
-    // TODO: Accept commands: ( DEFINE | UPDATE | DROP )
+
+    if (frozen && (configuration_filename == NULL)) {
+        fprintf(stderr, "%s\n", "Nothing to freeze: --frozen needs a --configuration-filename.");
+        return EXIT_FAILURE;
+    }
+
+    /**
+     * @brief Decide where the server's memory and threads
+     * go before anything is allocated, so that the symbol
+     * table starts out in the right place.
+     *
+     */
+    huge_pages_enabled = huge_pages;
+
+    if (!placement_apply(&placement)) {
+        return EXIT_FAILURE;
+    }
+
+    /**
+     * @brief Set up the symbol table and load the
+     * configuration file into it. This has to happen before
+     * daemonizing, which changes into the root directory
+     * and would break a relative configuration path.
+     *
+     * @details A frozen server compiles the configuration
+     * into its read-only table and then throws the symbol
+     * table's contents away. The memory budget only applies
+     * to the mutable table, so it is left off while loading
+     * a configuration that is about to be frozen.
+     *
+     */
+    initialize_symbol_table(&symbol_table);
+
+    if (!frozen) {
+        symbol_table.memory_limit = memory_limit;
+    }
+
+    if (configuration_filename) {
+        load_configuration(&symbol_table, configuration_filename);
+    }
+
+    if (frozen) {
+        if (!frozen_table_build(&frozen_table, &symbol_table)) {
+            return EXIT_FAILURE;
+        }
+
+        destroy_symbol_table(&symbol_table);
+        initialize_symbol_table(&symbol_table);
+    }
 
     /**
      * @brief Cross over to the spirit world.
@@ -685,5 +959,45 @@ int main(int argc, char *argv[])
      */
     daemonize();
 
+    /**
+     * @brief Hand logging off to the background thread, now
+     * that we are past the fork and no longer need to worry
+     * about threads not surviving it.
+     *
+     */
+    start_logger(log_filename);
+
+    /**
+     * @brief The capture writer is a thread too, so it has
+     * to wait until now as well.
+     *
+     */
+    if (capture_filename) {
+        start_capture(capture_filename, capture_sample_rate);
+    }
+
+    /**
+     * @brief Only now that every background thread is up,
+     * and free to run anywhere on the node, is this thread
+     * pinned to its own CPU.
+     *
+     */
+    placement_pin_event_loop(&placement);
+
+    /**
+     * @brief Start serving requests. The server only ever
+     * leaves its event loop by exiting the process.
+     *
+     */
+    struct server_options_t options = {
+        .port = port,
+        .socket_path = socket_path,
+        .metrics_port = metrics_port,
+        .frozen_table = frozen ? &frozen_table : NULL,
+        .admission = admission_policy
+    };
+
+    serve(&symbol_table, &options);
+
     return EXIT_SUCCESS;
 }
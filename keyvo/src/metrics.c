@@ -0,0 +1,531 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "metrics.h"
+#include "log.h"
+#include "capture.h"
+#include "placement.h"
+
+#include <malloc.h>
+
+const char* const command_names[COMMAND_COUNT] = {
+    [COMMAND_GET]    = "GET",
+    [COMMAND_DEFINE] = "DEFINE",
+    [COMMAND_UPDATE] = "UPDATE",
+    [COMMAND_DROP]   = "DROP",
+    [COMMAND_MGET]   = "MGET",
+    [COMMAND_GETV]   = "GETV",
+    [COMMAND_CHECK]  = "CHECK"
+};
+
+/**
+ * @brief The lowercase prefix each command's figures are
+ * reported under by the STATS command.
+ *
+ */
+static const char* const metric_names[COMMAND_COUNT] = {
+    [COMMAND_GET]    = "get",
+    [COMMAND_DEFINE] = "define",
+    [COMMAND_UPDATE] = "update",
+    [COMMAND_DROP]   = "drop",
+    [COMMAND_MGET]   = "mget",
+    [COMMAND_GETV]   = "getv",
+    [COMMAND_CHECK]  = "check"
+};
+
+_Thread_local struct thread_metrics_t* current_thread_metrics = NULL;
+
+/**
+ * @brief Every thread's counters, linked together so they
+ * can be merged on demand. Entries are pushed onto the
+ * front and never removed, so readers need no lock.
+ *
+ */
+static _Atomic(struct thread_metrics_t*) all_thread_metrics = NULL;
+
+/**
+ * @brief The frozen table being served, if any. When set,
+ * the table gauges describe it rather than the (empty)
+ * symbol table.
+ *
+ */
+static const struct frozen_table_t* frozen_table = NULL;
+
+/**
+ * @brief Report on the frozen table instead of the symbol
+ * table from now on.
+ *
+ * @param table
+ */
+void metrics_set_frozen_table(const struct frozen_table_t* table) {
+    frozen_table = table;
+}
+
+/**
+ * @brief Allocate the calling thread's counters and link
+ * them into the list that gets merged for reporting.
+ *
+ * @return struct thread_metrics_t*
+ */
+struct thread_metrics_t* register_thread_metrics(void) {
+    struct thread_metrics_t* metrics = aligned_alloc(64, sizeof (struct thread_metrics_t));
+
+    if (metrics == NULL) {
+        keyvo_log(LOG_ERR, "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(metrics, 0, sizeof (struct thread_metrics_t));
+
+    metrics->next = atomic_load_explicit(&all_thread_metrics, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(&all_thread_metrics, &metrics->next, metrics, memory_order_release, memory_order_relaxed)) {
+        ;
+    }
+
+    current_thread_metrics = metrics;
+
+    return metrics;
+}
+
+/**
+ * @brief Return the largest value that falls into the given
+ * histogram bucket.
+ *
+ * @param bucket
+ * @return uint64_t
+ */
+static uint64_t bucket_upper_bound(size_t bucket) {
+    if (bucket < (2 << HISTOGRAM_SUB_BUCKET_BITS)) {
+        return bucket;
+    }
+
+    unsigned int shift = (bucket >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    uint64_t mantissa = (bucket & (HISTOGRAM_SUB_BUCKETS - 1)) + HISTOGRAM_SUB_BUCKETS;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * @brief Return the value below which the given percentage
+ * of the recorded values fall.
+ *
+ * @param snapshot
+ * @param percentile
+ * @return uint64_t
+ */
+uint64_t histogram_percentile(const struct histogram_snapshot_t* snapshot, double percentile) {
+    if (snapshot->total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t) ((percentile / 100.0) * snapshot->total + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+        seen += snapshot->counts[bucket];
+
+        if (seen >= rank) {
+            uint64_t value = bucket_upper_bound(bucket);
+            return (value < snapshot->max) ? value : snapshot->max;
+        }
+    }
+
+    return snapshot->max;
+}
+
+/**
+ * @brief Everything a report needs, merged across threads.
+ *
+ */
+struct merged_metrics_t {
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t commands[COMMAND_COUNT];
+    uint64_t shed[COMMAND_COUNT];
+    uint64_t rate_limited;
+    struct histogram_snapshot_t latency[COMMAND_COUNT];
+    struct histogram_snapshot_t queue_delay;
+};
+
+/**
+ * @brief Add one thread's histogram into a snapshot.
+ *
+ * @param snapshot
+ * @param histogram
+ */
+static void merge_histogram(struct histogram_snapshot_t* snapshot, const struct histogram_t* histogram) {
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+        snapshot->counts[bucket] += atomic_load_explicit(&histogram->counts[bucket], memory_order_relaxed);
+    }
+
+    snapshot->total += atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    snapshot->sum += atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+    if (max > snapshot->max) {
+        snapshot->max = max;
+    }
+}
+
+/**
+ * @brief Sum up every thread's counters.
+ *
+ * @param merged
+ */
+static void merge_metrics(struct merged_metrics_t* merged) {
+    memset(merged, 0, sizeof (struct merged_metrics_t));
+
+    for (struct thread_metrics_t* m = atomic_load_explicit(&all_thread_metrics, memory_order_acquire); m; m = m->next) {
+        merged->requests += atomic_load_explicit(&m->requests, memory_order_relaxed);
+        merged->errors += atomic_load_explicit(&m->errors, memory_order_relaxed);
+        merged->bytes_in += atomic_load_explicit(&m->bytes_in, memory_order_relaxed);
+        merged->bytes_out += atomic_load_explicit(&m->bytes_out, memory_order_relaxed);
+        merged->rate_limited += atomic_load_explicit(&m->rate_limited, memory_order_relaxed);
+
+        for (size_t c = 0; c < COMMAND_COUNT; ++c) {
+            merged->commands[c] += atomic_load_explicit(&m->commands[c], memory_order_relaxed);
+            merged->shed[c] += atomic_load_explicit(&m->shed[c], memory_order_relaxed);
+
+            merge_histogram(&merged->latency[c], &m->latency[c]);
+        }
+
+        merge_histogram(&merged->queue_delay, &m->queue_delay);
+    }
+}
+
+/**
+ * @brief Process-wide figures that are not kept per thread.
+ *
+ */
+struct gauges_t {
+    size_t keys;
+    size_t buckets;
+    double load_factor;
+    size_t keys_with_ttl;
+    size_t memory_used;
+    size_t memory_limit;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t log_records_dropped;
+    uint64_t capture_records;
+    uint64_t capture_dropped;
+    size_t heap_size;
+    size_t heap_in_use;
+    bool frozen;
+    int cpu;
+    int numa_node;
+    int memory_node;
+    uint64_t cpu_migrations;
+    uint64_t local_pages;
+    uint64_t remote_pages;
+    bool huge_pages;
+    struct huge_page_stats_t huge_page_stats;
+};
+
+/**
+ * @brief Check where a sample of the table's pages really
+ * live: the bucket array and the entries it points to, or
+ * the frozen table's mapping. Pages on the node the server
+ * allocates from, or failing that the node the event loop
+ * is running on, count as local.
+ *
+ * @param symbol_table
+ * @param gauges
+ */
+static void sample_page_locality(const struct symbol_table_t* symbol_table, struct gauges_t* gauges) {
+    void* addresses[PLACEMENT_SAMPLE_PAGES];
+    size_t count = 0;
+
+    if (frozen_table) {
+        size_t stride = frozen_table->blob_size / PLACEMENT_SAMPLE_PAGES + 1;
+
+        for (size_t offset = 0; (offset < frozen_table->blob_size) && (count < PLACEMENT_SAMPLE_PAGES); offset += stride) {
+            addresses[count++] = frozen_table->blob + offset;
+        }
+    } else {
+        size_t stride = symbol_table->bucket_count / (PLACEMENT_SAMPLE_PAGES / 2) + 1;
+
+        for (size_t i = 0; (i < symbol_table->bucket_count) && (count + 2 <= PLACEMENT_SAMPLE_PAGES); i += stride) {
+            addresses[count++] = &symbol_table->buckets[i];
+
+            if (symbol_table->buckets[i]) {
+                addresses[count++] = symbol_table->buckets[i];
+            }
+        }
+    }
+
+    int node = (gauges->memory_node >= 0) ? gauges->memory_node : gauges->numa_node;
+
+    placement_page_locality(addresses, count, node, &gauges->local_pages, &gauges->remote_pages);
+}
+
+/**
+ * @brief Read the gauges from the symbol table and the
+ * allocator.
+ *
+ * @param symbol_table
+ * @param gauges
+ */
+static void read_gauges(const struct symbol_table_t* symbol_table, struct gauges_t* gauges) {
+    gauges->keys = symbol_table->count;
+    gauges->buckets = symbol_table->bucket_count;
+    gauges->load_factor = symbol_table->bucket_count ? (double) symbol_table->count / symbol_table->bucket_count : 0.0;
+    gauges->keys_with_ttl = symbol_table->expiry.count;
+    gauges->memory_used = symbol_table->memory_used;
+    gauges->memory_limit = symbol_table->memory_limit;
+    gauges->hits = symbol_table->hits;
+    gauges->misses = symbol_table->misses;
+    gauges->evictions = symbol_table->evictions;
+    gauges->log_records_dropped = log_records_dropped();
+    gauges->capture_records = capture_records_written();
+    gauges->capture_dropped = capture_records_dropped();
+    gauges->frozen = (frozen_table != NULL);
+
+    if (frozen_table) {
+        gauges->keys = frozen_table->count;
+        gauges->buckets = frozen_table->bucket_count;
+        gauges->load_factor = (double) frozen_table->count / frozen_table->bucket_count;
+        gauges->memory_used = frozen_table->blob_size;
+        gauges->hits = frozen_table->hits;
+        gauges->misses = frozen_table->misses;
+    }
+
+    struct mallinfo2 info = mallinfo2();
+
+    gauges->heap_size = info.arena + info.hblkhd;
+    gauges->heap_in_use = info.uordblks + info.hblkhd;
+
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+
+    if (getcpu(&cpu, &node) == 0) {
+        gauges->cpu = (int) cpu;
+        gauges->numa_node = (int) node;
+    } else {
+        gauges->cpu = -1;
+        gauges->numa_node = -1;
+    }
+
+    gauges->memory_node = placement_memory_node();
+    gauges->cpu_migrations = placement_cpu_migrations;
+    gauges->huge_pages = huge_pages_enabled;
+    huge_pages_statistics(&gauges->huge_page_stats);
+
+    sample_page_locality(symbol_table, gauges);
+}
+
+/**
+ * @brief Append formatted text to a report buffer. Text
+ * that does not fit is not appended at all, not even in
+ * part: the length is set to the capacity instead, so the
+ * caller can tell that the report was cut short, and
+ * nothing more is appended after it.
+ *
+ * @return The new length of the report.
+ */
+static size_t append(char* buffer, size_t length, size_t capacity, const char* format, ...) {
+    if (length >= capacity) {
+        return length;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, capacity - length, format, args);
+    va_end(args);
+
+    if (written < 0) {
+        return length;
+    }
+
+    return ((size_t) written >= capacity - length) ? capacity : length + written;
+}
+
+/**
+ * @brief Render the response to the STATS command: one
+ * "STAT <name> <value>" line per figure, followed by END.
+ * Latencies are reported in microseconds, as the 50th,
+ * 99th and 99.9th percentiles plus the maximum.
+ *
+ * @param symbol_table
+ * @param buffer
+ * @param capacity
+ * @return The length of the report, or the capacity if it
+ * did not fit.
+ */
+size_t render_stats(const struct symbol_table_t* symbol_table, char* buffer, size_t capacity) {
+    static struct merged_metrics_t merged;
+    struct gauges_t gauges;
+    size_t length = 0;
+
+    merge_metrics(&merged);
+    read_gauges(symbol_table, &gauges);
+
+    length = append(buffer, length, capacity, "STAT requests %llu\n", (unsigned long long) merged.requests);
+    length = append(buffer, length, capacity, "STAT errors %llu\n", (unsigned long long) merged.errors);
+    length = append(buffer, length, capacity, "STAT bytes_in %llu\n", (unsigned long long) merged.bytes_in);
+    length = append(buffer, length, capacity, "STAT bytes_out %llu\n", (unsigned long long) merged.bytes_out);
+    length = append(buffer, length, capacity, "STAT frozen %d\n", gauges.frozen);
+    length = append(buffer, length, capacity, "STAT keys %zu\n", gauges.keys);
+    length = append(buffer, length, capacity, "STAT buckets %zu\n", gauges.buckets);
+    length = append(buffer, length, capacity, "STAT load_factor %.3f\n", gauges.load_factor);
+    length = append(buffer, length, capacity, "STAT keys_with_ttl %zu\n", gauges.keys_with_ttl);
+    length = append(buffer, length, capacity, "STAT memory_used %zu\n", gauges.memory_used);
+    length = append(buffer, length, capacity, "STAT memory_limit %zu\n", gauges.memory_limit);
+    length = append(buffer, length, capacity, "STAT hits %llu\n", (unsigned long long) gauges.hits);
+    length = append(buffer, length, capacity, "STAT misses %llu\n", (unsigned long long) gauges.misses);
+    length = append(buffer, length, capacity, "STAT evictions %llu\n", (unsigned long long) gauges.evictions);
+    length = append(buffer, length, capacity, "STAT heap_size %zu\n", gauges.heap_size);
+    length = append(buffer, length, capacity, "STAT heap_in_use %zu\n", gauges.heap_in_use);
+    length = append(buffer, length, capacity, "STAT log_records_dropped %llu\n", (unsigned long long) gauges.log_records_dropped);
+    length = append(buffer, length, capacity, "STAT capture_records %llu\n", (unsigned long long) gauges.capture_records);
+    length = append(buffer, length, capacity, "STAT capture_dropped %llu\n", (unsigned long long) gauges.capture_dropped);
+    length = append(buffer, length, capacity, "STAT cpu %d\n", gauges.cpu);
+    length = append(buffer, length, capacity, "STAT numa_node %d\n", gauges.numa_node);
+    length = append(buffer, length, capacity, "STAT memory_node %d\n", gauges.memory_node);
+    length = append(buffer, length, capacity, "STAT cpu_migrations %llu\n", (unsigned long long) gauges.cpu_migrations);
+    length = append(buffer, length, capacity, "STAT local_pages_sampled %llu\n", (unsigned long long) gauges.local_pages);
+    length = append(buffer, length, capacity, "STAT remote_pages_sampled %llu\n", (unsigned long long) gauges.remote_pages);
+    length = append(buffer, length, capacity, "STAT huge_pages %d\n", gauges.huge_pages);
+    length = append(buffer, length, capacity, "STAT hugetlb_bytes %llu\n", (unsigned long long) gauges.huge_page_stats.reserved_bytes);
+    length = append(buffer, length, capacity, "STAT thp_bytes %llu\n", (unsigned long long) gauges.huge_page_stats.transparent_bytes);
+    length = append(buffer, length, capacity, "STAT huge_page_mappings %llu\n", (unsigned long long) gauges.huge_page_stats.mappings);
+    length = append(buffer, length, capacity, "STAT huge_page_fallbacks %llu\n", (unsigned long long) gauges.huge_page_stats.fallbacks);
+    length = append(buffer, length, capacity, "STAT rate_limited %llu\n", (unsigned long long) merged.rate_limited);
+    length = append(buffer, length, capacity, "STAT queue_delay_p50_us %.1f\n", histogram_percentile(&merged.queue_delay, 50.0) / 1000.0);
+    length = append(buffer, length, capacity, "STAT queue_delay_p99_us %.1f\n", histogram_percentile(&merged.queue_delay, 99.0) / 1000.0);
+    length = append(buffer, length, capacity, "STAT queue_delay_p999_us %.1f\n", histogram_percentile(&merged.queue_delay, 99.9) / 1000.0);
+    length = append(buffer, length, capacity, "STAT queue_delay_max_us %.1f\n", merged.queue_delay.max / 1000.0);
+
+    for (size_t c = 0; c < COMMAND_COUNT; ++c) {
+        const struct histogram_snapshot_t* latency = &merged.latency[c];
+        const char* name = metric_names[c];
+
+        length = append(buffer, length, capacity, "STAT %s_count %llu\n", name, (unsigned long long) merged.commands[c]);
+        length = append(buffer, length, capacity, "STAT %s_shed %llu\n", name, (unsigned long long) merged.shed[c]);
+        length = append(buffer, length, capacity, "STAT %s_p50_us %.1f\n", name, histogram_percentile(latency, 50.0) / 1000.0);
+        length = append(buffer, length, capacity, "STAT %s_p99_us %.1f\n", name, histogram_percentile(latency, 99.0) / 1000.0);
+        length = append(buffer, length, capacity, "STAT %s_p999_us %.1f\n", name, histogram_percentile(latency, 99.9) / 1000.0);
+        length = append(buffer, length, capacity, "STAT %s_max_us %.1f\n", name, latency->max / 1000.0);
+    }
+
+    return append(buffer, length, capacity, "END\n");
+}
+
+/**
+ * @brief Render every metric in the Prometheus text
+ * exposition format.
+ *
+ * @details The latency histograms are far too fine-grained
+ * to expose bucket by bucket, so they are collapsed onto
+ * power-of-two boundaries from about a microsecond to about
+ * seventeen seconds. Since every power of two starts a new
+ * group of buckets, this loses nothing but resolution.
+ *
+ * @param symbol_table
+ * @param buffer
+ * @param capacity
+ * @return The length of the report, or the capacity if it
+ * did not fit.
+ */
+size_t render_prometheus(const struct symbol_table_t* symbol_table, char* buffer, size_t capacity) {
+    static struct merged_metrics_t merged;
+    struct gauges_t gauges;
+    size_t length = 0;
+
+    merge_metrics(&merged);
+    read_gauges(symbol_table, &gauges);
+
+    length = append(buffer, length, capacity, "# TYPE keyvo_requests_total counter\nkeyvo_requests_total %llu\n", (unsigned long long) merged.requests);
+    length = append(buffer, length, capacity, "# TYPE keyvo_errors_total counter\nkeyvo_errors_total %llu\n", (unsigned long long) merged.errors);
+    length = append(buffer, length, capacity, "# TYPE keyvo_received_bytes_total counter\nkeyvo_received_bytes_total %llu\n", (unsigned long long) merged.bytes_in);
+    length = append(buffer, length, capacity, "# TYPE keyvo_sent_bytes_total counter\nkeyvo_sent_bytes_total %llu\n", (unsigned long long) merged.bytes_out);
+    length = append(buffer, length, capacity, "# TYPE keyvo_frozen gauge\nkeyvo_frozen %d\n", gauges.frozen);
+    length = append(buffer, length, capacity, "# TYPE keyvo_keys gauge\nkeyvo_keys %zu\n", gauges.keys);
+    length = append(buffer, length, capacity, "# TYPE keyvo_buckets gauge\nkeyvo_buckets %zu\n", gauges.buckets);
+    length = append(buffer, length, capacity, "# TYPE keyvo_load_factor gauge\nkeyvo_load_factor %.6f\n", gauges.load_factor);
+    length = append(buffer, length, capacity, "# TYPE keyvo_keys_with_ttl gauge\nkeyvo_keys_with_ttl %zu\n", gauges.keys_with_ttl);
+    length = append(buffer, length, capacity, "# TYPE keyvo_memory_used_bytes gauge\nkeyvo_memory_used_bytes %zu\n", gauges.memory_used);
+    length = append(buffer, length, capacity, "# TYPE keyvo_memory_limit_bytes gauge\nkeyvo_memory_limit_bytes %zu\n", gauges.memory_limit);
+    length = append(buffer, length, capacity, "# TYPE keyvo_hits_total counter\nkeyvo_hits_total %llu\n", (unsigned long long) gauges.hits);
+    length = append(buffer, length, capacity, "# TYPE keyvo_misses_total counter\nkeyvo_misses_total %llu\n", (unsigned long long) gauges.misses);
+    length = append(buffer, length, capacity, "# TYPE keyvo_evictions_total counter\nkeyvo_evictions_total %llu\n", (unsigned long long) gauges.evictions);
+    length = append(buffer, length, capacity, "# TYPE keyvo_heap_size_bytes gauge\nkeyvo_heap_size_bytes %zu\n", gauges.heap_size);
+    length = append(buffer, length, capacity, "# TYPE keyvo_heap_in_use_bytes gauge\nkeyvo_heap_in_use_bytes %zu\n", gauges.heap_in_use);
+    length = append(buffer, length, capacity, "# TYPE keyvo_log_records_dropped_total counter\nkeyvo_log_records_dropped_total %llu\n", (unsigned long long) gauges.log_records_dropped);
+    length = append(buffer, length, capacity, "# TYPE keyvo_capture_records_total counter\nkeyvo_capture_records_total %llu\n", (unsigned long long) gauges.capture_records);
+    length = append(buffer, length, capacity, "# TYPE keyvo_capture_dropped_total counter\nkeyvo_capture_dropped_total %llu\n", (unsigned long long) gauges.capture_dropped);
+    length = append(buffer, length, capacity, "# TYPE keyvo_cpu gauge\nkeyvo_cpu %d\n", gauges.cpu);
+    length = append(buffer, length, capacity, "# TYPE keyvo_numa_node gauge\nkeyvo_numa_node %d\n", gauges.numa_node);
+    length = append(buffer, length, capacity, "# TYPE keyvo_memory_node gauge\nkeyvo_memory_node %d\n", gauges.memory_node);
+    length = append(buffer, length, capacity, "# TYPE keyvo_cpu_migrations_total counter\nkeyvo_cpu_migrations_total %llu\n", (unsigned long long) gauges.cpu_migrations);
+    length = append(buffer, length, capacity, "# TYPE keyvo_sampled_pages gauge\nkeyvo_sampled_pages{locality=\"local\"} %llu\nkeyvo_sampled_pages{locality=\"remote\"} %llu\n", (unsigned long long) gauges.local_pages, (unsigned long long) gauges.remote_pages);
+    length = append(buffer, length, capacity, "# TYPE keyvo_huge_pages gauge\nkeyvo_huge_pages %d\n", gauges.huge_pages);
+    length = append(buffer, length, capacity, "# TYPE keyvo_huge_page_bytes gauge\nkeyvo_huge_page_bytes{kind=\"hugetlb\"} %llu\nkeyvo_huge_page_bytes{kind=\"thp\"} %llu\n", (unsigned long long) gauges.huge_page_stats.reserved_bytes, (unsigned long long) gauges.huge_page_stats.transparent_bytes);
+    length = append(buffer, length, capacity, "# TYPE keyvo_huge_page_mappings_total counter\nkeyvo_huge_page_mappings_total %llu\n", (unsigned long long) gauges.huge_page_stats.mappings);
+    length = append(buffer, length, capacity, "# TYPE keyvo_huge_page_fallbacks_total counter\nkeyvo_huge_page_fallbacks_total %llu\n", (unsigned long long) gauges.huge_page_stats.fallbacks);
+    length = append(buffer, length, capacity, "# TYPE keyvo_rate_limited_total counter\nkeyvo_rate_limited_total %llu\n", (unsigned long long) merged.rate_limited);
+
+    length = append(buffer, length, capacity, "# TYPE keyvo_queue_delay_seconds summary\n");
+    length = append(buffer, length, capacity, "keyvo_queue_delay_seconds{quantile=\"0.5\"} %.9f\n", histogram_percentile(&merged.queue_delay, 50.0) / 1e9);
+    length = append(buffer, length, capacity, "keyvo_queue_delay_seconds{quantile=\"0.99\"} %.9f\n", histogram_percentile(&merged.queue_delay, 99.0) / 1e9);
+    length = append(buffer, length, capacity, "keyvo_queue_delay_seconds{quantile=\"0.999\"} %.9f\n", histogram_percentile(&merged.queue_delay, 99.9) / 1e9);
+    length = append(buffer, length, capacity, "keyvo_queue_delay_seconds_sum %.9f\n", merged.queue_delay.sum / 1e9);
+    length = append(buffer, length, capacity, "keyvo_queue_delay_seconds_count %llu\n", (unsigned long long) merged.queue_delay.total);
+
+    length = append(buffer, length, capacity, "# TYPE keyvo_commands_total counter\n");
+
+    for (size_t c = 0; c < COMMAND_COUNT; ++c) {
+        length = append(buffer, length, capacity, "keyvo_commands_total{command=\"%s\"} %llu\n", command_names[c], (unsigned long long) merged.commands[c]);
+    }
+
+    length = append(buffer, length, capacity, "# TYPE keyvo_shed_total counter\n");
+
+    for (size_t c = 0; c < COMMAND_COUNT; ++c) {
+        length = append(buffer, length, capacity, "keyvo_shed_total{command=\"%s\"} %llu\n", command_names[c], (unsigned long long) merged.shed[c]);
+    }
+
+    length = append(buffer, length, capacity, "# TYPE keyvo_command_latency_seconds histogram\n");
+
+    for (size_t c = 0; c < COMMAND_COUNT; ++c) {
+        const struct histogram_snapshot_t* latency = &merged.latency[c];
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+
+        for (unsigned int power = 10; power <= 34; ++power) {
+            uint64_t boundary = UINT64_C(1) << power;
+
+            while ((bucket < HISTOGRAM_BUCKETS) && (bucket_upper_bound(bucket) < boundary)) {
+                cumulative += latency->counts[bucket++];
+            }
+
+            length = append(buffer, length, capacity, "keyvo_command_latency_seconds_bucket{command=\"%s\",le=\"%.9g\"} %llu\n", command_names[c], boundary / 1e9, (unsigned long long) cumulative);
+        }
+
+        length = append(buffer, length, capacity, "keyvo_command_latency_seconds_bucket{command=\"%s\",le=\"+Inf\"} %llu\n", command_names[c], (unsigned long long) latency->total);
+        length = append(buffer, length, capacity, "keyvo_command_latency_seconds_sum{command=\"%s\"} %.9f\n", command_names[c], latency->sum / 1e9);
+        length = append(buffer, length, capacity, "keyvo_command_latency_seconds_count{command=\"%s\"} %llu\n", command_names[c], (unsigned long long) latency->total);
+    }
+
+    return length;
+}
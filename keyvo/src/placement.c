@@ -0,0 +1,348 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "placement.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+int placement_current_cpu = -1;
+uint64_t placement_cpu_migrations = 0;
+
+/**
+ * @brief The highest NUMA node number we can bind to, plus
+ * one. This is the size, in bits, of the node mask handed
+ * to the kernel.
+ *
+ */
+#define PLACEMENT_MAXIMUM_NODES 1024
+
+/**
+ * @brief The node memory is being allocated from, or -1 if
+ * the kernel's default policy is in effect.
+ *
+ */
+static int memory_node = -1;
+
+/**
+ * @brief Read a single integer out of a sysfs file.
+ *
+ * @param path
+ * @param value
+ * @return true
+ * @return false
+ */
+static bool read_integer(const char* path, long* value) {
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool found = (fscanf(file, "%ld", value) == 1);
+    fclose(file);
+
+    return found;
+}
+
+/**
+ * @brief Read a list of CPUs in the kernel's format, such
+ * as "0-3,8-11", out of a sysfs file.
+ *
+ * @param path
+ * @param cpus
+ * @return false if the file could not be read, or listed no
+ * CPUs at all.
+ */
+static bool read_cpu_list(const char* path, cpu_set_t* cpus) {
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    CPU_ZERO(cpus);
+
+    int first = 0;
+    int last = 0;
+    int separator = 0;
+
+    while (fscanf(file, "%d", &first) == 1) {
+        last = first;
+
+        if ((separator = fgetc(file)) == '-') {
+            if (fscanf(file, "%d", &last) != 1) {
+                break;
+            }
+
+            separator = fgetc(file);
+        }
+
+        for (int cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); ++cpu) {
+            CPU_SET(cpu, cpus);
+        }
+
+        if (separator != ',') {
+            break;
+        }
+    }
+
+    fclose(file);
+
+    return CPU_COUNT(cpus) != 0;
+}
+
+/**
+ * @brief Parse the argument to --numa-node, which is either
+ * a node number or the name of a network interface. In the
+ * second case, the server runs on whichever node the
+ * interface's device is attached to.
+ *
+ * @details An interface whose device reports no node, as on
+ * single-socket machines, or a virtual interface with no
+ * device behind it at all, leaves the node at -1, so that
+ * nothing is bound.
+ *
+ * @param argument
+ * @param node
+ * @return false if the argument is neither.
+ */
+bool placement_parse_node(const char* argument, int* node) {
+    char* end = NULL;
+    errno = 0;
+    long value = strtol(argument, &end, 10);
+
+    if ((errno == 0) && (end != argument) && (*end == '\0')) {
+        if ((value < 0) || (value >= PLACEMENT_MAXIMUM_NODES)) {
+            return false;
+        }
+
+        *node = (int) value;
+        return true;
+    }
+
+    char path[PATH_MAX];
+
+    if ((strchr(argument, '/') != NULL) || (snprintf(path, sizeof (path), "/sys/class/net/%s/device/numa_node", argument) >= (int) sizeof (path))) {
+        return false;
+    }
+
+    if (!read_integer(path, &value)) {
+        snprintf(path, sizeof (path), "/sys/class/net/%s", argument);
+
+        if (access(path, F_OK) != 0) {
+            return false;
+        }
+
+        value = -1;
+    }
+
+    if (value >= PLACEMENT_MAXIMUM_NODES) {
+        return false;
+    }
+
+    *node = (value < 0) ? -1 : (int) value;
+    return true;
+}
+
+/**
+ * @brief Find the NUMA node a CPU belongs to, from the
+ * nodeN link in its sysfs directory.
+ *
+ * @param cpu
+ * @return The node, or -1 if the CPU does not exist or the
+ * kernel was built without NUMA support.
+ */
+int placement_node_of_cpu(int cpu) {
+    char path[64];
+    snprintf(path, sizeof (path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* directory = opendir(path);
+
+    if (directory == NULL) {
+        return -1;
+    }
+
+    int node = -1;
+
+    for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+        if ((strncmp(entry->d_name, "node", 4) == 0) && isdigit((unsigned char) entry->d_name[4])) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+
+    closedir(directory);
+
+    return node;
+}
+
+/**
+ * @brief Apply the placement the command line asked for to
+ * the whole process. This runs before the symbol table is
+ * set up, so that it is allocated on the right node from
+ * the start, and before daemonizing, since fork() carries
+ * both the memory policy and the CPU affinity over.
+ *
+ * @details Memory is allocated preferentially from the
+ * node, falling back to other nodes rather than failing
+ * when it fills up. The process is confined to the node's
+ * CPUs, so that the background threads stay close to the
+ * memory they touch too. Pinning the event loop to its own
+ * CPU within the node is left for later, once those threads
+ * have been started.
+ *
+ * A CPU given without a node implies the CPU's own node.
+ * Problems are reported on standard error, since the
+ * server has not daemonized yet.
+ *
+ * @param placement
+ * @return false if the placement could not be applied.
+ */
+bool placement_apply(struct placement_t* placement) {
+    if (placement->cpu >= 0) {
+        char path[64];
+        snprintf(path, sizeof (path), "/sys/devices/system/cpu/cpu%d", placement->cpu);
+
+        if ((placement->cpu >= CPU_SETSIZE) || (access(path, F_OK) != 0)) {
+            fprintf(stderr, "%s: %d\n", "No such CPU", placement->cpu);
+            return false;
+        }
+
+        int node = placement_node_of_cpu(placement->cpu);
+
+        if (placement->node < 0) {
+            placement->node = node;
+        } else if ((node >= 0) && (node != placement->node)) {
+            fprintf(stderr, "Warning: CPU %d is on node %d, not on node %d.\n", placement->cpu, node, placement->node);
+        }
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    if (placement->node >= 0) {
+        char path[64];
+        snprintf(path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", placement->node);
+
+        if (!read_cpu_list(path, &cpus)) {
+            fprintf(stderr, "%s: %d\n", "No such NUMA node", placement->node);
+            return false;
+        }
+
+        unsigned long mask[PLACEMENT_MAXIMUM_NODES / (8 * sizeof (unsigned long))] = { 0 };
+        mask[placement->node / (8 * sizeof (unsigned long))] |= 1UL << (placement->node % (8 * sizeof (unsigned long)));
+
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long) PLACEMENT_MAXIMUM_NODES + 1) != 0) {
+            fprintf(stderr, "%s: %s\n", "Could not set the memory policy", strerror(errno));
+            return false;
+        }
+
+        memory_node = placement->node;
+    }
+
+    if (placement->cpu >= 0) {
+        CPU_SET(placement->cpu, &cpus);
+    }
+
+    if ((CPU_COUNT(&cpus) != 0) && (sched_setaffinity(0, sizeof (cpu_set_t), &cpus) != 0)) {
+        fprintf(stderr, "%s: %s\n", "Could not set the CPU affinity", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Pin the calling thread, which is about to become
+ * the event loop, to the CPU the command line asked for.
+ * Threads that were started before this keep running
+ * anywhere on the node.
+ *
+ * @param placement
+ */
+void placement_pin_event_loop(const struct placement_t* placement) {
+    if (placement->cpu < 0) {
+        return;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(placement->cpu, &cpus);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof (cpu_set_t), &cpus) != 0) {
+        keyvo_log(LOG_WARNING, "Could not pin the event loop to CPU %d.", placement->cpu);
+        return;
+    }
+
+    keyvo_log(LOG_DEBUG, "Event loop pinned to CPU %d.", placement->cpu);
+}
+
+/**
+ * @brief Return the node memory is being allocated from, or
+ * -1 if no node was chosen.
+ *
+ * @return int
+ */
+int placement_memory_node(void) {
+    return memory_node;
+}
+
+/**
+ * @brief Find out which node each of a set of addresses is
+ * really backed by, and count how many are on the given
+ * node and how many are not. Pages that have not been
+ * touched yet, and so are on no node, are not counted.
+ *
+ * @param addresses At most PLACEMENT_SAMPLE_PAGES of them.
+ * @param count
+ * @param node
+ * @param local
+ * @param remote
+ */
+void placement_page_locality(void* const* addresses, size_t count, int node, uint64_t* local, uint64_t* remote) {
+    void* pages[PLACEMENT_SAMPLE_PAGES];
+    int status[PLACEMENT_SAMPLE_PAGES];
+    uintptr_t page_mask = ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+
+    *local = 0;
+    *remote = 0;
+
+    if (count > PLACEMENT_SAMPLE_PAGES) {
+        count = PLACEMENT_SAMPLE_PAGES;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pages[i] = (void*) ((uintptr_t) addresses[i] & page_mask);
+    }
+
+    if ((count == 0) || (syscall(SYS_move_pages, 0, count, pages, NULL, status, 0) != 0)) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (status[i] < 0) {
+            continue;
+        }
+
+        if (status[i] == node) {
+            ++*local;
+        } else {
+            ++*remote;
+        }
+    }
+}
@@ -0,0 +1,1285 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "server.h"
+#include "metrics.h"
+#include "capture.h"
+#include "placement.h"
+#include "admission.h"
+
+/**
+ * @brief Append a formatted line to the response buffer.
+ *
+ * @details A line that does not fit is not appended at
+ * all, since a client that got half a line would match
+ * every later reply up with the wrong request. Instead, the
+ * length is set to the capacity, which marks the response
+ * as overflowed; nothing more is appended after that, and
+ * execute_command() replaces the reply with an error.
+ *
+ * @return The new length of the response.
+ */
+static size_t append_response(char* response, size_t length, size_t capacity, const char* format, ...) {
+    if (length >= capacity) {
+        return length;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(response + length, capacity - length, format, args);
+    va_end(args);
+
+    if (written < 0) {
+        return length;
+    }
+
+    return ((size_t) written >= capacity - length) ? capacity : length + written;
+}
+
+/**
+ * @brief Parse the optional time-to-live argument of the
+ * DEFINE and UPDATE commands.
+ *
+ * @details The time-to-live is given in whole seconds on
+ * the wire, and converted to the millisecond ticks used by
+ * the symbol table.
+ *
+ * @param argument
+ * @param ttl
+ * @return true
+ * @return false
+ */
+static bool parse_ttl(const char* argument, uint64_t* ttl) {
+    if (argument == NULL) {
+        *ttl = SYMBOL_TABLE_NO_TTL;
+        return true;
+    }
+
+    char* end = NULL;
+    errno = 0;
+    unsigned long long seconds = strtoull(argument, &end, 10);
+
+    if ((errno != 0) || (*end != '\0') || (seconds == 0) || (seconds > UINT64_MAX / 1000)) {
+        return false;
+    }
+
+    *ttl = seconds * 1000;
+    return true;
+}
+
+/**
+ * @brief Append an error reply to the response buffer, and
+ * count it.
+ *
+ * @return The new length of the response.
+ */
+static size_t append_error(char* response, size_t length, size_t capacity, const char* message) {
+    metrics_record_error();
+
+    return append_response(response, length, capacity, "ERROR %s\n", message);
+}
+
+/**
+ * @brief Map the first word of a command line onto the
+ * command it names, or COMMAND_COUNT if it names none.
+ *
+ * @param command
+ * @return enum command_id_t
+ */
+static enum command_id_t parse_command(const char* command) {
+    for (size_t c = 0; c < COMMAND_COUNT; ++c) {
+        if (strcasecmp(command, command_names[c]) == 0) {
+            return (enum command_id_t) c;
+        }
+    }
+
+    return COMMAND_COUNT;
+}
+
+/**
+ * @brief The read-only table being served in frozen mode,
+ * or NULL when serving the mutable symbol table.
+ *
+ */
+static struct frozen_table_t* frozen_table = NULL;
+
+/**
+ * @brief Look a key up in whichever table is being served.
+ * Entries in the frozen table never change, so they all
+ * report version zero.
+ *
+ * @return The value, or NULL if the key is not defined.
+ */
+static const char* lookup(struct symbol_table_t* symbol_table, const char* key, uint64_t* version, uint64_t now) {
+    if (frozen_table) {
+        *version = 0;
+        return frozen_table_lookup(frozen_table, key);
+    }
+
+    struct key_val_t* key_val = symbol_table_lookup(symbol_table, key, now);
+
+    if (key_val == NULL) {
+        return NULL;
+    }
+
+    *version = key_val->version;
+    return key_val->val;
+}
+
+/**
+ * @brief Append the reply to a single key lookup. Versioned
+ * lookups also report the value's version, which a client
+ * can later hand back to CHECK.
+ *
+ * @return The new length of the response.
+ */
+static size_t append_lookup(struct symbol_table_t* symbol_table, const char* key, bool versioned, char* response, size_t length, size_t capacity, uint64_t now) {
+    uint64_t version = 0;
+    const char* val = lookup(symbol_table, key, &version, now);
+
+    if (val == NULL) {
+        return append_response(response, length, capacity, "NOT_FOUND\n");
+    }
+
+    if (versioned) {
+        return append_response(response, length, capacity, "VALUE %s %llu\n", val, (unsigned long long) version);
+    }
+
+    return append_response(response, length, capacity, "VALUE %s\n", val);
+}
+
+/**
+ * @brief Append the reply to a CHECK: VALID if the client's
+ * copy of the key is still current, or the same reply as a
+ * GETV if it is not.
+ *
+ * @return The new length of the response.
+ */
+static size_t append_check(struct symbol_table_t* symbol_table, const char* key, const char* version_argument, char* response, size_t length, size_t capacity, uint64_t now) {
+    char* end = NULL;
+
+    if (version_argument == NULL) {
+        return append_error(response, length, capacity, "missing version");
+    }
+
+    errno = 0;
+    unsigned long long known = strtoull(version_argument, &end, 10);
+
+    if ((errno != 0) || (end == version_argument) || (*end != '\0')) {
+        return append_error(response, length, capacity, "invalid version");
+    }
+
+    uint64_t version = 0;
+    const char* val = lookup(symbol_table, key, &version, now);
+
+    if (val == NULL) {
+        return append_response(response, length, capacity, "NOT_FOUND\n");
+    }
+
+    if (version == known) {
+        return append_response(response, length, capacity, "VALID\n");
+    }
+
+    return append_response(response, length, capacity, "VALUE %s %llu\n", val, (unsigned long long) version);
+}
+
+/**
+ * @brief Run a command whose name has already been parsed,
+ * taking its arguments from the rest of the line.
+ *
+ * @return The new length of the response.
+ */
+static size_t run_command(struct symbol_table_t* symbol_table, enum command_id_t command, char** saveptr, char* response, size_t length, size_t capacity, uint64_t now) {
+    char* key = strtok_r(NULL, " \t\r", saveptr);
+
+    if (key == NULL) {
+        return append_error(response, length, capacity, "missing key");
+    }
+
+    if ((command == COMMAND_GET) || (command == COMMAND_GETV)) {
+        return append_lookup(symbol_table, key, command == COMMAND_GETV, response, length, capacity, now);
+    }
+
+    if (command == COMMAND_CHECK) {
+        return append_check(symbol_table, key, strtok_r(NULL, " \t\r", saveptr), response, length, capacity, now);
+    }
+
+    if (command == COMMAND_MGET) {
+        for (; key; key = strtok_r(NULL, " \t\r", saveptr)) {
+            length = append_lookup(symbol_table, key, false, response, length, capacity, now);
+        }
+
+        return length;
+    }
+
+    if (frozen_table) {
+        return append_response(response, length, capacity, "READ_ONLY\n");
+    }
+
+    if (command == COMMAND_DROP) {
+        if (symbol_table_drop(symbol_table, key, now) != SYMBOL_TABLE_OK) {
+            return append_response(response, length, capacity, "NOT_FOUND\n");
+        }
+
+        return append_response(response, length, capacity, "OK\n");
+    }
+
+    char* val = strtok_r(NULL, " \t\r", saveptr);
+    uint64_t ttl = SYMBOL_TABLE_NO_TTL;
+
+    if (val == NULL) {
+        return append_error(response, length, capacity, "missing value");
+    }
+
+    if (!parse_ttl(strtok_r(NULL, " \t\r", saveptr), &ttl)) {
+        return append_error(response, length, capacity, "invalid ttl");
+    }
+
+    enum symbol_table_status_t status = (command == COMMAND_DEFINE)
+        ? symbol_table_define(symbol_table, key, val, ttl, now)
+        : symbol_table_update(symbol_table, key, val, ttl, now);
+
+    switch (status) {
+        case SYMBOL_TABLE_OK: {
+            return append_response(response, length, capacity, "OK\n");
+        } break;
+
+        case SYMBOL_TABLE_EXISTS: {
+            return append_response(response, length, capacity, "EXISTS\n");
+        } break;
+
+        case SYMBOL_TABLE_NOT_FOUND: {
+            return append_response(response, length, capacity, "NOT_FOUND\n");
+        } break;
+
+        case SYMBOL_TABLE_TOO_LARGE: {
+            return append_response(response, length, capacity, "TOO_LARGE\n");
+        } break;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Count the keys left on a command line.
+ *
+ * @param rest
+ * @return uint64_t
+ */
+static uint64_t count_keys(const char* rest) {
+    uint64_t keys = 0;
+
+    while (rest && *(rest += strspn(rest, " \t\r"))) {
+        rest += strcspn(rest, " \t\r");
+        ++keys;
+    }
+
+    return keys;
+}
+
+/**
+ * @brief Append the reply to a command the server turned
+ * away, and count it. An MGET is answered with one BUSY per
+ * key, so that the reply still lines up with the request.
+ *
+ * @return The new length of the response.
+ */
+static size_t append_busy(enum command_id_t command, enum admission_verdict_t verdict, uint64_t keys, char* response, size_t length, size_t capacity) {
+    if (verdict == ADMISSION_SHED) {
+        metrics_record_shed(command);
+    } else {
+        metrics_record_rate_limited();
+    }
+
+    uint64_t replies = ((command == COMMAND_MGET) && (keys > 1)) ? keys : 1;
+
+    for (uint64_t r = 0; r < replies; ++r) {
+        length = append_response(response, length, capacity, "BUSY\n");
+    }
+
+    return length;
+}
+
+/**
+ * @brief Replace a reply that overflowed the response
+ * buffer with an error, and count it. As with BUSY, an
+ * MGET gets one error per key, so that the reply still
+ * lines up with the request; if even that does not fit, it
+ * gets a single error, and if that does not fit either, no
+ * reply at all.
+ *
+ * @param command The command, or COMMAND_COUNT for STATS.
+ * @param keys
+ * @param start Where the reply started in the response.
+ * @return The new length of the response.
+ */
+static size_t append_too_large(enum command_id_t command, uint64_t keys, char* response, size_t start, size_t capacity) {
+    static const char error[] = "ERROR response too large\n";
+
+    uint64_t replies = ((command == COMMAND_MGET) && (keys > 1)) ? keys : 1;
+    size_t length = start;
+
+    metrics_record_error();
+
+    for (uint64_t r = 0; r < replies; ++r) {
+        length = append_response(response, length, capacity, error);
+    }
+
+    if (length >= capacity) {
+        length = append_response(response, start, capacity, error);
+    }
+
+    return (length >= capacity) ? start : length;
+}
+
+/**
+ * @brief Execute a single command line against the symbol
+ * table, appending the reply to the response buffer.
+ *
+ * @details The protocol is line-oriented and whitespace-
+ * delimited:
+ *
+ *     GET <key>
+ *     GETV <key>
+ *     CHECK <key> <version>
+ *     MGET <key> [<key> ...]
+ *     DEFINE <key> <value> [<ttl-seconds>]
+ *     UPDATE <key> <value> [<ttl-seconds>]
+ *     DROP <key>
+ *     STATS
+ *     ECHO [<token>]
+ *
+ * GETV is GET with the value's version appended to the
+ * reply, and CHECK revalidates a copy fetched with GETV.
+ * ECHO just sends its token back, so that a datagram client
+ * can tag a request and tell its reply apart from those to
+ * requests that were lost or gave up on.
+ * MGET replies with one line per key, in order. When the
+ * server is frozen, DEFINE, UPDATE and DROP are refused
+ * with READ_ONLY. Every data
+ * command is timed and counted in the calling thread's
+ * metrics; STATS is not, so that polling it does not skew
+ * the figures it reports.
+ *
+ * A data command the server is too busy for, or that puts
+ * its client over its rate limit, is answered with BUSY
+ * instead of being run. STATS is always answered, so that
+ * an overloaded server can still be looked into, as is
+ * ECHO, which costs next to nothing.
+ *
+ * A reply is never cut off part way through a line. One
+ * that does not fit in what is left of the response buffer
+ * is answered with "ERROR response too large" instead.
+ *
+ * @param bucket The client's token bucket, or NULL.
+ * @param queue_delay How long, in nanoseconds, the line
+ * waited to be executed.
+ * @return The new length of the response.
+ */
+static size_t execute_command(struct symbol_table_t* symbol_table, char* line, struct token_bucket_t* bucket, uint64_t queue_delay, char* response, size_t length, size_t capacity, uint64_t now) {
+    char* saveptr = NULL;
+    char* name = strtok_r(line, " \t\r", &saveptr);
+
+    if (name == NULL) {
+        return length;
+    }
+
+    size_t reply = length;
+    enum command_id_t command = COMMAND_COUNT;
+    uint64_t keys = 1;
+
+    if (strcasecmp(name, "STATS") == 0) {
+        length += render_stats(symbol_table, response + length, capacity - length);
+    } else if (strcasecmp(name, "ECHO") == 0) {
+        char* token = strtok_r(NULL, " \t\r", &saveptr);
+
+        if (token == NULL) {
+            length = append_response(response, length, capacity, "ECHO\n");
+        } else {
+            length = append_response(response, length, capacity, "ECHO %s\n", token);
+        }
+    } else if ((command = parse_command(name)) == COMMAND_COUNT) {
+        length = append_error(response, length, capacity, "unknown command");
+    } else {
+        uint64_t start = monotonic_nanoseconds();
+        keys = (command == COMMAND_MGET) ? count_keys(saveptr) : 1;
+        enum admission_verdict_t verdict = admission_check(bucket, command, keys, queue_delay, start);
+
+        metrics_record_queue_delay(queue_delay);
+
+        if (verdict != ADMISSION_ACCEPT) {
+            length = append_busy(command, verdict, keys, response, length, capacity);
+        } else {
+            length = run_command(symbol_table, command, &saveptr, response, length, capacity, now);
+            metrics_record_command(command, monotonic_nanoseconds() - start);
+        }
+    }
+
+    if (length >= capacity) {
+        length = append_too_large(command, keys, response, reply, capacity);
+    }
+
+    return length;
+}
+
+/**
+ * @brief Execute every newline-separated command in the
+ * request, collecting all of the replies in the response.
+ *
+ * @return The length of the response.
+ */
+static size_t execute_request(struct symbol_table_t* symbol_table, char* request, struct token_bucket_t* bucket, uint64_t queue_delay, char* response, size_t capacity, uint64_t now) {
+    size_t length = 0;
+    char* saveptr = NULL;
+
+    for (char* line = strtok_r(request, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+        length = execute_command(symbol_table, line, bucket, queue_delay, response, length, capacity, now);
+    }
+
+    return length;
+}
+
+/**
+ * @brief Create and bind one of the server's sockets. For
+ * stream sockets, also start listening for connections,
+ * without ever blocking in accept() should a client give up
+ * before it is accepted; datagram sockets have the kernel
+ * timestamp every datagram as it arrives.
+ *
+ * @param port
+ * @param socktype
+ * @return int
+ */
+static int open_listener(const char* port, int socktype) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof (struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = socktype;
+    hints.ai_flags = AI_PASSIVE;
+
+    struct addrinfo* bind_address = NULL;
+
+    int error = 0;
+
+    if ((error = getaddrinfo(0, port, &hints, &bind_address)) != 0) {
+        keyvo_log(LOG_ERR, "Error in call to getaddrinfo(): %s", gai_strerror(error));
+        exit(EXIT_FAILURE);
+    }
+
+    int listener_socket = socket(bind_address->ai_family, bind_address->ai_socktype, bind_address->ai_protocol);
+
+    if (listener_socket == -1) {
+        keyvo_log(LOG_ERR, "Error in call to socket(): %m");
+        exit(EXIT_FAILURE);
+    }
+
+    if (socktype == SOCK_STREAM) {
+        int reuse = 1;
+        setsockopt(listener_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+    } else {
+        int timestamps = 1;
+        setsockopt(listener_socket, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof (timestamps));
+    }
+
+    if (bind(listener_socket, bind_address->ai_addr, bind_address->ai_addrlen)) {
+        keyvo_log(LOG_ERR, "Error in call to bind(): %m");
+        exit(EXIT_FAILURE);
+    }
+
+    freeaddrinfo(bind_address);
+
+    if ((socktype == SOCK_STREAM) && (listen(listener_socket, SOMAXCONN) == -1)) {
+        keyvo_log(LOG_ERR, "Error in call to listen(): %m");
+        exit(EXIT_FAILURE);
+    }
+
+    if (socktype == SOCK_STREAM) {
+        fcntl(listener_socket, F_SETFL, fcntl(listener_socket, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    return listener_socket;
+}
+
+/**
+ * @brief Identify a datagram client by its address, so
+ * that every request from the same socket is captured under
+ * the same connection.
+ *
+ * @param address
+ * @param length
+ * @return uint32_t
+ */
+static uint32_t datagram_client_id(const struct sockaddr_storage* address, socklen_t length) {
+    const unsigned char* bytes = (const unsigned char*) address;
+    uint32_t hash = 2166136261U;
+
+    for (socklen_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Work out how long a datagram sat in the socket's
+ * receive queue, from the time the kernel stamped it with
+ * on arrival.
+ *
+ * @param message
+ * @return The delay in nanoseconds, or zero if the datagram
+ * carries no timestamp.
+ */
+static uint64_t datagram_queue_delay(struct msghdr* message) {
+    for (struct cmsghdr* control = CMSG_FIRSTHDR(message); control; control = CMSG_NXTHDR(message, control)) {
+        if ((control->cmsg_level != SOL_SOCKET) || (control->cmsg_type != SCM_TIMESTAMPNS)) {
+            continue;
+        }
+
+        struct timespec arrived;
+        struct timespec now;
+        memcpy(&arrived, CMSG_DATA(control), sizeof (arrived));
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        int64_t delay = ((int64_t) (now.tv_sec - arrived.tv_sec) * 1000000000) + (now.tv_nsec - arrived.tv_nsec);
+
+        return (delay > 0) ? (uint64_t) delay : 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Receive one datagram, execute every command in it,
+ * and send the replies back to wherever it came from.
+ *
+ * @details Datagram clients have no request queue of their
+ * own in the server; theirs is the socket's receive buffer,
+ * so that is where their queueing delay is measured.
+ *
+ * @param symbol_table
+ * @param listener_socket
+ */
+static void handle_datagram(struct symbol_table_t* symbol_table, int listener_socket) {
+    static char request[DATAGRAM_SIZE];
+    static char response[DATAGRAM_SIZE];
+
+    struct sockaddr_storage client_address;
+    char control[CMSG_SPACE(sizeof (struct timespec))];
+    struct iovec buffer = { request, sizeof (request) - 1 };
+
+    struct msghdr message = {
+        .msg_name = &client_address,
+        .msg_namelen = sizeof (client_address),
+        .msg_iov = &buffer,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof (control)
+    };
+
+    ssize_t bytes_received = recvmsg(listener_socket, &message, 0);
+
+    if (bytes_received < 0) {
+        return;
+    }
+
+    socklen_t client_len = message.msg_namelen;
+    struct token_bucket_t* bucket = NULL;
+
+    request[bytes_received] = '\0';
+    metrics_record_request(bytes_received);
+
+    if ((capture_sample != 0) || admission_rate_limited()) {
+        uint32_t client_id = datagram_client_id(&client_address, client_len);
+
+        if (capture_sampled(client_id)) {
+            capture_request(client_id, CAPTURE_UDP, request, bytes_received);
+        }
+
+        bucket = admission_datagram_bucket(client_id);
+    }
+
+    size_t length = execute_request(symbol_table, request, bucket, datagram_queue_delay(&message), response, sizeof (response), monotonic_milliseconds());
+
+    if (length == 0) {
+        return;
+    }
+
+    if (sendto(listener_socket, response, length, 0, (struct sockaddr *) &client_address, client_len) == -1) {
+        keyvo_log(LOG_WARNING, "Error in call to sendto(): %m");
+        return;
+    }
+
+    metrics_record_response(length);
+}
+
+/**
+ * @brief Create, bind and start listening on the server's
+ * Unix-domain socket, replacing any stale socket file left
+ * over from a previous run.
+ *
+ * @param path
+ * @return int
+ */
+static int open_unix_listener(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof (struct sockaddr_un));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof (address.sun_path)) {
+        keyvo_log(LOG_ERR, "Socket path is too long: %s", path);
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(address.sun_path, path);
+
+    int listener_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listener_socket == -1) {
+        keyvo_log(LOG_ERR, "Error in call to socket(): %m");
+        exit(EXIT_FAILURE);
+    }
+
+    unlink(path);
+
+    if (bind(listener_socket, (struct sockaddr *) &address, sizeof (address))) {
+        keyvo_log(LOG_ERR, "Error in call to bind(): %m");
+        exit(EXIT_FAILURE);
+    }
+
+    if (listen(listener_socket, SOMAXCONN) == -1) {
+        keyvo_log(LOG_ERR, "Error in call to listen(): %m");
+        exit(EXIT_FAILURE);
+    }
+
+    fcntl(listener_socket, F_SETFL, fcntl(listener_socket, F_GETFL, 0) | O_NONBLOCK);
+
+    return listener_socket;
+}
+
+/**
+ * @brief The stream clients currently connected, indexed by
+ * their socket, along with the bookkeeping select() needs.
+ *
+ */
+static struct connection_t* connections[FD_SETSIZE];
+static fd_set master;
+static int max_socket = -1;
+
+/**
+ * @brief The number of connections that have subscribed to
+ * invalidations, so that changes cost nothing when nobody
+ * is listening.
+ *
+ */
+static size_t subscriber_count = 0;
+
+/**
+ * @brief Start watching a socket for readability.
+ *
+ * @param socket
+ */
+static void watch_socket(int socket) {
+    FD_SET(socket, &master);
+
+    if (socket > max_socket) {
+        max_socket = socket;
+    }
+}
+
+/**
+ * @brief The number of stream clients accepted so far, which
+ * also serves as their identifier in a traffic capture.
+ *
+ */
+static uint32_t accepted_count = 0;
+
+/**
+ * @brief Accept a pending stream client.
+ *
+ * @details select() cannot watch descriptors past
+ * FD_SETSIZE, so clients beyond that are turned away.
+ *
+ * @param listener_socket
+ * @param transport
+ */
+static void accept_connection(int listener_socket, enum capture_transport_t transport) {
+    int socket = accept(listener_socket, NULL, NULL);
+
+    if (socket == -1) {
+        return;
+    }
+
+    if (socket >= FD_SETSIZE) {
+        keyvo_log(LOG_WARNING, "Refusing connection: too many clients.");
+        close(socket);
+        return;
+    }
+
+    struct connection_t* connection = connection_open(socket);
+
+    if (connection == NULL) {
+        return;
+    }
+
+    connection->id = ++accepted_count;
+    connection->transport = (uint8_t) transport;
+    connection->captured = capture_sampled(connection->id);
+
+    connections[socket] = connection;
+    watch_socket(socket);
+}
+
+/**
+ * @brief Disconnect a stream client.
+ *
+ * @param connection
+ */
+static void drop_connection(struct connection_t* connection) {
+    if (connection->subscribed) {
+        --subscriber_count;
+    }
+
+    FD_CLR(connection->socket, &master);
+    connections[connection->socket] = NULL;
+    connection_close(connection);
+}
+
+/**
+ * @brief A scrape of the metrics endpoint in progress.
+ *
+ * @details This is deliberately the least HTTP server that
+ * could possibly work: whatever the request, the reply is
+ * the full set of metrics in the Prometheus text format,
+ * after which the connection is closed. Scrapes are still
+ * served from the event loop, so they get the same
+ * non-blocking treatment as any other client; a scraper
+ * that connects and then says nothing is simply dropped
+ * once METRICS_TIMEOUT has passed.
+ *
+ */
+struct metrics_client_t {
+    int socket;
+    uint64_t deadline;
+
+    size_t request_length;
+    char request[1024];
+
+    char* reply;
+    size_t reply_length;
+    size_t reply_sent;
+};
+
+/**
+ * @brief The scrapes in progress, indexed by their socket.
+ *
+ */
+static struct metrics_client_t* metrics_clients[FD_SETSIZE];
+static size_t metrics_client_count = 0;
+
+/**
+ * @brief Accept a pending scrape of the metrics endpoint.
+ *
+ * @param metrics_socket
+ * @param now
+ */
+static void accept_metrics_client(int metrics_socket, uint64_t now) {
+    int socket = accept(metrics_socket, NULL, NULL);
+
+    if (socket == -1) {
+        return;
+    }
+
+    struct metrics_client_t* client = (socket < FD_SETSIZE) ? malloc(sizeof (struct metrics_client_t)) : NULL;
+
+    if (client == NULL) {
+        keyvo_log(LOG_WARNING, "Refusing metrics connection.");
+        close(socket);
+        return;
+    }
+
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+
+    client->socket = socket;
+    client->deadline = now + METRICS_TIMEOUT;
+    client->request_length = 0;
+    client->reply = NULL;
+    client->reply_length = 0;
+    client->reply_sent = 0;
+
+    metrics_clients[socket] = client;
+    ++metrics_client_count;
+    watch_socket(socket);
+}
+
+/**
+ * @brief Close a scrape, whether it was answered or not.
+ *
+ * @param client
+ */
+static void drop_metrics_client(struct metrics_client_t* client) {
+    FD_CLR(client->socket, &master);
+    metrics_clients[client->socket] = NULL;
+    --metrics_client_count;
+
+    close(client->socket);
+    free(client->reply);
+    free(client);
+}
+
+/**
+ * @brief Send as much of the reply to a scrape as the
+ * scraper will take.
+ *
+ * @param client
+ * @return false once the scrape is over, either because
+ * the whole reply has gone out or because it failed.
+ */
+static bool flush_metrics_client(struct metrics_client_t* client) {
+    while (client->reply_sent < client->reply_length) {
+        ssize_t sent = send(client->socket, client->reply + client->reply_sent, client->reply_length - client->reply_sent, MSG_NOSIGNAL);
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return true;
+            }
+
+            keyvo_log(LOG_WARNING, "Error sending metrics: %m");
+            return false;
+        }
+
+        client->reply_sent += sent;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Read what a scraper has sent so far, and once the
+ * request is complete, render the metrics and start
+ * sending them.
+ *
+ * @param symbol_table
+ * @param client
+ * @return false once the scrape is over.
+ */
+static bool handle_metrics_client(struct symbol_table_t* symbol_table, struct metrics_client_t* client) {
+    static char body[METRICS_RESPONSE_SIZE];
+
+    ssize_t bytes_received = recv(client->socket, client->request + client->request_length, sizeof (client->request) - 1 - client->request_length, 0);
+
+    if (bytes_received < 0) {
+        return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    }
+
+    client->request_length += bytes_received;
+    client->request[client->request_length] = '\0';
+
+    bool complete = (bytes_received == 0)
+        || (client->request_length == sizeof (client->request) - 1)
+        || strstr(client->request, "\r\n\r\n")
+        || strstr(client->request, "\n\n");
+
+    if (!complete) {
+        return true;
+    }
+
+    if (client->request_length == 0) {
+        return false;
+    }
+
+    size_t length = render_prometheus(symbol_table, body, sizeof (body));
+    const char* status = "200 OK";
+
+    if (length >= sizeof (body)) {
+        keyvo_log(LOG_WARNING, "The metrics report does not fit in %zu bytes.", sizeof (body));
+
+        status = "500 Internal Server Error";
+        length = 0;
+    }
+
+    size_t capacity = length + 128;
+
+    if ((client->reply = malloc(capacity)) == NULL) {
+        return false;
+    }
+
+    int header_length = snprintf(client->reply, capacity, "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", status, length);
+
+    memcpy(client->reply + header_length, body, length);
+    client->reply_length = header_length + length;
+
+    FD_CLR(client->socket, &master);
+
+    return flush_metrics_client(client);
+}
+
+/**
+ * @brief Symbol-table change callback which pushes an
+ * INVALIDATE line to every subscribed client.
+ *
+ * @param context
+ * @param key
+ */
+static void publish_change(void* context, const char* key) {
+    (void) context;
+
+    if (subscriber_count == 0) {
+        return;
+    }
+
+    size_t key_length = strlen(key);
+
+    for (int socket = 0; socket <= max_socket; ++socket) {
+        struct connection_t* connection = connections[socket];
+
+        if ((connection == NULL) || !connection->subscribed || connection->failed) {
+            continue;
+        }
+
+        if (!connection_append_output(connection, "INVALIDATE ", 11)
+            || !connection_append_output(connection, key, key_length)
+            || !connection_append_output(connection, "\n", 1)) {
+            connection->failed = true;
+        }
+    }
+}
+
+/**
+ * @brief Check whether a command line is a SUBSCRIBE. Only
+ * stream clients can subscribe, since the server has no
+ * way of pushing anything to a datagram client.
+ *
+ * @param line
+ * @return true
+ * @return false
+ */
+static bool is_subscribe(const char* line) {
+    line += strspn(line, " \t\r");
+
+    return (strncasecmp(line, "SUBSCRIBE", 9) == 0) && (strspn(line + 9, " \t\r") == strlen(line + 9));
+}
+
+/**
+ * @brief Execute the complete lines in a stream client's
+ * input buffer, and queue up the replies.
+ *
+ * @details At most ADMISSION_BATCH lines are executed in
+ * one go, and none at all while the client is too far
+ * behind on reading its replies. Whatever is left over
+ * stays queued, and the client is marked as backlogged
+ * until a later pass of the event loop gets to it.
+ *
+ * Unlike a datagram, a stream reply is not limited to
+ * DATAGRAM_SIZE: an MGET of a few large values may run as
+ * long as whatever is left of the client's output buffer
+ * once it has reached the high-water mark, so a reply that
+ * was executed can always be queued.
+ *
+ * @param symbol_table
+ * @param connection
+ * @param scanned How much of the input is already known
+ * to hold no newline.
+ * @return false if the client should be disconnected.
+ */
+static bool execute_stream(struct symbol_table_t* symbol_table, struct connection_t* connection, size_t scanned) {
+    static char response[CONNECTION_OUTPUT_LIMIT - CONNECTION_OUTPUT_HIGH_WATER];
+
+    size_t consumed = 0;
+    size_t executed = 0;
+
+    connection->backlogged = false;
+
+    for (size_t i = scanned; i < connection->input_length; ++i) {
+        if (connection->input[i] != '\n') {
+            continue;
+        }
+
+        if ((executed == ADMISSION_BATCH) || connection_output_backlogged(connection)) {
+            connection->backlogged = true;
+            break;
+        }
+
+        connection->input[i] = '\0';
+
+        char* line = connection->input + consumed;
+        size_t length = 0;
+
+        if (connection->captured) {
+            capture_request(connection->id, connection->transport, line, i - consumed);
+        }
+
+        if (is_subscribe(line)) {
+            if (!connection->subscribed) {
+                connection->subscribed = true;
+                ++subscriber_count;
+            }
+
+            length = append_response(response, 0, sizeof (response), "OK\n");
+        } else {
+            uint64_t queue_delay = monotonic_nanoseconds() - connection->arrived;
+
+            length = execute_command(symbol_table, line, &connection->bucket, queue_delay, response, 0, sizeof (response), monotonic_milliseconds());
+        }
+
+        if ((length != 0) && !connection_append_output(connection, response, length)) {
+            return false;
+        }
+
+        metrics_record_response(length);
+        consumed = i + 1;
+        ++executed;
+    }
+
+    connection->input_length -= consumed;
+    memmove(connection->input, connection->input + consumed, connection->input_length);
+
+    if (!connection->backlogged && (connection->input_length == CONNECTION_INPUT_SIZE)) {
+        static const char error[] = "ERROR line too long\n";
+
+        connection_append_output(connection, error, sizeof (error) - 1);
+        connection_flush(connection);
+
+        return false;
+    }
+
+    return connection_flush(connection);
+}
+
+/**
+ * @brief Read whatever a stream client has sent, and
+ * execute every complete line.
+ *
+ * @details This is only called once the client's earlier
+ * lines have all been executed, so everything in the
+ * buffer beyond the partial line left over from last time
+ * has been waiting since select() said the socket was
+ * readable, at the latest. If the read leaves anything in
+ * the kernel's socket buffer (SIOCINQ), that has been
+ * waiting since at least now, and the next read is dated
+ * from now rather than from whenever select() next wakes
+ * up, since the socket is not watched while the client is
+ * backlogged.
+ *
+ * @param symbol_table
+ * @param connection
+ * @param woke When select() returned.
+ * @return false if the client should be disconnected.
+ */
+static bool handle_stream(struct symbol_table_t* symbol_table, struct connection_t* connection, uint64_t woke) {
+    ssize_t bytes_received = recv(connection->socket, connection->input + connection->input_length, CONNECTION_INPUT_SIZE - connection->input_length, 0);
+
+    if (bytes_received == 0) {
+        return false;
+    }
+
+    if (bytes_received < 0) {
+        return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    }
+
+    metrics_record_request(bytes_received);
+
+    size_t scanned = connection->input_length;
+
+    int queued = 0;
+
+    connection->input_length += bytes_received;
+    connection->arrived = connection->readable ? connection->readable : woke;
+    connection->readable = 0;
+
+    if ((ioctl(connection->socket, SIOCINQ, &queued) == 0) && (queued > 0)) {
+        connection->readable = monotonic_nanoseconds();
+    }
+
+    return execute_stream(symbol_table, connection, scanned);
+}
+
+/**
+ * @brief This is the server's event loop. It waits for
+ * requests to arrive, executes them, and in between, keeps
+ * the expiry wheel turning.
+ *
+ * @details Requests arrive as UDP datagrams, or as lines on
+ * a TCP or Unix-domain stream. Active expiry is bounded to
+ * EXPIRY_BUDGET keys per tick. If the wheel falls behind,
+ * the loop polls the sockets without blocking until it has
+ * caught up, so that requests keep being served throughout
+ * a mass expiry. It does the same while any stream client
+ * has commands queued from an earlier pass.
+ *
+ * @param symbol_table
+ * @param options
+ */
+void serve(struct symbol_table_t* symbol_table, const struct server_options_t* options) {
+    frozen_table = options->frozen_table;
+
+    symbol_table->on_change = publish_change;
+    symbol_table->on_change_context = NULL;
+
+    if (frozen_table) {
+        metrics_set_frozen_table(frozen_table);
+    }
+
+    admission_configure(&options->admission);
+
+    int listener_socket = open_listener(options->port, SOCK_DGRAM);
+    int stream_socket = open_listener(options->port, SOCK_STREAM);
+    int unix_socket = -1;
+    int metrics_socket = -1;
+
+    FD_ZERO(&master);
+    watch_socket(listener_socket);
+    watch_socket(stream_socket);
+
+    if (options->socket_path) {
+        unix_socket = open_unix_listener(options->socket_path);
+        watch_socket(unix_socket);
+
+        keyvo_log(LOG_DEBUG, "Server listening on %s", options->socket_path);
+    }
+
+    if (options->metrics_port) {
+        metrics_socket = open_listener(options->metrics_port, SOCK_STREAM);
+        watch_socket(metrics_socket);
+
+        keyvo_log(LOG_DEBUG, "Serving metrics on port %s", options->metrics_port);
+    }
+
+    keyvo_log(LOG_DEBUG, "Server listening on port %s", options->port);
+
+    while (1) {
+        uint64_t now = monotonic_milliseconds();
+
+        placement_note_cpu();
+        symbol_table_expire(symbol_table, now, EXPIRY_BUDGET);
+
+        struct timeval interval = { 0, 0 };
+        struct timeval* timeout = &interval;
+
+        if (!timing_wheel_behind(&symbol_table->expiry, now)) {
+            if (symbol_table->expiry.count != 0) {
+                interval.tv_usec = EXPIRY_INTERVAL * 1000;
+            } else {
+                timeout = NULL;
+            }
+        }
+
+        fd_set reads = master;
+        fd_set writes;
+        FD_ZERO(&writes);
+
+        if ((metrics_client_count != 0) && (timeout == NULL)) {
+            interval.tv_sec = METRICS_TIMEOUT / 1000;
+            interval.tv_usec = (METRICS_TIMEOUT % 1000) * 1000;
+            timeout = &interval;
+        }
+
+        for (int socket = 0; socket <= max_socket; ++socket) {
+            struct connection_t* connection = connections[socket];
+
+            if (metrics_clients[socket] && (metrics_clients[socket]->reply != NULL)) {
+                FD_SET(socket, &writes);
+            }
+
+            if (connection == NULL) {
+                continue;
+            }
+
+            if (connection_pending_output(connection)) {
+                FD_SET(socket, &writes);
+            }
+
+            if (connection->backlogged || connection_output_backlogged(connection)) {
+                FD_CLR(socket, &reads);
+            }
+
+            if (connection_runnable(connection)) {
+                interval.tv_usec = 0;
+                timeout = &interval;
+            }
+        }
+
+        if (select(max_socket + 1, &reads, &writes, 0, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            keyvo_log(LOG_ERR, "Error in call to select(): %m");
+            exit(EXIT_FAILURE);
+        }
+
+        uint64_t woke = monotonic_nanoseconds();
+
+        if (FD_ISSET(listener_socket, &reads)) {
+            handle_datagram(symbol_table, listener_socket);
+        }
+
+        if (FD_ISSET(stream_socket, &reads)) {
+            accept_connection(stream_socket, CAPTURE_TCP);
+        }
+
+        if ((unix_socket != -1) && FD_ISSET(unix_socket, &reads)) {
+            accept_connection(unix_socket, CAPTURE_UNIX);
+        }
+
+        if ((metrics_socket != -1) && FD_ISSET(metrics_socket, &reads)) {
+            accept_metrics_client(metrics_socket, now);
+        }
+
+        for (int socket = 0; socket <= max_socket; ++socket) {
+            struct connection_t* connection = connections[socket];
+            struct metrics_client_t* scrape = metrics_clients[socket];
+
+            if (scrape) {
+                bool active = monotonic_milliseconds() < scrape->deadline;
+
+                if (active && FD_ISSET(socket, &writes)) {
+                    active = flush_metrics_client(scrape);
+                } else if (active && FD_ISSET(socket, &reads)) {
+                    active = handle_metrics_client(symbol_table, scrape);
+                }
+
+                if (!active) {
+                    drop_metrics_client(scrape);
+                }
+
+                continue;
+            }
+
+            if (connection == NULL) {
+                continue;
+            }
+
+            bool healthy = true;
+
+            if (FD_ISSET(socket, &writes)) {
+                healthy = connection_flush(connection);
+            }
+
+            if (healthy && FD_ISSET(socket, &reads)) {
+                healthy = handle_stream(symbol_table, connection, woke);
+            } else if (healthy && connection_runnable(connection)) {
+                healthy = execute_stream(symbol_table, connection, 0);
+            }
+
+            if (!healthy || connection->failed) {
+                drop_connection(connection);
+            }
+        }
+    }
+}
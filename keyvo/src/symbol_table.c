@@ -0,0 +1,757 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "symbol_table.h"
+
+/**
+ * @todo Implement hashing functionality.
+ *
+ * - gperf
+ * - sparsehash
+ * - libkeccak
+ * - mhash
+ * - xxhash
+ *
+ * - murmurhash3
+ * - jenkinshash
+ *
+ * For the moment, we are using 64-bit FNV-1a, which is
+ * trivial to implement and good enough for prototyping.
+ *
+ */
+static uint64_t hash_key(const char* key) {
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    for (const unsigned char* c = (const unsigned char*) key; *c; ++c) {
+        hash ^= *c;
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+/**
+ * @brief The number of buckets the symbol table starts out
+ * with. The bucket count is always a power of two.
+ *
+ */
+#define INITIAL_BUCKET_COUNT 16
+
+/**
+ * @brief Allocate a zero-initialized bucket array, bailing
+ * out of the process entirely if the allocation fails.
+ * Once the array reaches the size of a huge page, it is put
+ * on huge pages if they are enabled.
+ *
+ * @param bucket_count
+ * @return struct key_val_t**
+ */
+static struct key_val_t** allocate_buckets(size_t bucket_count) {
+    struct key_val_t** buckets = huge_pages_allocate(bucket_count * sizeof (struct key_val_t*));
+
+    if (buckets == NULL) {
+        keyvo_log(LOG_ERR, "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    return buckets;
+}
+
+/**
+ * @brief Allocate the ghost table, which remembers the
+ * hashes of recently-evicted keys.
+ *
+ * @param ghost_count
+ * @return uint64_t*
+ */
+static uint64_t* allocate_ghosts(size_t ghost_count) {
+    uint64_t* ghosts = huge_pages_allocate(ghost_count * sizeof (uint64_t));
+
+    if (ghosts == NULL) {
+        keyvo_log(LOG_ERR, "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    return ghosts;
+}
+
+/**
+ * @brief Return the number of bytes of metadata the table
+ * itself needs for a given number of buckets: the bucket
+ * array plus the ghost table, which is kept the same size.
+ *
+ * @param bucket_count
+ * @return size_t
+ */
+static inline size_t table_overhead(size_t bucket_count) {
+    return bucket_count * (sizeof (struct key_val_t*) + sizeof (uint64_t));
+}
+
+/**
+ * @brief This function is meant to be called one and only
+ * one time, simply for the purposes of allocating the
+ * initial memory to the symbol table. After that, the
+ * subroutine which will handle adding elements to the
+ * table will handle the necessary baggage to dynamically
+ * allocate memory for the symbol table.
+ *
+ * @param symbol_table
+ */
+void initialize_symbol_table(struct symbol_table_t* symbol_table) {
+    symbol_table->buckets = allocate_buckets(INITIAL_BUCKET_COUNT);
+    symbol_table->bucket_count = INITIAL_BUCKET_COUNT;
+    symbol_table->count = 0;
+
+    timing_wheel_initialize(&symbol_table->expiry, monotonic_milliseconds());
+
+    symbol_table->memory_used = table_overhead(INITIAL_BUCKET_COUNT);
+    symbol_table->memory_limit = 0;
+
+    memset(symbol_table->queues, 0, sizeof (symbol_table->queues));
+
+    symbol_table->ghosts = allocate_ghosts(INITIAL_BUCKET_COUNT);
+    symbol_table->ghost_count = INITIAL_BUCKET_COUNT;
+
+    symbol_table->hits = 0;
+    symbol_table->misses = 0;
+    symbol_table->evictions = 0;
+
+    symbol_table->version = 0;
+    symbol_table->on_change = NULL;
+    symbol_table->on_change_context = NULL;
+
+    object_pool_initialize(&symbol_table->entries, sizeof (struct key_val_t));
+}
+
+/**
+ * @brief Release an entry and the strings it owns.
+ *
+ * @param symbol_table
+ * @param key_val
+ */
+static void free_key_val(struct symbol_table_t* symbol_table, struct key_val_t* key_val) {
+    free(key_val->key);
+    free(key_val->val);
+    object_pool_release(&symbol_table->entries, key_val);
+}
+
+/**
+ * @brief Release every entry in the table, along with the
+ * bucket array itself.
+ *
+ * @param symbol_table
+ */
+void destroy_symbol_table(struct symbol_table_t* symbol_table) {
+    for (size_t i = 0; i < symbol_table->bucket_count; ++i) {
+        struct key_val_t* key_val = symbol_table->buckets[i];
+
+        while (key_val) {
+            struct key_val_t* next = key_val->next;
+            free_key_val(symbol_table, key_val);
+            key_val = next;
+        }
+    }
+
+    huge_pages_release(symbol_table->buckets, symbol_table->bucket_count * sizeof (struct key_val_t*));
+    huge_pages_release(symbol_table->ghosts, symbol_table->ghost_count * sizeof (uint64_t));
+    object_pool_destroy(&symbol_table->entries);
+
+    symbol_table->buckets = NULL;
+    symbol_table->bucket_count = 0;
+    symbol_table->count = 0;
+    symbol_table->ghosts = NULL;
+    symbol_table->ghost_count = 0;
+    symbol_table->memory_used = 0;
+}
+
+/**
+ * @brief Double the number of buckets once the table's load
+ * factor reaches one. Since every entry remembers its hash,
+ * this never has to look at the keys themselves.
+ *
+ * The ghost table grows along with the buckets, so that it
+ * can remember roughly as many evicted keys as the table
+ * holds. Its old contents are simply forgotten.
+ *
+ * @param symbol_table
+ */
+static void grow_symbol_table(struct symbol_table_t* symbol_table) {
+    size_t bucket_count = symbol_table->bucket_count * 2;
+    struct key_val_t** buckets = allocate_buckets(bucket_count);
+
+    for (size_t i = 0; i < symbol_table->bucket_count; ++i) {
+        struct key_val_t* key_val = symbol_table->buckets[i];
+
+        while (key_val) {
+            struct key_val_t* next = key_val->next;
+            size_t index = key_val->hash & (bucket_count - 1);
+
+            key_val->next = buckets[index];
+            buckets[index] = key_val;
+            key_val = next;
+        }
+    }
+
+    huge_pages_release(symbol_table->buckets, symbol_table->bucket_count * sizeof (struct key_val_t*));
+    huge_pages_release(symbol_table->ghosts, symbol_table->ghost_count * sizeof (uint64_t));
+
+    symbol_table->memory_used += table_overhead(bucket_count) - table_overhead(symbol_table->bucket_count);
+
+    symbol_table->buckets = buckets;
+    symbol_table->bucket_count = bucket_count;
+
+    symbol_table->ghosts = allocate_ghosts(bucket_count);
+    symbol_table->ghost_count = bucket_count;
+}
+
+/**
+ * @brief Find the link pointing at the entry for the given
+ * key, or at the terminating null pointer of its bucket if
+ * the key is not in the table. Returning the link rather
+ * than the entry lets callers unlink it in place.
+ *
+ * @param symbol_table
+ * @param key
+ * @param hash
+ * @return struct key_val_t**
+ */
+static struct key_val_t** find_link(struct symbol_table_t* symbol_table, const char* key, uint64_t hash) {
+    struct key_val_t** link = &symbol_table->buckets[hash & (symbol_table->bucket_count - 1)];
+
+    while (*link) {
+        if (((*link)->hash == hash) && (strcmp((*link)->key, key) == 0)) {
+            break;
+        }
+
+        link = &(*link)->next;
+    }
+
+    return link;
+}
+
+/**
+ * @brief Push an entry onto the head of one of the eviction
+ * queues.
+ *
+ * @param symbol_table
+ * @param key_val
+ * @param queue
+ */
+static void queue_push(struct symbol_table_t* symbol_table, struct key_val_t* key_val, enum eviction_queue_id_t queue) {
+    struct eviction_queue_t* q = &symbol_table->queues[queue];
+
+    key_val->queue = queue;
+    key_val->newer = NULL;
+    key_val->older = q->head;
+
+    if (q->head) {
+        q->head->newer = key_val;
+    } else {
+        q->tail = key_val;
+    }
+
+    q->head = key_val;
+    q->bytes += key_val->size;
+}
+
+/**
+ * @brief Unlink an entry from whichever eviction queue it
+ * is currently in.
+ *
+ * @param symbol_table
+ * @param key_val
+ */
+static void queue_remove(struct symbol_table_t* symbol_table, struct key_val_t* key_val) {
+    struct eviction_queue_t* q = &symbol_table->queues[key_val->queue];
+
+    if (key_val->newer) {
+        key_val->newer->older = key_val->older;
+    } else {
+        q->head = key_val->older;
+    }
+
+    if (key_val->older) {
+        key_val->older->newer = key_val->newer;
+    } else {
+        q->tail = key_val->newer;
+    }
+
+    q->bytes -= key_val->size;
+}
+
+/**
+ * @brief Remember that a key was evicted from the small
+ * queue without ever being accessed again.
+ *
+ * @details The ghost table is a direct-mapped array of key
+ * hashes, so a newer ghost simply overwrites an older one
+ * that happens to collide with it. That makes it a slightly
+ * forgetful FIFO, which is all S3-FIFO requires.
+ *
+ * @param symbol_table
+ * @param hash
+ */
+static void ghost_insert(struct symbol_table_t* symbol_table, uint64_t hash) {
+    symbol_table->ghosts[hash & (symbol_table->ghost_count - 1)] = hash | 1;
+}
+
+/**
+ * @brief Check whether a key was recently evicted, and if
+ * it was, forget about it.
+ *
+ * @param symbol_table
+ * @param hash
+ * @return true
+ * @return false
+ */
+static bool ghost_remove(struct symbol_table_t* symbol_table, uint64_t hash) {
+    uint64_t* ghost = &symbol_table->ghosts[hash & (symbol_table->ghost_count - 1)];
+
+    if (*ghost != (hash | 1)) {
+        return false;
+    }
+
+    *ghost = 0;
+    return true;
+}
+
+/**
+ * @brief Let whoever is listening know that a key has
+ * changed or gone away.
+ *
+ * @param symbol_table
+ * @param key
+ */
+static inline void notify_change(struct symbol_table_t* symbol_table, const char* key) {
+    if (symbol_table->on_change) {
+        symbol_table->on_change(symbol_table->on_change_context, key);
+    }
+}
+
+/**
+ * @brief Unlink the entry from its bucket, cancel its
+ * expiry timer if it has one, and free it.
+ *
+ * @param symbol_table
+ * @param link
+ */
+static void remove_key_val(struct symbol_table_t* symbol_table, struct key_val_t** link) {
+    struct key_val_t* key_val = *link;
+
+    notify_change(symbol_table, key_val->key);
+
+    *link = key_val->next;
+
+    timing_wheel_cancel(&symbol_table->expiry, &key_val->timer);
+    queue_remove(symbol_table, key_val);
+
+    symbol_table->memory_used -= key_val->size;
+    free_key_val(symbol_table, key_val);
+
+    --symbol_table->count;
+}
+
+/**
+ * @brief Evict a single entry to make room for new data,
+ * following the S3-FIFO policy.
+ *
+ * @details New keys start out in the small queue. When it
+ * is time to evict, if the small queue is over its share of
+ * the budget, its oldest entry is looked at first: if it
+ * was accessed while it was there, it is promoted to the
+ * main queue, and if not, it is evicted and its hash goes
+ * into the ghost table. Keys that come back while they are
+ * still in the ghost table go straight into the main queue.
+ * The main queue itself behaves like CLOCK: its oldest
+ * entry is reinserted at the head with one less access if
+ * it has been used, and evicted otherwise.
+ *
+ * This means one-hit wonders, such as those produced by a
+ * scan, leave the cache quickly without disturbing the
+ * working set, and a hit only ever costs a byte-sized
+ * increment instead of a linked-list update.
+ *
+ * The protected entry, if there is one, is never evicted.
+ * It is the entry whose growth triggered the eviction in
+ * the first place.
+ *
+ * @param symbol_table
+ * @param protected_key_val
+ * @return true
+ * @return false
+ */
+static bool evict_one(struct symbol_table_t* symbol_table, struct key_val_t* protected_key_val) {
+    struct eviction_queue_t* small_queue = &symbol_table->queues[QUEUE_SMALL];
+    struct eviction_queue_t* main_queue = &symbol_table->queues[QUEUE_MAIN];
+
+    size_t small_target = (symbol_table->memory_limit / 100) * SMALL_QUEUE_PERCENT;
+
+    while (small_queue->tail || main_queue->tail) {
+        bool from_small = small_queue->tail && ((small_queue->bytes >= small_target) || (main_queue->tail == NULL));
+        struct key_val_t* victim = from_small ? small_queue->tail : main_queue->tail;
+
+        if ((victim->frequency > 0) || (victim == protected_key_val)) {
+            queue_remove(symbol_table, victim);
+
+            if (from_small) {
+                victim->frequency = 0;
+            } else if (victim->frequency > 0) {
+                --victim->frequency;
+            }
+
+            queue_push(symbol_table, victim, QUEUE_MAIN);
+            continue;
+        }
+
+        if (from_small) {
+            ghost_insert(symbol_table, victim->hash);
+        }
+
+        remove_key_val(symbol_table, find_link(symbol_table, victim->key, victim->hash));
+        ++symbol_table->evictions;
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Evict entries until there is room for the given
+ * number of additional bytes within the memory budget.
+ * Without a budget, this does nothing.
+ *
+ * @param symbol_table
+ * @param incoming
+ * @param protected_key_val
+ */
+static void make_room(struct symbol_table_t* symbol_table, size_t incoming, struct key_val_t* protected_key_val) {
+    if (symbol_table->memory_limit == 0) {
+        return;
+    }
+
+    size_t keep = (protected_key_val != NULL) ? 1 : 0;
+
+    while ((symbol_table->memory_used + incoming > symbol_table->memory_limit) && (symbol_table->count > keep)) {
+        if (!evict_one(symbol_table, protected_key_val)) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Return the number of bytes an entry with the given
+ * key and value is charged against the memory budget.
+ *
+ * @param key
+ * @param val
+ * @return size_t
+ */
+static inline size_t key_val_size(const char* key, const char* val) {
+    return sizeof (struct key_val_t) + strlen(key) + 1 + strlen(val) + 1;
+}
+
+/**
+ * @brief Check whether an entry of the given size could
+ * ever fit within the memory budget.
+ *
+ * @param symbol_table
+ * @param size
+ * @return true
+ * @return false
+ */
+static inline bool fits_in_budget(const struct symbol_table_t* symbol_table, size_t size) {
+    return (symbol_table->memory_limit == 0) || (size + table_overhead(symbol_table->bucket_count) <= symbol_table->memory_limit);
+}
+
+/**
+ * @brief Check whether the entry's time-to-live has run
+ * out as of the given time.
+ *
+ * @param key_val
+ * @param now
+ * @return true
+ * @return false
+ */
+static inline bool is_expired(const struct key_val_t* key_val, uint64_t now) {
+    return (key_val->expires_at != 0) && (key_val->expires_at <= now);
+}
+
+/**
+ * @brief Look up the link for a key, lazily removing the
+ * entry if it turns out to have already expired. This way
+ * an expired key is never visible, no matter how far behind
+ * the active-expiry pass happens to be.
+ *
+ * @param symbol_table
+ * @param key
+ * @param now
+ * @return struct key_val_t**
+ */
+static struct key_val_t** find_live_link(struct symbol_table_t* symbol_table, const char* key, uint64_t now) {
+    uint64_t hash = hash_key(key);
+    struct key_val_t** link = find_link(symbol_table, key, hash);
+
+    /**
+     * @brief Removing the entry leaves the link pointing at
+     * the next entry in the bucket, which belongs to some
+     * other key, so look the key up again.
+     *
+     */
+    if (*link && is_expired(*link, now)) {
+        remove_key_val(symbol_table, link);
+        link = find_link(symbol_table, key, hash);
+    }
+
+    return link;
+}
+
+/**
+ * @brief Set or clear the expiry time of an entry, keeping
+ * its timer in the expiry wheel in sync.
+ *
+ * @details A time-to-live so long that the expiry time
+ * would not fit in 64 bits is as good as none at all, and
+ * is treated that way rather than being allowed to wrap
+ * round into the past.
+ *
+ * @param symbol_table
+ * @param key_val
+ * @param ttl
+ * @param now
+ */
+static void set_expiry(struct symbol_table_t* symbol_table, struct key_val_t* key_val, uint64_t ttl, uint64_t now) {
+    if ((ttl == SYMBOL_TABLE_NO_TTL) || (ttl > UINT64_MAX - now)) {
+        key_val->expires_at = 0;
+        timing_wheel_cancel(&symbol_table->expiry, &key_val->timer);
+        return;
+    }
+
+    key_val->expires_at = now + ttl;
+    timing_wheel_schedule(&symbol_table->expiry, &key_val->timer, key_val->expires_at);
+}
+
+/**
+ * @brief Duplicate a string, treating allocation failure
+ * the same way as the rest of the symbol table does.
+ *
+ * @param s
+ * @return char*
+ */
+static char* duplicate_string(const char* s) {
+    char* copy = strdup(s);
+
+    if (copy == NULL) {
+        keyvo_log(LOG_ERR, "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    return copy;
+}
+
+/**
+ * @brief Return the entry for the given key, or NULL if
+ * the key is not defined or has expired.
+ *
+ * @details A hit is recorded by bumping the entry's access
+ * count, which is all the eviction policy needs to know.
+ *
+ * @param symbol_table
+ * @param key
+ * @param now
+ * @return struct key_val_t*
+ */
+struct key_val_t* symbol_table_lookup(struct symbol_table_t* symbol_table, const char* key, uint64_t now) {
+    struct key_val_t* key_val = *find_live_link(symbol_table, key, now);
+
+    if (key_val == NULL) {
+        ++symbol_table->misses;
+        return NULL;
+    }
+
+    if (key_val->frequency < MAXIMUM_FREQUENCY) {
+        ++key_val->frequency;
+    }
+
+    ++symbol_table->hits;
+
+    return key_val;
+}
+
+/**
+ * @brief Add a new key to the table. A key that is already
+ * defined is left untouched; use symbol_table_update() to
+ * change it instead.
+ *
+ * @details If the table has a memory budget, other keys are
+ * evicted as needed to make room for the new one.
+ *
+ * @param symbol_table
+ * @param key
+ * @param val
+ * @param ttl Time-to-live in milliseconds, or SYMBOL_TABLE_NO_TTL.
+ * @param now
+ * @return enum symbol_table_status_t
+ */
+enum symbol_table_status_t symbol_table_define(struct symbol_table_t* symbol_table, const char* key, const char* val, uint64_t ttl, uint64_t now) {
+    if (*find_live_link(symbol_table, key, now)) {
+        return SYMBOL_TABLE_EXISTS;
+    }
+
+    size_t size = key_val_size(key, val);
+
+    if (!fits_in_budget(symbol_table, size)) {
+        return SYMBOL_TABLE_TOO_LARGE;
+    }
+
+    if (symbol_table->count >= symbol_table->bucket_count) {
+        grow_symbol_table(symbol_table);
+    }
+
+    make_room(symbol_table, size, NULL);
+
+    struct key_val_t* key_val = object_pool_allocate(&symbol_table->entries);
+
+    if (key_val == NULL) {
+        keyvo_log(LOG_ERR, "Memory-allocation failure.");
+        exit(EXIT_FAILURE);
+    }
+
+    key_val->key = duplicate_string(key);
+    key_val->val = duplicate_string(val);
+    key_val->hash = hash_key(key);
+    key_val->expires_at = 0;
+    key_val->size = size;
+    key_val->frequency = 0;
+    key_val->version = ++symbol_table->version;
+    timer_initialize(&key_val->timer);
+
+    size_t index = key_val->hash & (symbol_table->bucket_count - 1);
+    key_val->next = symbol_table->buckets[index];
+    symbol_table->buckets[index] = key_val;
+    ++symbol_table->count;
+
+    symbol_table->memory_used += size;
+    queue_push(symbol_table, key_val, ghost_remove(symbol_table, key_val->hash) ? QUEUE_MAIN : QUEUE_SMALL);
+
+    set_expiry(symbol_table, key_val, ttl, now);
+
+    return SYMBOL_TABLE_OK;
+}
+
+/**
+ * @brief Change the value of a key that is already defined.
+ *
+ * @details If a time-to-live is given, it replaces the
+ * key's current one. Otherwise the key keeps whatever
+ * expiry time it already had, so that updating a setting
+ * does not accidentally make it permanent.
+ *
+ * Growing a value can push the table over its memory
+ * budget, in which case other keys are evicted; the key
+ * being updated is never the one to go.
+ *
+ * @param symbol_table
+ * @param key
+ * @param val
+ * @param ttl Time-to-live in milliseconds, or SYMBOL_TABLE_NO_TTL.
+ * @param now
+ * @return enum symbol_table_status_t
+ */
+enum symbol_table_status_t symbol_table_update(struct symbol_table_t* symbol_table, const char* key, const char* val, uint64_t ttl, uint64_t now) {
+    struct key_val_t* key_val = *find_live_link(symbol_table, key, now);
+
+    if (key_val == NULL) {
+        return SYMBOL_TABLE_NOT_FOUND;
+    }
+
+    size_t size = key_val_size(key, val);
+
+    if (!fits_in_budget(symbol_table, size)) {
+        return SYMBOL_TABLE_TOO_LARGE;
+    }
+
+    char* copy = duplicate_string(val);
+    free(key_val->val);
+    key_val->val = copy;
+    key_val->version = ++symbol_table->version;
+
+    symbol_table->queues[key_val->queue].bytes += size - key_val->size;
+    symbol_table->memory_used += size - key_val->size;
+    key_val->size = size;
+
+    make_room(symbol_table, 0, key_val);
+
+    if (ttl != SYMBOL_TABLE_NO_TTL) {
+        set_expiry(symbol_table, key_val, ttl, now);
+    }
+
+    notify_change(symbol_table, key);
+
+    return SYMBOL_TABLE_OK;
+}
+
+/**
+ * @brief Remove a key from the table.
+ *
+ * @param symbol_table
+ * @param key
+ * @param now
+ * @return enum symbol_table_status_t
+ */
+enum symbol_table_status_t symbol_table_drop(struct symbol_table_t* symbol_table, const char* key, uint64_t now) {
+    struct key_val_t** link = find_live_link(symbol_table, key, now);
+
+    if (*link == NULL) {
+        return SYMBOL_TABLE_NOT_FOUND;
+    }
+
+    remove_key_val(symbol_table, link);
+
+    return SYMBOL_TABLE_OK;
+}
+
+/**
+ * @brief Expiry-wheel callback which removes the entry that
+ * owns the timer that just fired.
+ *
+ * @param timer
+ * @param context
+ */
+static void expire_key_val(struct wheel_timer_t* timer, void* context) {
+    struct symbol_table_t* symbol_table = context;
+    struct key_val_t* key_val = (struct key_val_t*) ((char*) timer - offsetof(struct key_val_t, timer));
+
+    remove_key_val(symbol_table, find_link(symbol_table, key_val->key, key_val->hash));
+}
+
+/**
+ * @brief Actively expire keys whose time-to-live has run
+ * out, doing at most a bounded amount of work.
+ *
+ * @details This is meant to be called once per tick of the
+ * event loop. Keys are also expired lazily whenever they
+ * are accessed, so this pass exists only to reclaim the
+ * memory of keys nobody is asking for anymore, and it is
+ * fine for it to fall behind during a burst of expirations.
+ *
+ * @param symbol_table
+ * @param now
+ * @param budget
+ * @return The number of keys that were expired.
+ */
+size_t symbol_table_expire(struct symbol_table_t* symbol_table, uint64_t now, size_t budget) {
+    return timing_wheel_advance(&symbol_table->expiry, now, budget, expire_key_val, symbol_table);
+}
@@ -0,0 +1,290 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "timing_wheel.h"
+
+/**
+ * @brief The largest distance into the future a timer can
+ * be filed at directly. Anything beyond this is clamped to
+ * the top level and re-filed when that slot cascades.
+ *
+ */
+#define TIMING_WHEEL_HORIZON ((UINT64_C(1) << (TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOT_BITS)) - 1)
+
+/**
+ * @brief Return the number of ticks covered by a single slot
+ * at the given level of the wheel.
+ *
+ * @param level
+ * @return uint64_t
+ */
+static inline uint64_t level_granularity(unsigned int level) {
+    return UINT64_C(1) << (level * TIMING_WHEEL_SLOT_BITS);
+}
+
+/**
+ * @brief Initialize every slot of the wheel to an empty
+ * circular list, and set the wheel's notion of the current
+ * time.
+ *
+ * @param wheel
+ * @param now
+ */
+void timing_wheel_initialize(struct timing_wheel_t* wheel, uint64_t now) {
+    wheel->current = now;
+    wheel->count = 0;
+
+    for (unsigned int level = 0; level < TIMING_WHEEL_LEVELS; ++level) {
+        wheel->occupied[level] = 0;
+
+        for (unsigned int slot = 0; slot < TIMING_WHEEL_SLOTS; ++slot) {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+}
+
+/**
+ * @brief Mark a freshly-embedded timer as not scheduled.
+ *
+ * @param timer
+ */
+void timer_initialize(struct wheel_timer_t* timer) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->level = 0;
+    timer->slot = 0;
+}
+
+/**
+ * @brief Unlink a timer from whichever slot it is in,
+ * clearing the slot's occupancy bit if it is now empty.
+ *
+ * @param wheel
+ * @param timer
+ */
+static void unlink_timer(struct timing_wheel_t* wheel, struct wheel_timer_t* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+
+    struct wheel_timer_t* head = &wheel->slots[timer->level][timer->slot];
+
+    if (head->next == head) {
+        wheel->occupied[timer->level] &= ~(UINT64_C(1) << timer->slot);
+    }
+
+    timer->next = NULL;
+    timer->prev = NULL;
+    --wheel->count;
+}
+
+/**
+ * @brief File a timer into the slot corresponding to its
+ * expiration tick, relative to the wheel's current tick.
+ *
+ * @details The level is chosen by how far in the future
+ * the timer expires, and the slot is chosen by that level's
+ * six bits of the expiration tick. Timers that are already
+ * due land in the slot for the current tick, so they are
+ * picked up the next time the wheel is advanced.
+ *
+ * @param wheel
+ * @param timer
+ */
+static void file_timer(struct timing_wheel_t* wheel, struct wheel_timer_t* timer) {
+    uint64_t expires = timer->expires;
+
+    if (expires < wheel->current) {
+        expires = wheel->current;
+    }
+
+    if (expires - wheel->current > TIMING_WHEEL_HORIZON) {
+        expires = wheel->current + TIMING_WHEEL_HORIZON;
+    }
+
+    uint64_t delta = expires - wheel->current;
+    unsigned int level = 0;
+
+    while ((level < TIMING_WHEEL_LEVELS - 1) && (delta >= level_granularity(level + 1))) {
+        ++level;
+    }
+
+    unsigned int slot = (expires >> (level * TIMING_WHEEL_SLOT_BITS)) & TIMING_WHEEL_SLOT_MASK;
+    struct wheel_timer_t* head = &wheel->slots[level][slot];
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+
+    wheel->occupied[level] |= UINT64_C(1) << slot;
+    ++wheel->count;
+}
+
+/**
+ * @brief Schedule the timer to fire at the given tick. If
+ * the timer is already scheduled, it is simply moved.
+ *
+ * @param wheel
+ * @param timer
+ * @param expires
+ */
+void timing_wheel_schedule(struct timing_wheel_t* wheel, struct wheel_timer_t* timer, uint64_t expires) {
+    if (timer_pending(timer)) {
+        unlink_timer(wheel, timer);
+    }
+
+    timer->expires = expires;
+    file_timer(wheel, timer);
+}
+
+/**
+ * @brief Remove the timer from the wheel without firing it.
+ * Cancelling a timer that is not scheduled is a no-op.
+ *
+ * @param wheel
+ * @param timer
+ */
+void timing_wheel_cancel(struct timing_wheel_t* wheel, struct wheel_timer_t* timer) {
+    if (timer_pending(timer)) {
+        unlink_timer(wheel, timer);
+    }
+}
+
+/**
+ * @brief Move the timers in the given higher-level slot
+ * down to the levels that now correspond to them.
+ *
+ * @return The amount of budget still left over.
+ */
+static size_t cascade(struct timing_wheel_t* wheel, unsigned int level, unsigned int slot, size_t budget) {
+    struct wheel_timer_t* head = &wheel->slots[level][slot];
+
+    while ((head->next != head) && (budget != 0)) {
+        struct wheel_timer_t* timer = head->next;
+
+        unlink_timer(wheel, timer);
+        file_timer(wheel, timer);
+        --budget;
+    }
+
+    return budget;
+}
+
+/**
+ * @brief Advance the wheel up to and including the given
+ * tick, firing every timer that has come due.
+ *
+ * @details Every timer fired or moved between levels costs
+ * one unit of the budget. Once the budget is spent, the
+ * wheel stops without moving past the tick it was working
+ * on; since cascading is idempotent, the next call simply
+ * finishes that tick off before moving on. Use the
+ * timing_wheel_behind() predicate to find out whether there
+ * is any work left over.
+ *
+ * When the lowest levels of the wheel are empty, there is
+ * nothing to do until the next time a non-empty level
+ * cascades, so the wheel skips straight to it rather than
+ * walking every idle millisecond.
+ *
+ * @param wheel
+ * @param now
+ * @param budget
+ * @param expire
+ * @param context
+ * @return The number of timers that fired.
+ */
+size_t timing_wheel_advance(struct timing_wheel_t* wheel, uint64_t now, size_t budget, timer_callback_t expire, void* context) {
+    size_t expired = 0;
+
+    while (wheel->current <= now) {
+        if (wheel->count == 0) {
+            wheel->current = now + 1;
+            break;
+        }
+
+        uint64_t tick = wheel->current;
+
+        /**
+         * @brief Cascade from the top down, so that timers
+         * coming out of a high level can land in a lower
+         * level's slot that is about to be cascaded itself.
+         *
+         */
+        for (unsigned int level = TIMING_WHEEL_LEVELS - 1; level > 0; --level) {
+            if ((tick & (level_granularity(level) - 1)) != 0) {
+                continue;
+            }
+
+            unsigned int slot = (tick >> (level * TIMING_WHEEL_SLOT_BITS)) & TIMING_WHEEL_SLOT_MASK;
+
+            if ((budget = cascade(wheel, level, slot, budget)) == 0) {
+                return expired;
+            }
+        }
+
+        struct wheel_timer_t* head = &wheel->slots[0][tick & TIMING_WHEEL_SLOT_MASK];
+
+        while (head->next != head) {
+            if (budget == 0) {
+                return expired;
+            }
+
+            struct wheel_timer_t* timer = head->next;
+            unlink_timer(wheel, timer);
+            --budget;
+
+            /**
+             * @brief A timer that was clamped to the
+             * horizon is not actually due yet; re-file it.
+             *
+             */
+            if (timer->expires > tick) {
+                file_timer(wheel, timer);
+                continue;
+            }
+
+            expire(timer, context);
+            ++expired;
+        }
+
+        /**
+         * @brief Skip ahead to the next tick where there
+         * could possibly be anything to do, which is the
+         * next time the lowest non-empty level cascades.
+         *
+         */
+        unsigned int level = 0;
+
+        while ((level < TIMING_WHEEL_LEVELS) && (wheel->occupied[level] == 0)) {
+            ++level;
+        }
+
+        if ((level == 0) || (level == TIMING_WHEEL_LEVELS)) {
+            wheel->current = tick + 1;
+        } else {
+            uint64_t granularity = level_granularity(level);
+            uint64_t next = (tick + granularity) & ~(granularity - 1);
+
+            wheel->current = (next > now + 1) ? now + 1 : next;
+        }
+    }
+
+    return expired;
+}
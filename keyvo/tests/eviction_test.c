@@ -0,0 +1,202 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "symbol_table.h"
+
+/**
+ * @brief How many entries fit in the test's memory budget.
+ *
+ */
+#define EVICTION_TEST_CAPACITY 10
+
+/**
+ * @brief The keys that have been evicted, in order, as
+ * reported by the symbol table's change callback.
+ *
+ */
+struct eviction_log_t {
+    size_t count;
+    char keys[64][8];
+};
+
+/**
+ * @brief Report a failed check and bail out.
+ *
+ * @param message
+ */
+static void fail(const char* message) {
+    fprintf(stderr, "eviction_test: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Change callback: log every key that goes away.
+ *
+ * @param context
+ * @param key
+ */
+static void record_eviction(void* context, const char* key) {
+    struct eviction_log_t* log = context;
+
+    if (log->count == sizeof (log->keys) / sizeof (log->keys[0])) {
+        fail("Too many keys were evicted.");
+    }
+
+    snprintf(log->keys[log->count++], sizeof (log->keys[0]), "%s", key);
+}
+
+/**
+ * @brief Define a key, failing the test if it cannot be.
+ *
+ * @param symbol_table
+ * @param key
+ */
+static void define(struct symbol_table_t* symbol_table, const char* key) {
+    if (symbol_table_define(symbol_table, key, "value", SYMBOL_TABLE_NO_TTL, 0) != SYMBOL_TABLE_OK) {
+        fail("Could not define a key.");
+    }
+}
+
+/**
+ * @brief Run the S3-FIFO eviction checks against a table
+ * with room for EVICTION_TEST_CAPACITY entries.
+ *
+ * @details Five hot keys, each read once, and five cold
+ * keys fill the table. Every further cold key must push out
+ * the oldest cold key, while the hot keys are promoted to
+ * the main queue and kept. A cold key that comes back while
+ * it is still remembered in the ghost table must go
+ * straight into the main queue, and a brand-new key into
+ * the small one. Finally, once every key has been dropped,
+ * no memory may still be charged for entries.
+ *
+ * Every key is the same length, so every entry costs the
+ * same, which the test measures rather than assumes.
+ *
+ * @return int
+ */
+int main(void) {
+    struct symbol_table_t symbol_table;
+    struct eviction_log_t log = { 0 };
+    char key[8];
+
+    initialize_symbol_table(&symbol_table);
+
+    size_t overhead = symbol_table.memory_used;
+    size_t bucket_count = symbol_table.bucket_count;
+
+    define(&symbol_table, "h00");
+
+    size_t entry_size = symbol_table.memory_used - overhead;
+
+    symbol_table.memory_limit = overhead + (EVICTION_TEST_CAPACITY * entry_size);
+
+    for (int i = 1; i < 5; ++i) {
+        snprintf(key, sizeof (key), "h%02d", i);
+        define(&symbol_table, key);
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        snprintf(key, sizeof (key), "h%02d", i);
+
+        if (symbol_table_lookup(&symbol_table, key, 0) == NULL) {
+            fail("A hot key is missing.");
+        }
+    }
+
+    symbol_table.on_change = record_eviction;
+    symbol_table.on_change_context = &log;
+
+    for (int i = 0; i < 25; ++i) {
+        snprintf(key, sizeof (key), "c%02d", i);
+        define(&symbol_table, key);
+    }
+
+    if ((log.count != 20) || (symbol_table.evictions != 20) || (symbol_table.count != EVICTION_TEST_CAPACITY)) {
+        fail("The wrong number of keys were evicted.");
+    }
+
+    for (int i = 0; i < 20; ++i) {
+        snprintf(key, sizeof (key), "c%02d", i);
+
+        if (strcmp(log.keys[i], key) != 0) {
+            fail("Something other than the oldest cold key was evicted.");
+        }
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        snprintf(key, sizeof (key), "h%02d", i);
+
+        struct key_val_t* key_val = symbol_table_lookup(&symbol_table, key, 0);
+
+        if ((key_val == NULL) || (key_val->queue != QUEUE_MAIN)) {
+            fail("A hot key was not promoted to the main queue.");
+        }
+    }
+
+    struct key_val_t* hot = NULL;
+
+    for (int i = 0; i < 2 * MAXIMUM_FREQUENCY; ++i) {
+        hot = symbol_table_lookup(&symbol_table, "h00", 0);
+    }
+
+    if (hot->frequency != MAXIMUM_FREQUENCY) {
+        fail("The access count did not saturate.");
+    }
+
+    /**
+     * @brief The ghost table is direct-mapped, so evicting
+     * yet another key to make room could overwrite the
+     * ghost being tested. Drop one instead.
+     *
+     */
+    symbol_table_drop(&symbol_table, "c24", 0);
+    define(&symbol_table, "c19");
+
+    if ((symbol_table_lookup(&symbol_table, "c19", 0) == NULL) || (symbol_table_lookup(&symbol_table, "c19", 0)->queue != QUEUE_MAIN)) {
+        fail("A key that came back from the ghost table did not go to the main queue.");
+    }
+
+    define(&symbol_table, "f00");
+
+    if (symbol_table_lookup(&symbol_table, "f00", 0)->queue != QUEUE_SMALL) {
+        fail("A brand-new key did not go to the small queue.");
+    }
+
+    symbol_table.on_change = NULL;
+
+    static const char* const prefixes[] = { "h", "c", "f" };
+
+    for (size_t p = 0; p < sizeof (prefixes) / sizeof (prefixes[0]); ++p) {
+        for (int i = 0; i < 25; ++i) {
+            snprintf(key, sizeof (key), "%s%02d", prefixes[p], i);
+            symbol_table_drop(&symbol_table, key, 0);
+        }
+    }
+
+    if (symbol_table.bucket_count != bucket_count) {
+        fail("The table grew, so its overhead is no longer known.");
+    }
+
+    if ((symbol_table.count != 0) || (symbol_table.memory_used != overhead) || (symbol_table.queues[QUEUE_SMALL].bytes != 0) || (symbol_table.queues[QUEUE_MAIN].bytes != 0)) {
+        fail("Memory is still charged for entries after every key was dropped.");
+    }
+
+    destroy_symbol_table(&symbol_table);
+
+    printf("Eviction tests passed.\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "frozen_table.h"
+
+/**
+ * @brief The number of keys to freeze. A few million keys
+ * is where a table with no spare slots starts running out
+ * of seeds for its last few buckets.
+ *
+ */
+#ifndef FROZEN_TABLE_TEST_KEYS
+#define FROZEN_TABLE_TEST_KEYS 4000000
+#endif
+
+/**
+ * @brief Report a failed check and bail out.
+ *
+ * @param message
+ */
+static void fail(const char* message) {
+    fprintf(stderr, "frozen_table_test: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Freeze a large symbol table, then look up every
+ * key in it, along with as many keys that are not.
+ *
+ * @return int
+ */
+int main(void) {
+    struct symbol_table_t symbol_table;
+    struct frozen_table_t frozen_table;
+    char key[32];
+    char val[32];
+
+    initialize_symbol_table(&symbol_table);
+
+    for (size_t i = 0; i < FROZEN_TABLE_TEST_KEYS; ++i) {
+        snprintf(key, sizeof (key), "key:%zu", i);
+        snprintf(val, sizeof (val), "%zu", i * 7);
+
+        if (symbol_table_define(&symbol_table, key, val, SYMBOL_TABLE_NO_TTL, 0) != SYMBOL_TABLE_OK) {
+            fail("Could not define a key.");
+        }
+    }
+
+    if (!frozen_table_build(&frozen_table, &symbol_table)) {
+        fail("Could not build the frozen table.");
+    }
+
+    if ((frozen_table.count != FROZEN_TABLE_TEST_KEYS) || (frozen_table.slot_count < frozen_table.count)) {
+        fail("The frozen table has the wrong shape.");
+    }
+
+    for (size_t i = 0; i < FROZEN_TABLE_TEST_KEYS; ++i) {
+        snprintf(key, sizeof (key), "key:%zu", i);
+        snprintf(val, sizeof (val), "%zu", i * 7);
+
+        const char* found = frozen_table_lookup(&frozen_table, key);
+
+        if ((found == NULL) || (strcmp(found, val) != 0)) {
+            fail("A frozen key is missing or has the wrong value.");
+        }
+
+        snprintf(key, sizeof (key), "missing:%zu", i);
+
+        if (frozen_table_lookup(&frozen_table, key) != NULL) {
+            fail("A key that was never defined was found.");
+        }
+    }
+
+    printf("Froze and found %zu keys in %zu slots.\n", frozen_table.count, frozen_table.slot_count);
+
+    frozen_table_destroy(&frozen_table);
+    destroy_symbol_table(&symbol_table);
+
+    return EXIT_SUCCESS;
+}
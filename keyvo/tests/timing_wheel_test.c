@@ -0,0 +1,412 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "symbol_table.h"
+
+/**
+ * @brief How many timers the randomized test schedules.
+ *
+ */
+#ifndef TIMING_WHEEL_TEST_TIMERS
+#define TIMING_WHEEL_TEST_TIMERS 20000
+#endif
+
+/**
+ * @brief A timer, and what the test knows about it.
+ *
+ */
+struct test_timer_t {
+    struct wheel_timer_t timer;
+    bool cancelled;
+    bool fired;
+};
+
+/**
+ * @brief Everything the expiry callback checks its timers
+ * against.
+ *
+ * @details Every advance call fires exactly the timers
+ * that came due after the previous call's time, up to and
+ * including its own, and it fires them in order.
+ *
+ */
+struct expiry_log_t {
+    uint64_t previous;
+    uint64_t now;
+    uint64_t last;
+    size_t fired;
+    const struct test_timer_t** order;
+};
+
+/**
+ * @brief Report a failed check and bail out.
+ *
+ * @param message
+ */
+static void fail(const char* message) {
+    fprintf(stderr, "timing_wheel_test: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Expiry callback: check that the timer is due, has
+ * not fired too early or twice, and comes no earlier than
+ * the last one to fire, then log it.
+ *
+ * @param timer
+ * @param context
+ */
+static void record_expiry(struct wheel_timer_t* timer, void* context) {
+    struct expiry_log_t* log = context;
+    struct test_timer_t* test_timer = (struct test_timer_t*) timer;
+
+    if (test_timer->cancelled || test_timer->fired) {
+        fail("A cancelled timer fired, or a timer fired twice.");
+    }
+
+    if ((timer->expires > log->now) || (timer->expires <= log->previous)) {
+        fail("A timer fired in the wrong advance call.");
+    }
+
+    if (timer->expires < log->last) {
+        fail("Timers fired out of order.");
+    }
+
+    test_timer->fired = true;
+    log->last = timer->expires;
+
+    if (log->order) {
+        log->order[log->fired] = test_timer;
+    }
+
+    ++log->fired;
+}
+
+/**
+ * @brief Advance the wheel to the given time with an
+ * unlimited budget.
+ *
+ * @param wheel
+ * @param log
+ * @param now
+ */
+static void advance(struct timing_wheel_t* wheel, struct expiry_log_t* log, uint64_t now) {
+    log->now = now;
+    timing_wheel_advance(wheel, now, SIZE_MAX, record_expiry, log);
+    log->previous = now;
+
+    if (timing_wheel_behind(wheel, now)) {
+        fail("The wheel fell behind with an unlimited budget.");
+    }
+}
+
+/**
+ * @brief Schedule one timer at the edges of every level,
+ * and past the wheel's horizon, then advance one tick at a
+ * time for a while, and in large jumps after that. Every
+ * timer must land on the expected level, and fire exactly
+ * when it is due, in order.
+ *
+ */
+static void test_levels(void) {
+    static const struct {
+        uint64_t delta;
+        uint8_t level;
+    } cases[] = {
+        { 0, 0 }, { 1, 0 }, { 63, 0 },
+        { 64, 1 }, { 65, 1 }, { 4095, 1 },
+        { 4096, 2 }, { 4097, 2 }, { 262143, 2 },
+        { 262144, 3 }, { 262145, 3 }, { 16777215, 3 },
+        { 16777216, 4 }, { 16777217, 4 }, { (UINT64_C(1) << 30) - 1, 4 },
+        { (UINT64_C(1) << 30) + 10, 4 }, { UINT64_C(3) << 30, 4 }
+    };
+
+    enum { COUNT = sizeof (cases) / sizeof (cases[0]) };
+
+    static struct timing_wheel_t wheel;
+    struct test_timer_t timers[COUNT];
+    const struct test_timer_t* order[COUNT];
+
+    uint64_t start = 1000003;
+    struct expiry_log_t log = { start - 1, start, 0, 0, order };
+
+    timing_wheel_initialize(&wheel, start);
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        timer_initialize(&timers[i].timer);
+        timers[i].cancelled = false;
+        timers[i].fired = false;
+
+        timing_wheel_schedule(&wheel, &timers[i].timer, start + cases[i].delta);
+
+        if (timers[i].timer.level != cases[i].level) {
+            fail("A timer was filed on the wrong level.");
+        }
+    }
+
+    if (wheel.count != COUNT) {
+        fail("The wheel lost count of its timers.");
+    }
+
+    for (uint64_t now = start; now < start + 5000; ++now) {
+        advance(&wheel, &log, now);
+    }
+
+    if (log.fired != 8) {
+        fail("The wrong number of timers fired one tick at a time.");
+    }
+
+    static const uint64_t jumps[] = { 262144, 300000, 16777216, 20000000, UINT64_C(1) << 30, (UINT64_C(1) << 30) + 10, UINT64_C(3) << 30 };
+
+    for (size_t j = 0; j < sizeof (jumps) / sizeof (jumps[0]); ++j) {
+        advance(&wheel, &log, start + jumps[j]);
+    }
+
+    if ((log.fired != COUNT) || (wheel.count != 0)) {
+        fail("The wrong number of timers fired in large jumps.");
+    }
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        if (order[i] != &timers[i]) {
+            fail("Timers fired in the wrong order.");
+        }
+    }
+
+    if (wheel.current != start + jumps[sizeof (jumps) / sizeof (jumps[0]) - 1] + 1) {
+        fail("An empty wheel did not catch up with the clock.");
+    }
+}
+
+/**
+ * @brief A small linear congruential generator, so that
+ * every run of the test is the same.
+ *
+ * @param state
+ * @return uint64_t
+ */
+static uint64_t next_random(uint64_t* state) {
+    *state = (*state * UINT64_C(6364136223846793005)) + UINT64_C(1442695040888963407);
+
+    return *state >> 33;
+}
+
+/**
+ * @brief Schedule timers at random distances spread over
+ * every level, cancel and reschedule some of them, and
+ * advance by a mix of single ticks and random jumps of up
+ * to a few hours.
+ *
+ */
+static void test_random(void) {
+    static struct timing_wheel_t wheel;
+    static struct test_timer_t timers[TIMING_WHEEL_TEST_TIMERS];
+
+    uint64_t state = 42;
+    uint64_t start = 77;
+    struct expiry_log_t log = { start - 1, start, 0, 0, NULL };
+    size_t cancelled = 0;
+
+    timing_wheel_initialize(&wheel, start);
+
+    for (size_t i = 0; i < TIMING_WHEEL_TEST_TIMERS; ++i) {
+        unsigned int level = next_random(&state) % TIMING_WHEEL_LEVELS;
+        uint64_t delta = next_random(&state) % (UINT64_C(1) << ((level + 1) * TIMING_WHEEL_SLOT_BITS));
+
+        timer_initialize(&timers[i].timer);
+        timers[i].cancelled = false;
+        timers[i].fired = false;
+
+        timing_wheel_schedule(&wheel, &timers[i].timer, start + delta);
+    }
+
+    for (size_t i = 0; i < TIMING_WHEEL_TEST_TIMERS; i += 11) {
+        timing_wheel_schedule(&wheel, &timers[i].timer, start + (next_random(&state) % 100000));
+    }
+
+    for (size_t i = 0; i < TIMING_WHEEL_TEST_TIMERS; i += 7) {
+        timing_wheel_cancel(&wheel, &timers[i].timer);
+        timers[i].cancelled = true;
+        ++cancelled;
+    }
+
+    uint64_t now = start;
+
+    while (wheel.count != 0) {
+        for (size_t step = 0; step < 200; ++step) {
+            advance(&wheel, &log, now++);
+        }
+
+        now += next_random(&state) % (UINT64_C(1) << (next_random(&state) % 24));
+        advance(&wheel, &log, now++);
+    }
+
+    if (log.fired != TIMING_WHEEL_TEST_TIMERS - cancelled) {
+        fail("The wrong number of random timers fired.");
+    }
+
+    for (size_t i = 0; i < TIMING_WHEEL_TEST_TIMERS; ++i) {
+        if (timers[i].fired == timers[i].cancelled) {
+            fail("A random timer neither fired nor was cancelled.");
+        }
+    }
+}
+
+/**
+ * @brief Check that a budgeted advance stops exactly where
+ * its budget runs out, reports that it is behind, and
+ * picks up where it left off, including halfway through
+ * cascading a slot.
+ *
+ */
+static void test_budget(void) {
+    enum { DUE = 2500, CASCADING = 300, BUDGET = 1024 };
+
+    static struct timing_wheel_t wheel;
+    static struct test_timer_t timers[DUE + CASCADING];
+
+    uint64_t start = 0;
+    struct expiry_log_t log = { 0, 0, 0, 0, NULL };
+
+    timing_wheel_initialize(&wheel, start);
+
+    for (size_t i = 0; i < DUE + CASCADING; ++i) {
+        timer_initialize(&timers[i].timer);
+        timers[i].cancelled = false;
+        timers[i].fired = false;
+
+        timing_wheel_schedule(&wheel, &timers[i].timer, (i < DUE) ? 50 : 4096);
+    }
+
+    static const size_t expected[] = { BUDGET, BUDGET, DUE - (2 * BUDGET) };
+
+    log.previous = 49;
+    log.now = 50;
+
+    for (size_t call = 0; call < sizeof (expected) / sizeof (expected[0]); ++call) {
+        if (timing_wheel_advance(&wheel, 50, BUDGET, record_expiry, &log) != expected[call]) {
+            fail("A budgeted advance fired the wrong number of timers.");
+        }
+
+        if (timing_wheel_behind(&wheel, 50) != (call + 1 < sizeof (expected) / sizeof (expected[0]))) {
+            fail("A budgeted advance misreported whether it was behind.");
+        }
+    }
+
+    /**
+     * @brief The remaining timers sit on level two, and
+     * cascade straight down to level zero at tick 4096.
+     * Moving each one costs a unit of budget, as does
+     * firing it, so a budget of 100 moves a hundred of them
+     * and fires none on the first call.
+     *
+     */
+    log.previous = 50;
+    log.now = 4096;
+
+    if ((timing_wheel_advance(&wheel, 4096, 100, record_expiry, &log) != 0) || !timing_wheel_behind(&wheel, 4096)) {
+        fail("A budgeted cascade fired timers early, or finished too soon.");
+    }
+
+    size_t fired = 0;
+    size_t calls = 0;
+
+    while (timing_wheel_behind(&wheel, 4096)) {
+        fired += timing_wheel_advance(&wheel, 4096, 100, record_expiry, &log);
+        ++calls;
+    }
+
+    if ((fired != CASCADING) || (calls != 5) || (log.fired != DUE + CASCADING)) {
+        fail("A budgeted cascade did the wrong amount of work.");
+    }
+}
+
+/**
+ * @brief Check expiry through the symbol table: the active
+ * pass is held to EXPIRY_BUDGET keys per tick, lookups
+ * expire keys lazily, and a time-to-live that would run
+ * past the end of time is taken to be none at all.
+ *
+ */
+static void test_symbol_table(void) {
+    struct symbol_table_t symbol_table;
+    char key[32];
+
+    initialize_symbol_table(&symbol_table);
+
+    uint64_t now = monotonic_milliseconds();
+    size_t batch = (5 * EXPIRY_BUDGET) / 2;
+
+    for (size_t i = 0; i < batch; ++i) {
+        snprintf(key, sizeof (key), "batch:%zu", i);
+        symbol_table_define(&symbol_table, key, "v", 50, now);
+    }
+
+    symbol_table_define(&symbol_table, "lazy", "v", 10, now);
+    symbol_table_define(&symbol_table, "edge", "v", UINT64_MAX - now, now);
+    symbol_table_define(&symbol_table, "forever", "v", UINT64_MAX - now + 1, now);
+
+    if ((symbol_table.expiry.count != batch + 2) || (symbol_table.count != batch + 3)) {
+        fail("A time-to-live past the end of time was scheduled.");
+    }
+
+    if ((symbol_table_lookup(&symbol_table, "lazy", now + 9) == NULL) || (symbol_table_lookup(&symbol_table, "lazy", now + 10) != NULL)) {
+        fail("A key did not expire lazily when it was due.");
+    }
+
+    if ((symbol_table.expiry.count != batch + 1) || (symbol_table.count != batch + 2)) {
+        fail("Lazy expiry did not remove the key.");
+    }
+
+    static const size_t expected[] = { EXPIRY_BUDGET, EXPIRY_BUDGET, EXPIRY_BUDGET / 2 };
+
+    for (size_t tick = 0; tick < sizeof (expected) / sizeof (expected[0]); ++tick) {
+        if (symbol_table_expire(&symbol_table, now + 50, EXPIRY_BUDGET) != expected[tick]) {
+            fail("The active-expiry pass overran its budget.");
+        }
+    }
+
+    if (symbol_table_expire(&symbol_table, now + 50, EXPIRY_BUDGET) != 0) {
+        fail("The active-expiry pass expired a key twice.");
+    }
+
+    struct key_val_t* forever = symbol_table_lookup(&symbol_table, "forever", UINT64_MAX - 1);
+    struct key_val_t* edge = symbol_table_lookup(&symbol_table, "edge", UINT64_MAX - 1);
+
+    if ((forever == NULL) || (forever->expires_at != 0) || (edge == NULL) || (edge->expires_at != UINT64_MAX)) {
+        fail("A very long time-to-live was not handled as expected.");
+    }
+
+    if ((symbol_table.count != 2) || (symbol_table.expiry.count != 1)) {
+        fail("The active-expiry pass left the wrong keys behind.");
+    }
+
+    destroy_symbol_table(&symbol_table);
+}
+
+/**
+ * @brief Run every timing wheel test.
+ *
+ * @return int
+ */
+int main(void) {
+    test_levels();
+    test_random();
+    test_budget();
+    test_symbol_table();
+
+    printf("Timing wheel tests passed.\n");
+
+    return EXIT_SUCCESS;
+}
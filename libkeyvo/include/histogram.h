@@ -0,0 +1,78 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_HISTOGRAM_H
+#define PROJECT_INCLUDES_HISTOGRAM_H
+
+/**
+ * @brief This header is shared by keyvo-bench and
+ * keyvo-replay, each of which has its own keyvo.h, so it
+ * pulls in exactly what it needs rather than relying on
+ * whichever keyvo.h happens to be included first.
+ *
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief Every power of two in the histogram is split into
+ * 2^HISTOGRAM_SUB_BUCKET_BITS linear sub-buckets, so any
+ * recorded value is off by at most about three percent.
+ * This is the same layout the server uses for its own
+ * latency histograms, so the two can be compared directly.
+ *
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS     (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * @brief Values are recorded in nanoseconds; anything from
+ * 2^40 ns (about eighteen minutes) up is lumped together in
+ * the last bucket.
+ *
+ */
+#define HISTOGRAM_MAXIMUM_BITS    40
+#define HISTOGRAM_BUCKETS         ((HISTOGRAM_MAXIMUM_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @brief An HDR-style log-linear latency histogram.
+ *
+ */
+struct histogram_t {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/**
+ * @brief Return the current value of the monotonic clock,
+ * in nanoseconds.
+ *
+ * @return uint64_t
+ */
+static inline uint64_t monotonic_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+void histogram_record(struct histogram_t* histogram, uint64_t value);
+
+uint64_t histogram_percentile(const struct histogram_t* histogram, double percentile);
+
+#endif /** PROJECT_INCLUDES_HISTOGRAM_H */
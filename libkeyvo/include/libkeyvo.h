@@ -0,0 +1,142 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_LIBKEYVO_H
+#define PROJECT_INCLUDES_LIBKEYVO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief The outcome of a request. Every reply the server
+ * can send maps onto one of these; KEYVO_IO_ERROR means no
+ * reply was received at all.
+ *
+ */
+enum keyvo_status_t {
+    KEYVO_OK,
+    KEYVO_NOT_FOUND,
+    KEYVO_EXISTS,
+    KEYVO_TOO_LARGE,
+    KEYVO_READ_ONLY,
+    KEYVO_BUSY,
+    KEYVO_INVALID_ARGUMENT,
+    KEYVO_SERVER_ERROR,
+    KEYVO_IO_ERROR
+};
+
+/**
+ * @brief How a client reaches the server, and how it
+ * caches what it reads.
+ *
+ * @details The near cache keeps up to near_cache_capacity
+ * values in the client process, so that reading them again
+ * costs no round trip. Entries are kept fresh in two ways:
+ *
+ * - With subscribe set, a background thread holds a
+ *   connection open on which the server pushes every key
+ *   that changes, and those keys are dropped from the
+ *   cache as soon as the news arrives. If that connection
+ *   is lost, the whole cache is dropped, and it is not
+ *   used again until the connection is back.
+ *
+ * - With near_cache_max_age set, an entry older than that
+ *   many milliseconds is revalidated with the server before
+ *   it is used. Revalidating a value that has not changed
+ *   costs a round trip, but does not transfer the value.
+ *
+ * Either one bounds how stale a cached value can be; a
+ * near cache with neither is refused. Setting both gives
+ * a hard bound even if an invalidation goes astray.
+ *
+ * The strings are copied, so they need not outlive the
+ * call to keyvo_open().
+ *
+ */
+struct keyvo_options_t {
+    /** Server host and port, for TCP */
+    const char* host;
+    const char* port;
+
+    /** Server socket, used instead of TCP when set */
+    const char* socket_path;
+
+    /** Connections to keep open for requests */
+    size_t pool_size;
+
+    /** Values to cache locally, or zero for no near cache */
+    size_t near_cache_capacity;
+
+    /** Milliseconds before an entry is revalidated, or zero */
+    uint64_t near_cache_max_age;
+
+    /** Whether to listen for invalidations */
+    bool subscribe;
+};
+
+/**
+ * @brief How well the near cache has been doing.
+ *
+ */
+struct keyvo_cache_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t revalidations;
+    uint64_t invalidations;
+};
+
+struct keyvo_client_t;
+struct keyvo_pipeline_t;
+
+void keyvo_default_options(struct keyvo_options_t* options);
+
+struct keyvo_client_t* keyvo_open(const struct keyvo_options_t* options);
+
+void keyvo_close(struct keyvo_client_t* client);
+
+enum keyvo_status_t keyvo_get(struct keyvo_client_t* client, const char* key, char** value);
+
+enum keyvo_status_t keyvo_define(struct keyvo_client_t* client, const char* key, const char* value, uint64_t ttl);
+
+enum keyvo_status_t keyvo_update(struct keyvo_client_t* client, const char* key, const char* value, uint64_t ttl);
+
+enum keyvo_status_t keyvo_drop(struct keyvo_client_t* client, const char* key);
+
+void keyvo_cache_stats(struct keyvo_client_t* client, struct keyvo_cache_stats_t* stats);
+
+const char* keyvo_status_string(enum keyvo_status_t status);
+
+struct keyvo_pipeline_t* keyvo_pipeline_create(struct keyvo_client_t* client);
+
+void keyvo_pipeline_destroy(struct keyvo_pipeline_t* pipeline);
+
+void keyvo_pipeline_reset(struct keyvo_pipeline_t* pipeline);
+
+bool keyvo_pipeline_get(struct keyvo_pipeline_t* pipeline, const char* key);
+
+bool keyvo_pipeline_define(struct keyvo_pipeline_t* pipeline, const char* key, const char* value, uint64_t ttl);
+
+bool keyvo_pipeline_update(struct keyvo_pipeline_t* pipeline, const char* key, const char* value, uint64_t ttl);
+
+bool keyvo_pipeline_drop(struct keyvo_pipeline_t* pipeline, const char* key);
+
+enum keyvo_status_t keyvo_pipeline_execute(struct keyvo_pipeline_t* pipeline);
+
+size_t keyvo_pipeline_count(const struct keyvo_pipeline_t* pipeline);
+
+enum keyvo_status_t keyvo_pipeline_result(const struct keyvo_pipeline_t* pipeline, size_t index, const char** value);
+
+#endif /** PROJECT_INCLUDES_LIBKEYVO_H */
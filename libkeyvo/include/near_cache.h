@@ -0,0 +1,130 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_NEAR_CACHE_H
+#define PROJECT_INCLUDES_NEAR_CACHE_H
+
+#include "keyvo.h"
+
+/**
+ * @brief The number of generation counters the keys are
+ * spread over. See near_cache_t for what they are for.
+ *
+ */
+#ifndef NEAR_CACHE_STRIPES
+#define NEAR_CACHE_STRIPES 64
+#endif
+
+/**
+ * @brief A value cached in the client process.
+ *
+ */
+struct near_entry_t {
+    char* key;
+    char* value;
+    uint64_t hash;
+
+    /** The version the server gave the value */
+    uint64_t version;
+
+    /** When the server last vouched for the value */
+    uint64_t validated_at;
+
+    /** The next entry in the same bucket, or the next free one */
+    int32_t next;
+
+    bool used;
+    bool referenced;
+};
+
+/**
+ * @brief What a near-cache lookup found.
+ *
+ */
+enum near_cache_result_t {
+    NEAR_CACHE_MISS,
+    NEAR_CACHE_HIT,
+    NEAR_CACHE_STALE
+};
+
+/**
+ * @brief The generation numbers a request sampled before it
+ * went out, so that its reply can be checked against any
+ * invalidations that arrived in the meantime.
+ *
+ */
+struct near_cache_ticket_t {
+    uint64_t hash;
+    uint64_t generation;
+};
+
+/**
+ * @brief A fixed-capacity cache of values, shared by every
+ * thread using the client.
+ *
+ * @details Entries live in a preallocated array, chained
+ * off of a power-of-two bucket array by index, and are
+ * evicted with CLOCK once the array is full.
+ *
+ * A reply can race with an invalidation for the same key:
+ * the server may change a key after answering a read but
+ * before the reply has been cached, and the invalidation,
+ * which arrives on a different connection, may be processed
+ * first. To keep such a reply from resurrecting the old
+ * value, every invalidation bumps a generation counter, and
+ * a reply is only cached if the counter for its key has not
+ * moved since the request was sent. The counters are
+ * striped by key hash, so that a busy key does not stop
+ * every other key from being cached.
+ *
+ */
+struct near_cache_t {
+    pthread_mutex_t lock;
+
+    struct near_entry_t* entries;
+    size_t capacity;
+
+    int32_t* buckets;
+    size_t bucket_mask;
+
+    int32_t free_list;
+    size_t hand;
+
+    uint64_t generations[NEAR_CACHE_STRIPES];
+
+    /** Milliseconds before an entry must be revalidated */
+    uint64_t max_age;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t revalidations;
+    uint64_t invalidations;
+};
+
+bool near_cache_initialize(struct near_cache_t* cache, size_t capacity, uint64_t max_age);
+
+void near_cache_destroy(struct near_cache_t* cache);
+
+enum near_cache_result_t near_cache_lookup(struct near_cache_t* cache, const char* key, uint64_t now, char** value, uint64_t* version, struct near_cache_ticket_t* ticket);
+
+void near_cache_insert(struct near_cache_t* cache, const char* key, const char* value, uint64_t version, const struct near_cache_ticket_t* ticket, uint64_t now);
+
+void near_cache_revalidated(struct near_cache_t* cache, const char* key, uint64_t version, const struct near_cache_ticket_t* ticket, uint64_t now);
+
+void near_cache_invalidate(struct near_cache_t* cache, const char* key);
+
+void near_cache_clear(struct near_cache_t* cache);
+
+#endif /** PROJECT_INCLUDES_NEAR_CACHE_H */
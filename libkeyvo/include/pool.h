@@ -0,0 +1,80 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef PROJECT_INCLUDES_POOL_H
+#define PROJECT_INCLUDES_POOL_H
+
+#include "keyvo.h"
+
+/**
+ * @brief How much reply data a connection buffers to begin
+ * with. The buffer grows to fit the longest reply seen.
+ *
+ */
+#ifndef CONNECTION_INPUT_SIZE
+#define CONNECTION_INPUT_SIZE 4096
+#endif
+
+/**
+ * @brief A blocking connection to the server, along with
+ * whatever it has read past the end of the last reply.
+ *
+ */
+struct keyvo_connection_t {
+    int socket;
+
+    char* input;
+    size_t input_start;
+    size_t input_length;
+    size_t input_capacity;
+};
+
+/**
+ * @brief A fixed-size pool of connections. Connections are
+ * opened the first time they are needed, and reopened after
+ * any failure, so a server restart costs the client only
+ * the requests that were in flight at the time.
+ *
+ */
+struct keyvo_pool_t {
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+
+    struct keyvo_connection_t* connections;
+    bool* busy;
+    size_t size;
+
+    const char* host;
+    const char* port;
+    const char* socket_path;
+};
+
+int keyvo_connect(const char* host, const char* port, const char* socket_path);
+
+bool connection_write(struct keyvo_connection_t* connection, const char* data, size_t length);
+
+char* connection_read_line(struct keyvo_connection_t* connection);
+
+void connection_reset(struct keyvo_connection_t* connection);
+
+bool pool_initialize(struct keyvo_pool_t* pool, size_t size, const char* host, const char* port, const char* socket_path);
+
+void pool_destroy(struct keyvo_pool_t* pool);
+
+struct keyvo_connection_t* pool_acquire(struct keyvo_pool_t* pool);
+
+void pool_release(struct keyvo_pool_t* pool, struct keyvo_connection_t* connection, bool healthy);
+
+#endif /** PROJECT_INCLUDES_POOL_H */
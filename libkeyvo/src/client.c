@@ -0,0 +1,916 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "keyvo.h"
+#include "near_cache.h"
+#include "pool.h"
+
+/**
+ * @brief The most commands written to a connection before
+ * their replies are read back. Bounding this keeps a large
+ * pipeline from filling both sides' socket buffers, and the
+ * server's per-connection reply queue, at once.
+ *
+ */
+#ifndef KEYVO_PIPELINE_WINDOW
+#define KEYVO_PIPELINE_WINDOW 256
+#endif
+
+/**
+ * @brief How long the invalidation thread waits before
+ * trying to reconnect, in milliseconds.
+ *
+ */
+#ifndef KEYVO_RECONNECT_DELAY
+#define KEYVO_RECONNECT_DELAY 100
+#endif
+
+enum command_kind_t {
+    COMMAND_GET,
+    COMMAND_DEFINE,
+    COMMAND_UPDATE,
+    COMMAND_DROP
+};
+
+/**
+ * @brief A single request, and what became of it.
+ *
+ * @details A read is answered from the near cache if it
+ * can be. Otherwise it goes out as a GETV, so that the
+ * reply can be cached along with its version, or, if the
+ * cached copy has grown too old, as a CHECK of that copy.
+ *
+ */
+struct command_t {
+    enum command_kind_t kind;
+    char* key;
+    char* value;
+    uint64_t ttl;
+
+    enum keyvo_status_t status;
+    char* result;
+
+    /** Answered from the near cache, without a round trip */
+    bool answered;
+
+    /** Sent as GETV or CHECK, so the reply carries a version */
+    bool versioned;
+
+    /** Sent as CHECK of the cached copy in result */
+    bool checking;
+
+    uint64_t version;
+    struct near_cache_ticket_t ticket;
+};
+
+struct keyvo_pipeline_t {
+    struct keyvo_client_t* client;
+
+    struct command_t* commands;
+    size_t count;
+    size_t capacity;
+};
+
+struct keyvo_client_t {
+    char* host;
+    char* port;
+    char* socket_path;
+
+    struct keyvo_options_t options;
+    struct keyvo_pool_t pool;
+
+    bool caching;
+    struct near_cache_t cache;
+
+    bool subscribing;
+    pthread_t subscriber;
+    pthread_mutex_t subscriber_lock;
+    int subscriber_socket;
+
+    atomic_bool stopping;
+
+    /** Whether invalidations are currently being received */
+    atomic_bool subscribed;
+};
+
+/**
+ * @brief Fill in the default options: a TCP connection to
+ * the local server, four pooled connections, and no near
+ * cache.
+ *
+ * @param options
+ */
+void keyvo_default_options(struct keyvo_options_t* options) {
+    options->host = "127.0.0.1";
+    options->port = "8080";
+    options->socket_path = NULL;
+    options->pool_size = 4;
+    options->near_cache_capacity = 0;
+    options->near_cache_max_age = 0;
+    options->subscribe = false;
+}
+
+/**
+ * @brief Return a short description of a status.
+ *
+ * @param status
+ * @return const char*
+ */
+const char* keyvo_status_string(enum keyvo_status_t status) {
+    switch (status) {
+        case KEYVO_OK: return "OK";
+        case KEYVO_NOT_FOUND: return "NOT_FOUND";
+        case KEYVO_EXISTS: return "EXISTS";
+        case KEYVO_TOO_LARGE: return "TOO_LARGE";
+        case KEYVO_READ_ONLY: return "READ_ONLY";
+        case KEYVO_BUSY: return "BUSY";
+        case KEYVO_INVALID_ARGUMENT: return "INVALID_ARGUMENT";
+        case KEYVO_SERVER_ERROR: return "SERVER_ERROR";
+        case KEYVO_IO_ERROR: return "IO_ERROR";
+    }
+
+    return "UNKNOWN";
+}
+
+/**
+ * @brief Sleep for the given number of milliseconds.
+ *
+ * @param milliseconds
+ */
+static void sleep_milliseconds(uint64_t milliseconds) {
+    struct timespec delay = { (time_t) (milliseconds / 1000), (long) ((milliseconds % 1000) * 1000000) };
+
+    while ((nanosleep(&delay, &delay) == -1) && (errno == EINTR)) {
+    }
+}
+
+/**
+ * @brief Check whether the near cache can be trusted right
+ * now. A client that relies on invalidations cannot trust
+ * its cache while it is not receiving them.
+ *
+ * @param client
+ * @return true
+ * @return false
+ */
+static inline bool cache_usable(struct keyvo_client_t* client) {
+    return client->caching && (!client->subscribing || atomic_load(&client->subscribed));
+}
+
+/**
+ * @brief The invalidation thread. It keeps a subscribed
+ * connection open to the server, and drops every key the
+ * server reports as changed from the near cache.
+ *
+ * @details Whenever the subscription is lost, and again
+ * once it has been reestablished, the whole cache is
+ * dropped, since any number of invalidations may have been
+ * missed in between.
+ *
+ * @param argument
+ * @return void*
+ */
+static void* subscribe_loop(void* argument) {
+    struct keyvo_client_t* client = argument;
+    struct keyvo_connection_t connection = { -1, NULL, 0, 0, 0 };
+
+    while (!atomic_load(&client->stopping)) {
+        int subscriber_socket = keyvo_connect(client->host, client->port, client->socket_path);
+
+        if (subscriber_socket == -1) {
+            sleep_milliseconds(KEYVO_RECONNECT_DELAY);
+            continue;
+        }
+
+        pthread_mutex_lock(&client->subscriber_lock);
+
+        if (atomic_load(&client->stopping)) {
+            pthread_mutex_unlock(&client->subscriber_lock);
+            close(subscriber_socket);
+            break;
+        }
+
+        client->subscriber_socket = subscriber_socket;
+        pthread_mutex_unlock(&client->subscriber_lock);
+
+        connection.socket = subscriber_socket;
+
+        char* line = NULL;
+
+        if (connection_write(&connection, "SUBSCRIBE\n", 10) && (line = connection_read_line(&connection)) && (strcmp(line, "OK") == 0)) {
+            near_cache_clear(&client->cache);
+            atomic_store(&client->subscribed, true);
+
+            while ((line = connection_read_line(&connection))) {
+                if (strncmp(line, "INVALIDATE ", 11) == 0) {
+                    near_cache_invalidate(&client->cache, line + 11);
+                }
+            }
+        }
+
+        atomic_store(&client->subscribed, false);
+        near_cache_clear(&client->cache);
+
+        pthread_mutex_lock(&client->subscriber_lock);
+        client->subscriber_socket = -1;
+        pthread_mutex_unlock(&client->subscriber_lock);
+
+        connection_reset(&connection);
+
+        if (!atomic_load(&client->stopping)) {
+            sleep_milliseconds(KEYVO_RECONNECT_DELAY);
+        }
+    }
+
+    free(connection.input);
+
+    return NULL;
+}
+
+/**
+ * @brief Duplicate an optional string.
+ *
+ * @param s
+ * @param copy
+ * @return false if memory could not be allocated.
+ */
+static bool copy_option(const char* s, char** copy) {
+    *copy = s ? strdup(s) : NULL;
+
+    return (s == NULL) || (*copy != NULL);
+}
+
+/**
+ * @brief Create a client. No connection is made to the
+ * server until the first request, except by the
+ * invalidation thread, which starts right away.
+ *
+ * @param options
+ * @return The client, or NULL if the options are invalid
+ * or memory could not be allocated.
+ */
+struct keyvo_client_t* keyvo_open(const struct keyvo_options_t* options) {
+    if ((options->pool_size == 0) || ((options->socket_path == NULL) && ((options->host == NULL) || (options->port == NULL)))) {
+        return NULL;
+    }
+
+    if ((options->near_cache_capacity != 0) && !options->subscribe && (options->near_cache_max_age == 0)) {
+        return NULL;
+    }
+
+    struct keyvo_client_t* client = calloc(1, sizeof (struct keyvo_client_t));
+
+    if (client == NULL) {
+        return NULL;
+    }
+
+    if (!copy_option(options->host, &client->host) || !copy_option(options->port, &client->port) || !copy_option(options->socket_path, &client->socket_path)) {
+        goto fail_strings;
+    }
+
+    client->options = *options;
+
+    if (!pool_initialize(&client->pool, options->pool_size, client->host, client->port, client->socket_path)) {
+        goto fail_strings;
+    }
+
+    client->caching = (options->near_cache_capacity != 0);
+
+    if (client->caching && !near_cache_initialize(&client->cache, options->near_cache_capacity, options->near_cache_max_age)) {
+        goto fail_pool;
+    }
+
+    atomic_init(&client->stopping, false);
+    atomic_init(&client->subscribed, false);
+
+    client->subscriber_socket = -1;
+    pthread_mutex_init(&client->subscriber_lock, NULL);
+
+    client->subscribing = client->caching && options->subscribe;
+
+    if (client->subscribing && (pthread_create(&client->subscriber, NULL, subscribe_loop, client) != 0)) {
+        pthread_mutex_destroy(&client->subscriber_lock);
+        near_cache_destroy(&client->cache);
+        goto fail_pool;
+    }
+
+    return client;
+
+fail_pool:
+    pool_destroy(&client->pool);
+
+fail_strings:
+    free(client->host);
+    free(client->port);
+    free(client->socket_path);
+    free(client);
+
+    return NULL;
+}
+
+/**
+ * @brief Stop the invalidation thread, close every
+ * connection and release the client. No other thread may
+ * be using the client.
+ *
+ * @param client
+ */
+void keyvo_close(struct keyvo_client_t* client) {
+    if (client->subscribing) {
+        atomic_store(&client->stopping, true);
+
+        pthread_mutex_lock(&client->subscriber_lock);
+
+        if (client->subscriber_socket != -1) {
+            shutdown(client->subscriber_socket, SHUT_RDWR);
+        }
+
+        pthread_mutex_unlock(&client->subscriber_lock);
+
+        pthread_join(client->subscriber, NULL);
+    }
+
+    if (client->caching) {
+        near_cache_destroy(&client->cache);
+    }
+
+    pthread_mutex_destroy(&client->subscriber_lock);
+    pool_destroy(&client->pool);
+
+    free(client->host);
+    free(client->port);
+    free(client->socket_path);
+    free(client);
+}
+
+/**
+ * @brief Check that a key or value can be sent as a single
+ * word of the protocol.
+ *
+ * @param s
+ * @return true
+ * @return false
+ */
+static bool valid_word(const char* s) {
+    return s && *s && (strcspn(s, " \t\r\n") == strlen(s));
+}
+
+/**
+ * @brief Try to answer a read from the near cache, and work
+ * out what to ask the server if that is not possible.
+ *
+ * @param client
+ * @param command
+ * @param now
+ */
+static void consult_cache(struct keyvo_client_t* client, struct command_t* command, uint64_t now) {
+    if (!cache_usable(client)) {
+        return;
+    }
+
+    char* cached = NULL;
+
+    switch (near_cache_lookup(&client->cache, command->key, now, &cached, &command->version, &command->ticket)) {
+        case NEAR_CACHE_HIT: {
+            command->status = KEYVO_OK;
+            command->result = cached;
+            command->answered = true;
+        } break;
+
+        case NEAR_CACHE_STALE: {
+            command->result = cached;
+            command->versioned = true;
+            command->checking = true;
+        } break;
+
+        case NEAR_CACHE_MISS: {
+            command->versioned = true;
+        } break;
+    }
+}
+
+/**
+ * @brief Return the length of the text a command is sent
+ * as, including its newline, with room to spare for the
+ * numbers.
+ *
+ * @param command
+ * @return size_t
+ */
+static size_t command_length(const struct command_t* command) {
+    return 64 + strlen(command->key) + (command->value ? strlen(command->value) : 0);
+}
+
+/**
+ * @brief Write a command's text into the buffer.
+ *
+ * @param command
+ * @param buffer
+ * @return The length of the text.
+ */
+static size_t format_command(const struct command_t* command, char* buffer, size_t capacity) {
+    int length = 0;
+
+    switch (command->kind) {
+        case COMMAND_GET: {
+            if (command->checking) {
+                length = snprintf(buffer, capacity, "CHECK %s %llu\n", command->key, (unsigned long long) command->version);
+            } else {
+                length = snprintf(buffer, capacity, "%s %s\n", command->versioned ? "GETV" : "GET", command->key);
+            }
+        } break;
+
+        case COMMAND_DEFINE:
+        case COMMAND_UPDATE: {
+            const char* verb = (command->kind == COMMAND_DEFINE) ? "DEFINE" : "UPDATE";
+
+            if (command->ttl) {
+                length = snprintf(buffer, capacity, "%s %s %s %llu\n", verb, command->key, command->value, (unsigned long long) command->ttl);
+            } else {
+                length = snprintf(buffer, capacity, "%s %s %s\n", verb, command->key, command->value);
+            }
+        } break;
+
+        case COMMAND_DROP: {
+            length = snprintf(buffer, capacity, "DROP %s\n", command->key);
+        } break;
+    }
+
+    return (size_t) length;
+}
+
+/**
+ * @brief Make sense of the reply to a command, and keep the
+ * near cache in step with it.
+ *
+ * @param client
+ * @param command
+ * @param reply
+ * @param now
+ */
+static void handle_reply(struct keyvo_client_t* client, struct command_t* command, char* reply, uint64_t now) {
+    bool usable = command->versioned && cache_usable(client);
+
+    if (strncmp(reply, "VALUE ", 6) == 0) {
+        char* value = reply + 6;
+        uint64_t version = 0;
+
+        if (command->versioned) {
+            char* space = strrchr(value, ' ');
+
+            if (space == NULL) {
+                command->status = KEYVO_SERVER_ERROR;
+                return;
+            }
+
+            *space = '\0';
+            version = strtoull(space + 1, NULL, 10);
+        }
+
+        free(command->result);
+        command->result = strdup(value);
+        command->status = command->result ? KEYVO_OK : KEYVO_IO_ERROR;
+
+        if (usable) {
+            near_cache_insert(&client->cache, command->key, value, version, &command->ticket, now);
+        }
+    } else if (command->checking && (strcmp(reply, "VALID") == 0)) {
+        command->status = KEYVO_OK;
+
+        if (usable) {
+            near_cache_revalidated(&client->cache, command->key, command->version, &command->ticket, now);
+        }
+    } else if (strcmp(reply, "OK") == 0) {
+        command->status = KEYVO_OK;
+    } else if (strcmp(reply, "NOT_FOUND") == 0) {
+        command->status = KEYVO_NOT_FOUND;
+    } else if (strcmp(reply, "EXISTS") == 0) {
+        command->status = KEYVO_EXISTS;
+    } else if (strcmp(reply, "TOO_LARGE") == 0) {
+        command->status = KEYVO_TOO_LARGE;
+    } else if (strcmp(reply, "READ_ONLY") == 0) {
+        command->status = KEYVO_READ_ONLY;
+    } else if (strcmp(reply, "BUSY") == 0) {
+        command->status = KEYVO_BUSY;
+    } else {
+        command->status = KEYVO_SERVER_ERROR;
+    }
+
+    if (command->status != KEYVO_OK) {
+        free(command->result);
+        command->result = NULL;
+    }
+
+    /**
+     * @brief A key this client has written, or found to be
+     * gone, is dropped from the cache straight away rather
+     * than when the invalidation comes round, so the client
+     * always reads its own writes.
+     *
+     */
+    if (client->caching && ((command->kind != COMMAND_GET) || (command->checking && (command->status != KEYVO_OK)))) {
+        near_cache_invalidate(&client->cache, command->key);
+    }
+}
+
+/**
+ * @brief Run a batch of commands. Reads the near cache can
+ * answer are answered locally; everything else is written
+ * to a single pooled connection in windows of up to
+ * KEYVO_PIPELINE_WINDOW commands, and the replies are read
+ * back in order.
+ *
+ * @param client
+ * @param commands
+ * @param count
+ * @return KEYVO_IO_ERROR if the server could not be
+ * reached, in which case every command that needed it has
+ * that status too, and KEYVO_OK otherwise.
+ */
+static enum keyvo_status_t execute_commands(struct keyvo_client_t* client, struct command_t* commands, size_t count) {
+    uint64_t now = monotonic_milliseconds();
+    size_t remote = 0;
+    size_t buffer_size = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        struct command_t* command = &commands[i];
+
+        command->status = KEYVO_IO_ERROR;
+        command->answered = false;
+        command->versioned = false;
+        command->checking = false;
+
+        free(command->result);
+        command->result = NULL;
+
+        if (command->kind == COMMAND_GET) {
+            consult_cache(client, command, now);
+        }
+
+        if (!command->answered) {
+            ++remote;
+
+            size_t length = command_length(command);
+
+            if (length > buffer_size) {
+                buffer_size = length;
+            }
+        }
+    }
+
+    if (remote == 0) {
+        return KEYVO_OK;
+    }
+
+    buffer_size *= (remote < KEYVO_PIPELINE_WINDOW) ? remote : KEYVO_PIPELINE_WINDOW;
+
+    char* buffer = malloc(buffer_size);
+    struct keyvo_connection_t* connection = buffer ? pool_acquire(&client->pool) : NULL;
+    bool healthy = (connection != NULL);
+
+    for (size_t start = 0; healthy && (start < count); ) {
+        size_t window[KEYVO_PIPELINE_WINDOW];
+        size_t window_count = 0;
+        size_t length = 0;
+
+        for (; (start < count) && (window_count < KEYVO_PIPELINE_WINDOW); ++start) {
+            if (!commands[start].answered) {
+                window[window_count++] = start;
+                length += format_command(&commands[start], buffer + length, buffer_size - length);
+            }
+        }
+
+        healthy = connection_write(connection, buffer, length);
+
+        for (size_t w = 0; healthy && (w < window_count); ++w) {
+            char* reply = connection_read_line(connection);
+
+            if (reply == NULL) {
+                healthy = false;
+                break;
+            }
+
+            handle_reply(client, &commands[window[w]], reply, monotonic_milliseconds());
+        }
+    }
+
+    if (connection) {
+        pool_release(&client->pool, connection, healthy);
+    }
+
+    free(buffer);
+
+    if (!healthy) {
+        for (size_t i = 0; i < count; ++i) {
+            if (commands[i].status == KEYVO_IO_ERROR) {
+                free(commands[i].result);
+                commands[i].result = NULL;
+            }
+        }
+
+        return KEYVO_IO_ERROR;
+    }
+
+    return KEYVO_OK;
+}
+
+/**
+ * @brief Read a key. The value is returned in a new string,
+ * which the caller must free.
+ *
+ * @param client
+ * @param key
+ * @param value
+ * @return enum keyvo_status_t
+ */
+enum keyvo_status_t keyvo_get(struct keyvo_client_t* client, const char* key, char** value) {
+    if (!valid_word(key)) {
+        return KEYVO_INVALID_ARGUMENT;
+    }
+
+    struct command_t command = { .kind = COMMAND_GET, .key = (char*) key };
+
+    execute_commands(client, &command, 1);
+
+    *value = command.result;
+
+    return command.status;
+}
+
+/**
+ * @brief Run a single write.
+ *
+ * @param client
+ * @param kind
+ * @param key
+ * @param value
+ * @param ttl
+ * @return enum keyvo_status_t
+ */
+static enum keyvo_status_t execute_write(struct keyvo_client_t* client, enum command_kind_t kind, const char* key, const char* value, uint64_t ttl) {
+    if (!valid_word(key) || ((kind != COMMAND_DROP) && !valid_word(value))) {
+        return KEYVO_INVALID_ARGUMENT;
+    }
+
+    struct command_t command = { .kind = kind, .key = (char*) key, .value = (char*) value, .ttl = ttl };
+
+    execute_commands(client, &command, 1);
+    free(command.result);
+
+    return command.status;
+}
+
+/**
+ * @brief Define a new key.
+ *
+ * @param client
+ * @param key
+ * @param value
+ * @param ttl Time-to-live in seconds, or zero for none.
+ * @return enum keyvo_status_t
+ */
+enum keyvo_status_t keyvo_define(struct keyvo_client_t* client, const char* key, const char* value, uint64_t ttl) {
+    return execute_write(client, COMMAND_DEFINE, key, value, ttl);
+}
+
+/**
+ * @brief Change the value of an existing key.
+ *
+ * @param client
+ * @param key
+ * @param value
+ * @param ttl Time-to-live in seconds, or zero to keep the
+ * key's current expiry.
+ * @return enum keyvo_status_t
+ */
+enum keyvo_status_t keyvo_update(struct keyvo_client_t* client, const char* key, const char* value, uint64_t ttl) {
+    return execute_write(client, COMMAND_UPDATE, key, value, ttl);
+}
+
+/**
+ * @brief Remove a key.
+ *
+ * @param client
+ * @param key
+ * @return enum keyvo_status_t
+ */
+enum keyvo_status_t keyvo_drop(struct keyvo_client_t* client, const char* key) {
+    return execute_write(client, COMMAND_DROP, key, NULL, 0);
+}
+
+/**
+ * @brief Report how the near cache has been doing. Every
+ * figure is zero if the client has no near cache.
+ *
+ * @param client
+ * @param stats
+ */
+void keyvo_cache_stats(struct keyvo_client_t* client, struct keyvo_cache_stats_t* stats) {
+    memset(stats, 0, sizeof (struct keyvo_cache_stats_t));
+
+    if (!client->caching) {
+        return;
+    }
+
+    pthread_mutex_lock(&client->cache.lock);
+
+    stats->hits = client->cache.hits;
+    stats->misses = client->cache.misses;
+    stats->revalidations = client->cache.revalidations;
+    stats->invalidations = client->cache.invalidations;
+
+    pthread_mutex_unlock(&client->cache.lock);
+}
+
+/**
+ * @brief Create an empty pipeline. Commands added to it are
+ * only sent when it is executed, all at once.
+ *
+ * @param client
+ * @return The pipeline, or NULL if memory could not be
+ * allocated.
+ */
+struct keyvo_pipeline_t* keyvo_pipeline_create(struct keyvo_client_t* client) {
+    struct keyvo_pipeline_t* pipeline = calloc(1, sizeof (struct keyvo_pipeline_t));
+
+    if (pipeline) {
+        pipeline->client = client;
+    }
+
+    return pipeline;
+}
+
+/**
+ * @brief Remove every command, and its result, from the
+ * pipeline, so that it can be reused.
+ *
+ * @param pipeline
+ */
+void keyvo_pipeline_reset(struct keyvo_pipeline_t* pipeline) {
+    for (size_t i = 0; i < pipeline->count; ++i) {
+        free(pipeline->commands[i].key);
+        free(pipeline->commands[i].value);
+        free(pipeline->commands[i].result);
+    }
+
+    pipeline->count = 0;
+}
+
+/**
+ * @brief Release the pipeline and every result in it.
+ *
+ * @param pipeline
+ */
+void keyvo_pipeline_destroy(struct keyvo_pipeline_t* pipeline) {
+    keyvo_pipeline_reset(pipeline);
+
+    free(pipeline->commands);
+    free(pipeline);
+}
+
+/**
+ * @brief Queue up a command.
+ *
+ * @param pipeline
+ * @param kind
+ * @param key
+ * @param value
+ * @param ttl
+ * @return false if the arguments are invalid or memory
+ * could not be allocated.
+ */
+static bool pipeline_add(struct keyvo_pipeline_t* pipeline, enum command_kind_t kind, const char* key, const char* value, uint64_t ttl) {
+    if (!valid_word(key) || (value && !valid_word(value))) {
+        return false;
+    }
+
+    if (pipeline->count == pipeline->capacity) {
+        size_t capacity = pipeline->capacity ? 2 * pipeline->capacity : 16;
+        struct command_t* commands = realloc(pipeline->commands, capacity * sizeof (struct command_t));
+
+        if (commands == NULL) {
+            return false;
+        }
+
+        pipeline->commands = commands;
+        pipeline->capacity = capacity;
+    }
+
+    struct command_t* command = &pipeline->commands[pipeline->count];
+    memset(command, 0, sizeof (struct command_t));
+
+    command->kind = kind;
+    command->key = strdup(key);
+    command->value = value ? strdup(value) : NULL;
+    command->ttl = ttl;
+
+    if ((command->key == NULL) || (value && (command->value == NULL))) {
+        free(command->key);
+        free(command->value);
+        return false;
+    }
+
+    ++pipeline->count;
+
+    return true;
+}
+
+/**
+ * @brief Queue up a read.
+ *
+ * @return false if the arguments are invalid or memory
+ * could not be allocated.
+ */
+bool keyvo_pipeline_get(struct keyvo_pipeline_t* pipeline, const char* key) {
+    return pipeline_add(pipeline, COMMAND_GET, key, NULL, 0);
+}
+
+/**
+ * @brief Queue up a DEFINE.
+ *
+ * @return false if the arguments are invalid or memory
+ * could not be allocated.
+ */
+bool keyvo_pipeline_define(struct keyvo_pipeline_t* pipeline, const char* key, const char* value, uint64_t ttl) {
+    return (value != NULL) && pipeline_add(pipeline, COMMAND_DEFINE, key, value, ttl);
+}
+
+/**
+ * @brief Queue up an UPDATE.
+ *
+ * @return false if the arguments are invalid or memory
+ * could not be allocated.
+ */
+bool keyvo_pipeline_update(struct keyvo_pipeline_t* pipeline, const char* key, const char* value, uint64_t ttl) {
+    return (value != NULL) && pipeline_add(pipeline, COMMAND_UPDATE, key, value, ttl);
+}
+
+/**
+ * @brief Queue up a DROP.
+ *
+ * @return false if the arguments are invalid or memory
+ * could not be allocated.
+ */
+bool keyvo_pipeline_drop(struct keyvo_pipeline_t* pipeline, const char* key) {
+    return pipeline_add(pipeline, COMMAND_DROP, key, NULL, 0);
+}
+
+/**
+ * @brief Send every queued command and collect the replies.
+ * A pipeline can be executed more than once; each execution
+ * replaces the previous results.
+ *
+ * @param pipeline
+ * @return KEYVO_IO_ERROR if the server could not be
+ * reached, and KEYVO_OK otherwise. Each command's own
+ * outcome is available from keyvo_pipeline_result().
+ */
+enum keyvo_status_t keyvo_pipeline_execute(struct keyvo_pipeline_t* pipeline) {
+    return execute_commands(pipeline->client, pipeline->commands, pipeline->count);
+}
+
+/**
+ * @brief Return the number of commands in the pipeline.
+ *
+ * @param pipeline
+ * @return size_t
+ */
+size_t keyvo_pipeline_count(const struct keyvo_pipeline_t* pipeline) {
+    return pipeline->count;
+}
+
+/**
+ * @brief Return the outcome of a command in an executed
+ * pipeline. For a read that succeeded, the value is also
+ * returned; it belongs to the pipeline, and stays valid
+ * until the pipeline is reset, executed again or
+ * destroyed.
+ *
+ * @param pipeline
+ * @param index
+ * @param value May be NULL.
+ * @return enum keyvo_status_t
+ */
+enum keyvo_status_t keyvo_pipeline_result(const struct keyvo_pipeline_t* pipeline, size_t index, const char** value) {
+    if (index >= pipeline->count) {
+        return KEYVO_INVALID_ARGUMENT;
+    }
+
+    if (value) {
+        *value = pipeline->commands[index].result;
+    }
+
+    return pipeline->commands[index].status;
+}
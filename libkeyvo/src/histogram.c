@@ -0,0 +1,118 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "histogram.h"
+
+/**
+ * @brief Map a value onto its histogram bucket. Values
+ * below 2^(HISTOGRAM_SUB_BUCKET_BITS + 1) each get their own
+ * bucket; above that, every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS evenly-sized buckets.
+ *
+ * @param value
+ * @return size_t
+ */
+static size_t histogram_bucket(uint64_t value) {
+    if (value < (UINT64_C(2) << HISTOGRAM_SUB_BUCKET_BITS)) {
+        return value;
+    }
+
+    unsigned int magnitude = 63 - __builtin_clzll(value);
+
+    if (magnitude >= HISTOGRAM_MAXIMUM_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    unsigned int shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return ((size_t) (shift + 1) << HISTOGRAM_SUB_BUCKET_BITS) + ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+/**
+ * @brief Return the largest value that falls into the given
+ * histogram bucket.
+ *
+ * @param bucket
+ * @return uint64_t
+ */
+static uint64_t bucket_upper_bound(size_t bucket) {
+    if (bucket < (2 * HISTOGRAM_SUB_BUCKETS)) {
+        return bucket;
+    }
+
+    unsigned int shift = (bucket >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    uint64_t mantissa = (bucket & (HISTOGRAM_SUB_BUCKETS - 1)) + HISTOGRAM_SUB_BUCKETS;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * @brief Record a value in the histogram.
+ *
+ * @param histogram
+ * @param value
+ */
+void histogram_record(struct histogram_t* histogram, uint64_t value) {
+    histogram->counts[histogram_bucket(value)] += 1;
+    histogram->total += 1;
+    histogram->sum += value;
+
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/**
+ * @brief Estimate the value below which the given
+ * percentage of the recorded values fall.
+ *
+ * @details The estimate is the upper edge of the bucket
+ * the percentile lands in, clamped to the largest value
+ * actually recorded, so it errs on the pessimistic side.
+ *
+ * @param histogram
+ * @param percentile
+ * @return uint64_t
+ */
+uint64_t histogram_percentile(const struct histogram_t* histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+
+    double exact = (percentile / 100.0) * (double) histogram->total;
+    uint64_t rank = (uint64_t) exact;
+
+    if ((double) rank < exact) {
+        rank += 1;
+    }
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+        seen += histogram->counts[bucket];
+
+        if (seen >= rank) {
+            uint64_t value = bucket_upper_bound(bucket);
+
+            return (value < histogram->max) ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
@@ -0,0 +1,397 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "near_cache.h"
+
+/**
+ * @brief Hash a key with 64-bit FNV-1a, the same function
+ * the server uses.
+ *
+ * @param key
+ * @return uint64_t
+ */
+static uint64_t hash_key(const char* key) {
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    for (const unsigned char* c = (const unsigned char*) key; *c; ++c) {
+        hash ^= *c;
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Return the generation counter covering a key. The
+ * stripe is taken from the high bits of the hash, since the
+ * low bits already pick the bucket.
+ *
+ * @param cache
+ * @param hash
+ * @return uint64_t*
+ */
+static inline uint64_t* generation_of(struct near_cache_t* cache, uint64_t hash) {
+    return &cache->generations[(hash >> 32) % NEAR_CACHE_STRIPES];
+}
+
+/**
+ * @brief Thread every entry onto the free list, and empty
+ * every bucket.
+ *
+ * @param cache
+ */
+static void reset_entries(struct near_cache_t* cache) {
+    for (size_t i = 0; i <= cache->bucket_mask; ++i) {
+        cache->buckets[i] = -1;
+    }
+
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        cache->entries[i].used = false;
+        cache->entries[i].next = (i + 1 < cache->capacity) ? (int32_t) (i + 1) : -1;
+    }
+
+    cache->free_list = 0;
+    cache->hand = 0;
+}
+
+/**
+ * @brief Set up an empty cache with room for the given
+ * number of values.
+ *
+ * @param cache
+ * @param capacity
+ * @param max_age Milliseconds before an entry must be
+ * revalidated, or zero if entries never age out.
+ * @return false if memory could not be allocated.
+ */
+bool near_cache_initialize(struct near_cache_t* cache, size_t capacity, uint64_t max_age) {
+    size_t bucket_count = 1;
+
+    if ((capacity == 0) || (capacity > INT32_MAX)) {
+        return false;
+    }
+
+    while (bucket_count < capacity) {
+        bucket_count *= 2;
+    }
+
+    cache->entries = calloc(capacity, sizeof (struct near_entry_t));
+    cache->buckets = calloc(bucket_count, sizeof (int32_t));
+
+    if ((cache->entries == NULL) || (cache->buckets == NULL)) {
+        free(cache->entries);
+        free(cache->buckets);
+        return false;
+    }
+
+    cache->capacity = capacity;
+    cache->bucket_mask = bucket_count - 1;
+    cache->max_age = max_age;
+
+    reset_entries(cache);
+
+    memset(cache->generations, 0, sizeof (cache->generations));
+
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->revalidations = 0;
+    cache->invalidations = 0;
+
+    pthread_mutex_init(&cache->lock, NULL);
+
+    return true;
+}
+
+/**
+ * @brief Release the cache and everything in it.
+ *
+ * @param cache
+ */
+void near_cache_destroy(struct near_cache_t* cache) {
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        if (cache->entries[i].used) {
+            free(cache->entries[i].key);
+            free(cache->entries[i].value);
+        }
+    }
+
+    free(cache->entries);
+    free(cache->buckets);
+
+    pthread_mutex_destroy(&cache->lock);
+}
+
+/**
+ * @brief Find the link that points at the entry for the
+ * given key, or at the end of its bucket's chain.
+ *
+ * @param cache
+ * @param key
+ * @param hash
+ * @return int32_t*
+ */
+static int32_t* find_link(struct near_cache_t* cache, const char* key, uint64_t hash) {
+    int32_t* link = &cache->buckets[hash & cache->bucket_mask];
+
+    while (*link != -1) {
+        struct near_entry_t* entry = &cache->entries[*link];
+
+        if ((entry->hash == hash) && (strcmp(entry->key, key) == 0)) {
+            break;
+        }
+
+        link = &entry->next;
+    }
+
+    return link;
+}
+
+/**
+ * @brief Unlink an entry from its bucket and put it back on
+ * the free list.
+ *
+ * @param cache
+ * @param link
+ */
+static void release_entry(struct near_cache_t* cache, int32_t* link) {
+    int32_t index = *link;
+    struct near_entry_t* entry = &cache->entries[index];
+
+    *link = entry->next;
+
+    free(entry->key);
+    free(entry->value);
+
+    entry->used = false;
+    entry->next = cache->free_list;
+    cache->free_list = index;
+}
+
+/**
+ * @brief Take an entry off of the free list, evicting one
+ * with CLOCK if there are none left.
+ *
+ * @param cache
+ * @return int32_t
+ */
+static int32_t allocate_entry(struct near_cache_t* cache) {
+    while (cache->free_list == -1) {
+        struct near_entry_t* entry = &cache->entries[cache->hand];
+        cache->hand = (cache->hand + 1) % cache->capacity;
+
+        if (entry->referenced) {
+            entry->referenced = false;
+            continue;
+        }
+
+        release_entry(cache, find_link(cache, entry->key, entry->hash));
+    }
+
+    int32_t index = cache->free_list;
+    cache->free_list = cache->entries[index].next;
+
+    return index;
+}
+
+/**
+ * @brief Look a key up in the cache.
+ *
+ * @details Whatever the outcome, the ticket is filled in so
+ * that the reply to any request the caller goes on to send
+ * can be cached safely. On a hit or a stale hit, the value
+ * is copied out, and must be freed by the caller.
+ *
+ * @param cache
+ * @param key
+ * @param now
+ * @param value
+ * @param version
+ * @param ticket
+ * @return NEAR_CACHE_HIT if the value can be used as it is,
+ * NEAR_CACHE_STALE if it must be revalidated first, and
+ * NEAR_CACHE_MISS if there is no value.
+ */
+enum near_cache_result_t near_cache_lookup(struct near_cache_t* cache, const char* key, uint64_t now, char** value, uint64_t* version, struct near_cache_ticket_t* ticket) {
+    enum near_cache_result_t result = NEAR_CACHE_MISS;
+    uint64_t hash = hash_key(key);
+
+    pthread_mutex_lock(&cache->lock);
+
+    ticket->hash = hash;
+    ticket->generation = *generation_of(cache, hash);
+
+    int32_t index = *find_link(cache, key, hash);
+
+    if (index != -1) {
+        struct near_entry_t* entry = &cache->entries[index];
+
+        *value = strdup(entry->value);
+        *version = entry->version;
+
+        if (*value == NULL) {
+            result = NEAR_CACHE_MISS;
+        } else if ((cache->max_age != 0) && (now - entry->validated_at >= cache->max_age)) {
+            result = NEAR_CACHE_STALE;
+        } else {
+            entry->referenced = true;
+            result = NEAR_CACHE_HIT;
+        }
+    }
+
+    switch (result) {
+        case NEAR_CACHE_HIT: ++cache->hits; break;
+        case NEAR_CACHE_STALE: ++cache->revalidations; break;
+        case NEAR_CACHE_MISS: ++cache->misses; break;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return result;
+}
+
+/**
+ * @brief Cache a value the server just sent, unless the key
+ * may have been invalidated since the request went out.
+ *
+ * @param cache
+ * @param key
+ * @param value
+ * @param version
+ * @param ticket
+ * @param now
+ */
+void near_cache_insert(struct near_cache_t* cache, const char* key, const char* value, uint64_t version, const struct near_cache_ticket_t* ticket, uint64_t now) {
+    char* value_copy = strdup(value);
+
+    if (value_copy == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (*generation_of(cache, ticket->hash) != ticket->generation) {
+        pthread_mutex_unlock(&cache->lock);
+        free(value_copy);
+        return;
+    }
+
+    int32_t* link = find_link(cache, key, ticket->hash);
+    struct near_entry_t* entry = NULL;
+
+    if (*link != -1) {
+        entry = &cache->entries[*link];
+        free(entry->value);
+    } else {
+        char* key_copy = strdup(key);
+
+        if (key_copy == NULL) {
+            pthread_mutex_unlock(&cache->lock);
+            free(value_copy);
+            return;
+        }
+
+        int32_t index = allocate_entry(cache);
+        entry = &cache->entries[index];
+
+        entry->key = key_copy;
+        entry->hash = ticket->hash;
+        entry->used = true;
+        entry->referenced = false;
+
+        link = &cache->buckets[ticket->hash & cache->bucket_mask];
+        entry->next = *link;
+        *link = index;
+    }
+
+    entry->value = value_copy;
+    entry->version = version;
+    entry->validated_at = now;
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Record that the server has confirmed a cached
+ * value is still current, restarting its age.
+ *
+ * @param cache
+ * @param key
+ * @param version
+ * @param ticket
+ * @param now
+ */
+void near_cache_revalidated(struct near_cache_t* cache, const char* key, uint64_t version, const struct near_cache_ticket_t* ticket, uint64_t now) {
+    pthread_mutex_lock(&cache->lock);
+
+    if (*generation_of(cache, ticket->hash) == ticket->generation) {
+        int32_t index = *find_link(cache, key, ticket->hash);
+
+        if ((index != -1) && (cache->entries[index].version == version)) {
+            cache->entries[index].validated_at = now;
+            cache->entries[index].referenced = true;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Forget a key, because it has changed or gone away.
+ *
+ * @param cache
+ * @param key
+ */
+void near_cache_invalidate(struct near_cache_t* cache, const char* key) {
+    uint64_t hash = hash_key(key);
+
+    pthread_mutex_lock(&cache->lock);
+
+    *generation_of(cache, hash) += 1;
+
+    int32_t* link = find_link(cache, key, hash);
+
+    if (*link != -1) {
+        release_entry(cache, link);
+    }
+
+    ++cache->invalidations;
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Forget everything, because some invalidations may
+ * have been missed.
+ *
+ * @param cache
+ */
+void near_cache_clear(struct near_cache_t* cache) {
+    pthread_mutex_lock(&cache->lock);
+
+    for (size_t i = 0; i < NEAR_CACHE_STRIPES; ++i) {
+        cache->generations[i] += 1;
+    }
+
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        if (cache->entries[i].used) {
+            free(cache->entries[i].key);
+            free(cache->entries[i].value);
+        }
+    }
+
+    reset_entries(cache);
+
+    pthread_mutex_unlock(&cache->lock);
+}
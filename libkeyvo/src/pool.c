@@ -0,0 +1,317 @@
+/**
+ *  Keyvo - Key-Value Caching Server
+ *  Copyright (C) Jose Fernando Lopez Fernandez, 2020.
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "pool.h"
+
+/**
+ * @brief Open a blocking stream connection to the server,
+ * over a Unix-domain socket if a path is given and over TCP
+ * otherwise.
+ *
+ * @param host
+ * @param port
+ * @param socket_path
+ * @return The socket, or -1 if the server could not be
+ * reached.
+ */
+int keyvo_connect(const char* host, const char* port, const char* socket_path) {
+    int client_socket = -1;
+
+    if (socket_path) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof (struct sockaddr_un));
+        address.sun_family = AF_UNIX;
+
+        if (strlen(socket_path) >= sizeof (address.sun_path)) {
+            return -1;
+        }
+
+        strcpy(address.sun_path, socket_path);
+
+        if ((client_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+            return -1;
+        }
+
+        if (connect(client_socket, (struct sockaddr *) &address, sizeof (address))) {
+            close(client_socket);
+            return -1;
+        }
+
+        return client_socket;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof (struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* server_address = NULL;
+
+    if (getaddrinfo(host, port, &hints, &server_address) != 0) {
+        return -1;
+    }
+
+    for (struct addrinfo* address = server_address; address; address = address->ai_next) {
+        client_socket = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+
+        if (client_socket == -1) {
+            continue;
+        }
+
+        if (connect(client_socket, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+
+        close(client_socket);
+        client_socket = -1;
+    }
+
+    freeaddrinfo(server_address);
+
+    if (client_socket != -1) {
+        int enable = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof (enable));
+    }
+
+    return client_socket;
+}
+
+/**
+ * @brief Write the whole buffer to the connection.
+ *
+ * @param connection
+ * @param data
+ * @param length
+ * @return false if the connection failed.
+ */
+bool connection_write(struct keyvo_connection_t* connection, const char* data, size_t length) {
+    while (length) {
+        ssize_t sent = send(connection->socket, data, length, MSG_NOSIGNAL);
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read the next line from the connection.
+ *
+ * @details The line is returned in place, without its
+ * newline, and stays valid until the next read.
+ *
+ * @param connection
+ * @return The line, or NULL if the connection failed or
+ * the server closed it.
+ */
+char* connection_read_line(struct keyvo_connection_t* connection) {
+    size_t scanned = 0;
+
+    while (1) {
+        char* start = connection->input + connection->input_start;
+        char* newline = (connection->input_length > scanned) ? memchr(start + scanned, '\n', connection->input_length - scanned) : NULL;
+
+        if (newline) {
+            *newline = '\0';
+
+            size_t consumed = (size_t) (newline - start) + 1;
+            connection->input_start += consumed;
+            connection->input_length -= consumed;
+
+            return start;
+        }
+
+        scanned = connection->input_length;
+
+        if (connection->input_start != 0) {
+            memmove(connection->input, start, connection->input_length);
+            connection->input_start = 0;
+        }
+
+        if (connection->input_length == connection->input_capacity) {
+            size_t capacity = connection->input_capacity ? 2 * connection->input_capacity : CONNECTION_INPUT_SIZE;
+            char* input = realloc(connection->input, capacity);
+
+            if (input == NULL) {
+                return NULL;
+            }
+
+            connection->input = input;
+            connection->input_capacity = capacity;
+        }
+
+        ssize_t bytes_received = recv(connection->socket, connection->input + connection->input_length, connection->input_capacity - connection->input_length, 0);
+
+        if (bytes_received == 0) {
+            return NULL;
+        }
+
+        if (bytes_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return NULL;
+        }
+
+        connection->input_length += bytes_received;
+    }
+}
+
+/**
+ * @brief Close the connection's socket, if it is open, and
+ * forget anything it had buffered.
+ *
+ * @param connection
+ */
+void connection_reset(struct keyvo_connection_t* connection) {
+    if (connection->socket != -1) {
+        close(connection->socket);
+    }
+
+    connection->socket = -1;
+    connection->input_start = 0;
+    connection->input_length = 0;
+}
+
+/**
+ * @brief Set up a pool of the given size. No connections
+ * are opened until they are first needed.
+ *
+ * @param pool
+ * @param size
+ * @param host
+ * @param port
+ * @param socket_path
+ * @return false if memory could not be allocated.
+ */
+bool pool_initialize(struct keyvo_pool_t* pool, size_t size, const char* host, const char* port, const char* socket_path) {
+    pool->connections = calloc(size, sizeof (struct keyvo_connection_t));
+    pool->busy = calloc(size, sizeof (bool));
+
+    if ((pool->connections == NULL) || (pool->busy == NULL)) {
+        free(pool->connections);
+        free(pool->busy);
+        return false;
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        pool->connections[i].socket = -1;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    pool->size = size;
+    pool->host = host;
+    pool->port = port;
+    pool->socket_path = socket_path;
+
+    return true;
+}
+
+/**
+ * @brief Close every connection and release the pool. No
+ * connection may still be in use.
+ *
+ * @param pool
+ */
+void pool_destroy(struct keyvo_pool_t* pool) {
+    for (size_t i = 0; i < pool->size; ++i) {
+        connection_reset(&pool->connections[i]);
+        free(pool->connections[i].input);
+    }
+
+    free(pool->connections);
+    free(pool->busy);
+
+    pthread_cond_destroy(&pool->available);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * @brief Take a connection from the pool, waiting for one
+ * to be released if they are all in use, and connecting it
+ * if it is not connected yet.
+ *
+ * @param pool
+ * @return The connection, or NULL if it could not be
+ * connected.
+ */
+struct keyvo_connection_t* pool_acquire(struct keyvo_pool_t* pool) {
+    size_t i = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        for (i = 0; i < pool->size; ++i) {
+            if (!pool->busy[i]) {
+                break;
+            }
+        }
+
+        if (i < pool->size) {
+            break;
+        }
+
+        pthread_cond_wait(&pool->available, &pool->lock);
+    }
+
+    pool->busy[i] = true;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    struct keyvo_connection_t* connection = &pool->connections[i];
+
+    if (connection->socket == -1) {
+        connection->socket = keyvo_connect(pool->host, pool->port, pool->socket_path);
+
+        if (connection->socket == -1) {
+            pool_release(pool, connection, false);
+            return NULL;
+        }
+    }
+
+    return connection;
+}
+
+/**
+ * @brief Give a connection back to the pool. A connection
+ * that failed, or was left in an unknown state, is closed,
+ * so that it will be reopened the next time it is needed.
+ *
+ * @param pool
+ * @param connection
+ * @param healthy
+ */
+void pool_release(struct keyvo_pool_t* pool, struct keyvo_connection_t* connection, bool healthy) {
+    if (!healthy) {
+        connection_reset(connection);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy[connection - pool->connections] = false;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}